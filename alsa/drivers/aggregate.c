@@ -0,0 +1,3 @@
+#include "adriver.h"
+#include "../alsa-kernel/drivers/aggregate.c"
+EXPORT_NO_SYMBOLS;
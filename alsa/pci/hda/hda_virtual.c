@@ -0,0 +1,2 @@
+#include "adriver.h"
+#include "../../alsa-kernel/pci/hda/hda_virtual.c"
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Compare two result files of bench.sh.
+#
+#   bench-compare.sh old.txt new.txt
+#
+# Prints ns_per_op of both runs for every test (and period size for the
+# PCM tests) that appears in both, with the relative change; tests
+# slower by more than the threshold (default 5%, set THRESHOLD=n) are
+# flagged as regressions and make the script exit with 1.
+
+if [ $# -ne 2 ]; then
+	echo "usage: bench-compare.sh old.txt new.txt" >&2
+	exit 2
+fi
+
+awk -v threshold=${THRESHOLD:-5} '
+function field(name,   i) {
+	for (i = 1; i <= NF; i++)
+		if (index($i, name "=") == 1)
+			return substr($i, length(name) + 2)
+	return ""
+}
+/^bench=/ {
+	key = field("bench") " " field("device")
+	if (field("period") != "")
+		key = key " period=" field("period")
+	if (FILENAME == ARGV[1]) {
+		old[key] = field("ns_per_op")
+	} else if (key in old) {
+		n = field("ns_per_op")
+		o = old[key]
+		change = o > 0 ? (n - o) * 100 / o : 0
+		flag = ""
+		if (change > threshold) {
+			flag = "  REGRESSION"
+			bad++
+		}
+		printf "%-40s %10d %10d %+7.1f%%%s\n", key, o, n, change, flag
+	}
+}
+END { exit bad ? 1 : 0 }
+' "$1" "$2"
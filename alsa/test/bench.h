@@ -0,0 +1,92 @@
+/*
+ * Common helpers for the PCM core benchmarks (pcmbench, ctlbench,
+ * seqbench).  The benchmarks talk to the kernel interfaces directly,
+ * without alsa-lib, so that only the driver side is measured.
+ *
+ * Every result is printed as a single line of key=value pairs, e.g.
+ *
+ *   bench=pcm_rw device=/dev/snd/pcmC0D0p ops=100000 ns_per_op=812
+ *
+ * which bench-compare.sh can match up between two runs.
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static inline unsigned long long bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* system time used by this process in usec */
+static inline unsigned long long bench_sys_us(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_stime.tv_sec * 1000000ULL + ru.ru_stime.tv_usec;
+}
+
+struct bench_run {
+	const char *name;
+	const char *device;
+	unsigned long long ops;
+	unsigned long long start_ns;
+	unsigned long long start_sys_us;
+};
+
+static inline void bench_begin(struct bench_run *run, const char *name,
+			       const char *device)
+{
+	run->name = name;
+	run->device = device;
+	run->ops = 0;
+	run->start_sys_us = bench_sys_us();
+	run->start_ns = bench_now_ns();
+}
+
+/*
+ * Print the result line; extra is appended verbatim (may be NULL) and
+ * frames, if non-zero, gives the number of frames moved for a
+ * frames_per_sec figure.
+ */
+static inline void bench_end(struct bench_run *run, unsigned long long frames,
+			     const char *extra)
+{
+	unsigned long long ns = bench_now_ns() - run->start_ns;
+	unsigned long long sys = bench_sys_us() - run->start_sys_us;
+
+	if (!ns)
+		ns = 1;
+	printf("bench=%s device=%s ops=%llu ns_per_op=%llu ops_per_sec=%llu sys_us=%llu",
+	       run->name, run->device, run->ops,
+	       run->ops ? ns / run->ops : 0,
+	       run->ops * 1000000000ULL / ns, sys);
+	if (frames)
+		printf(" frames_per_sec=%llu", frames * 1000000000ULL / ns);
+	if (extra)
+		printf(" %s", extra);
+	printf("\n");
+	fflush(stdout);
+}
+
+/* run for at least this long; checked every BENCH_CHECK ops */
+#define BENCH_CHECK	64
+
+static inline int bench_done(struct bench_run *run, double seconds)
+{
+	if (run->ops % BENCH_CHECK)
+		return 0;
+	return bench_now_ns() - run->start_ns >= seconds * 1e9;
+}
+
+#endif /* __BENCH_H */
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Run the PCM core benchmark suite against snd-dummy and snd-aloop.
+#
+#   bench.sh [seconds] > results.txt
+#
+# Loads the modules if needed (requires root), runs pcmbench on the
+# playback and capture devices of both cards, ctlbench on both cards
+# and seqbench, and writes one key=value result line per test to
+# stdout.  Compare two runs with bench-compare.sh.
+
+secs=${1:-2}
+dir=$(dirname "$0")
+
+card_of() {
+	# card index from the id in /proc/asound/cards
+	sed -n "s/^ *\([0-9]*\) \[$1 *\].*/\1/p" /proc/asound/cards | head -n 1
+}
+
+for mod in snd-dummy snd-aloop snd-seq; do
+	modname=$(echo $mod | tr - _)
+	grep -q "^$modname " /proc/modules || modprobe $mod || exit 1
+done
+
+echo "# $(uname -r) $(date -u +%Y-%m-%dT%H:%M:%SZ)"
+for id in Dummy Loopback; do
+	card=$(card_of $id)
+	if [ -z "$card" ]; then
+		echo "$id card not found" >&2
+		continue
+	fi
+	for dev in /dev/snd/pcmC${card}D0p /dev/snd/pcmC${card}D0c; do
+		for period in 64 1024; do
+			$dir/pcmbench -s $secs -p $period $dev
+		done
+	done
+	$dir/ctlbench -s $secs $card
+done
+$dir/seqbench -s $secs
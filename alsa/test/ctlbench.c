@@ -0,0 +1,143 @@
+/*
+ * Control interface benchmark.
+ *
+ * Measures the rate of ELEM_LIST, ELEM_INFO, ELEM_READ and ELEM_WRITE
+ * ioctls on a card's control device.  Read and write go to the first
+ * writable integer or boolean element (on snd-dummy the master volume;
+ * on snd-aloop the PCM rate shift) and write toggles the value so that
+ * every call changes it and fires a notification.
+ *
+ *   ctlbench [-s seconds] [card]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+#include "bench.h"
+
+static double seconds = 2;
+
+static int find_elem(int fd, struct snd_ctl_elem_info *info)
+{
+	struct snd_ctl_elem_list list;
+	struct snd_ctl_elem_id *ids;
+	unsigned int i;
+
+	memset(&list, 0, sizeof(list));
+	if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &list) < 0)
+		return -1;
+	ids = calloc(list.count, sizeof(*ids));
+	if (!ids)
+		return -1;
+	list.space = list.count;
+	list.pids = ids;
+	if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &list) < 0) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < list.used; i++) {
+		memset(info, 0, sizeof(*info));
+		info->id = ids[i];
+		if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_INFO, info) < 0)
+			continue;
+		if (!(info->access & SNDRV_CTL_ELEM_ACCESS_WRITE))
+			continue;
+		if (info->type == SNDRV_CTL_ELEM_TYPE_INTEGER ||
+		    info->type == SNDRV_CTL_ELEM_TYPE_BOOLEAN) {
+			free(ids);
+			return 0;
+		}
+	}
+	free(ids);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct snd_ctl_elem_info info;
+	struct snd_ctl_elem_list list;
+	struct snd_ctl_elem_id ids[32];
+	struct snd_ctl_elem_value val;
+	struct bench_run run;
+	char device[32];
+	long lo, hi;
+	int c, fd;
+
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':
+			seconds = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: ctlbench [-s seconds] [card]\n");
+			return 1;
+		}
+	}
+	sprintf(device, "/dev/snd/controlC%d",
+		optind < argc ? atoi(argv[optind]) : 0);
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	if (find_elem(fd, &info) < 0) {
+		fprintf(stderr, "%s: no writable integer control\n", device);
+		close(fd);
+		return 1;
+	}
+	if (info.type == SNDRV_CTL_ELEM_TYPE_INTEGER) {
+		lo = info.value.integer.min;
+		hi = info.value.integer.max;
+	} else {
+		lo = 0;
+		hi = 1;
+	}
+
+	bench_begin(&run, "ctl_list", device);
+	while (!bench_done(&run, seconds)) {
+		memset(&list, 0, sizeof(list));
+		list.space = 32;
+		list.pids = ids;
+		if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &list) < 0)
+			break;
+		run.ops++;
+	}
+	bench_end(&run, 0, NULL);
+
+	bench_begin(&run, "ctl_info", device);
+	while (!bench_done(&run, seconds)) {
+		if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_INFO, &info) < 0)
+			break;
+		run.ops++;
+	}
+	bench_end(&run, 0, NULL);
+
+	memset(&val, 0, sizeof(val));
+	val.id = info.id;
+	bench_begin(&run, "ctl_read", device);
+	while (!bench_done(&run, seconds)) {
+		if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_READ, &val) < 0)
+			break;
+		run.ops++;
+	}
+	bench_end(&run, 0, NULL);
+
+	bench_begin(&run, "ctl_write", device);
+	while (!bench_done(&run, seconds)) {
+		unsigned int i;
+
+		for (i = 0; i < info.count; i++)
+			val.value.integer.value[i] = (run.ops & 1) ? hi : lo;
+		if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &val) < 0)
+			break;
+		run.ops++;
+	}
+	bench_end(&run, 0, NULL);
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Measure the CPU cost of the OSS rate conversion plugin.
+ *
+ * Plays a sine through /dev/dsp at a rate the hardware doesn't support
+ * (e.g. 44100Hz on snd-dummy with model=ac97, which is 48kHz only) for
+ * each rate_quality setting of snd-pcm-oss and prints the system time
+ * spent per second of audio.
+ *
+ *   ossrate [device] [rate] [channels] [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <linux/soundcard.h>
+
+#define QUALITY_PARAM	"/sys/module/snd_pcm_oss/parameters/rate_quality"
+#define FRAMES		1024
+
+static int set_quality(int quality)
+{
+	FILE *f = fopen(QUALITY_PARAM, "w");
+
+	if (!f) {
+		perror(QUALITY_PARAM);
+		return -1;
+	}
+	fprintf(f, "%d\n", quality);
+	return fclose(f);
+}
+
+static long sys_usec(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_stime.tv_sec * 1000000L + ru.ru_stime.tv_usec;
+}
+
+static int run(const char *device, int quality, int rate, int channels,
+	       int seconds)
+{
+	short buf[FRAMES * 8];
+	int fd, i, c, fmt = AFMT_S16_LE, val;
+	long frames, start;
+	double phase = 0;
+
+	if (set_quality(quality) < 0)
+		return -1;
+	fd = open(device, O_WRONLY);
+	if (fd < 0) {
+		perror(device);
+		return -1;
+	}
+	val = channels;
+	if (ioctl(fd, SNDCTL_DSP_SETFMT, &fmt) < 0 ||
+	    ioctl(fd, SNDCTL_DSP_CHANNELS, &val) < 0 || val != channels) {
+		fprintf(stderr, "cannot set S16 / %d channels\n", channels);
+		close(fd);
+		return -1;
+	}
+	val = rate;
+	if (ioctl(fd, SNDCTL_DSP_SPEED, &val) < 0 || val != rate) {
+		fprintf(stderr, "cannot set rate %d\n", rate);
+		close(fd);
+		return -1;
+	}
+	start = sys_usec();
+	for (frames = 0; frames < (long)rate * seconds; frames += FRAMES) {
+		for (i = 0; i < FRAMES; i++) {
+			for (c = 0; c < channels; c++)
+				buf[i * channels + c] = 16000 * sin(phase);
+			phase += 2 * M_PI * 1000 / rate;
+		}
+		if (write(fd, buf, FRAMES * channels * 2) < 0) {
+			perror("write");
+			break;
+		}
+	}
+	ioctl(fd, SNDCTL_DSP_SYNC, 0);
+	close(fd);
+	printf("quality=%d channels=%d rate=%d sys_us_per_sec=%ld\n",
+	       quality, channels, rate, (sys_usec() - start) / seconds);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *device = argc > 1 ? argv[1] : "/dev/dsp";
+	int rate = argc > 2 ? atoi(argv[2]) : 44100;
+	int channels = argc > 3 ? atoi(argv[3]) : 2;
+	int seconds = argc > 4 ? atoi(argv[4]) : 10;
+	int quality;
+
+	if (channels < 1 || channels > 8 || seconds < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	for (quality = 0; quality <= 3; quality++)
+		if (run(device, quality, rate, channels, seconds) < 0)
+			return 1;
+	set_quality(0);
+	return 0;
+}
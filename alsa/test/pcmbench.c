@@ -0,0 +1,354 @@
+/*
+ * PCM core benchmark.
+ *
+ * Drives a PCM device (snd-dummy or snd-aloop are the intended targets)
+ * through the kernel ioctl interface and measures:
+ *
+ *   churn - open / hw_params / sw_params / prepare / start / drop /
+ *           hw_free / close cycles
+ *   rw    - WRITEI + REWIND on a stopped stream, i.e. the write
+ *           transfer path without waiting for the hardware; capture
+ *           has to read in real time, so there sys_us is the figure
+ *           to look at
+ *   mmap  - copy into the mmapped buffer + SYNC_PTR commit, the mmap
+ *           counterpart of rw
+ *
+ *   pcmbench [-t test] [-s seconds] [-p period] [-n periods]
+ *            [-c channels] [-r rate] device
+ *
+ * device is a PCM device node such as /dev/snd/pcmC0D0p.  Without -t
+ * all tests are run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sound/asound.h>
+#include "bench.h"
+
+static const char *device;
+static double seconds = 2;
+static unsigned int rate = 48000;
+static unsigned int channels = 2;
+static unsigned int period_size = 256;
+static unsigned int periods = 4;
+static int capture;
+
+#define FRAME_BYTES	(channels * 2)
+
+static struct snd_mask *param_mask(struct snd_pcm_hw_params *p, int n)
+{
+	return &p->masks[n - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+}
+
+static struct snd_interval *param_interval(struct snd_pcm_hw_params *p, int n)
+{
+	return &p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+static void param_init(struct snd_pcm_hw_params *p)
+{
+	int n;
+
+	memset(p, 0, sizeof(*p));
+	for (n = SNDRV_PCM_HW_PARAM_FIRST_MASK;
+	     n <= SNDRV_PCM_HW_PARAM_LAST_MASK; n++)
+		memset(param_mask(p, n), 0xff, sizeof(struct snd_mask));
+	for (n = SNDRV_PCM_HW_PARAM_FIRST_INTERVAL;
+	     n <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL; n++) {
+		param_interval(p, n)->min = 0;
+		param_interval(p, n)->max = UINT_MAX;
+	}
+	p->rmask = ~0U;
+	p->info = ~0U;
+}
+
+static void param_set_mask(struct snd_pcm_hw_params *p, int n, unsigned int bit)
+{
+	struct snd_mask *m = param_mask(p, n);
+
+	memset(m, 0, sizeof(*m));
+	m->bits[bit >> 5] = 1U << (bit & 31);
+}
+
+static void param_set_int(struct snd_pcm_hw_params *p, int n, unsigned int val)
+{
+	struct snd_interval *i = param_interval(p, n);
+
+	i->min = i->max = val;
+	i->integer = 1;
+}
+
+/* print the result with the period size, which is part of the key */
+static void pcm_bench_end(struct bench_run *run, unsigned long long frames)
+{
+	char extra[32];
+
+	snprintf(extra, sizeof(extra), "period=%u", period_size);
+	bench_end(run, frames, extra);
+}
+
+static int pcm_open(int mmap_access)
+{
+	struct snd_pcm_hw_params hw;
+	struct snd_pcm_sw_params sw;
+	int fd;
+
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		perror(device);
+		return -1;
+	}
+	param_init(&hw);
+	param_set_mask(&hw, SNDRV_PCM_HW_PARAM_ACCESS,
+		       mmap_access ? SNDRV_PCM_ACCESS_MMAP_INTERLEAVED :
+				     SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	param_set_mask(&hw, SNDRV_PCM_HW_PARAM_FORMAT, SNDRV_PCM_FORMAT_S16_LE);
+	param_set_mask(&hw, SNDRV_PCM_HW_PARAM_SUBFORMAT,
+		       SNDRV_PCM_SUBFORMAT_STD);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_CHANNELS, channels);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_RATE, rate);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, period_size);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_PERIODS, periods);
+	if (ioctl(fd, SNDRV_PCM_IOCTL_HW_PARAMS, &hw) < 0) {
+		perror("hw_params");
+		close(fd);
+		return -1;
+	}
+
+	memset(&sw, 0, sizeof(sw));
+	sw.tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sw.period_step = 1;
+	sw.avail_min = period_size;
+	/* never start implicitly and never stop on xrun */
+	sw.start_threshold = LONG_MAX;
+	sw.stop_threshold = LONG_MAX;
+	if (ioctl(fd, SNDRV_PCM_IOCTL_SW_PARAMS, &sw) < 0) {
+		perror("sw_params");
+		close(fd);
+		return -1;
+	}
+	if (ioctl(fd, SNDRV_PCM_IOCTL_PREPARE) < 0) {
+		perror("prepare");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int test_churn(void)
+{
+	struct bench_run run;
+	struct snd_xferi xfer;
+	char *buf;
+	int fd, err = 0;
+
+	buf = calloc(period_size, FRAME_BYTES);
+	if (!buf)
+		return -1;
+	bench_begin(&run, "pcm_churn", device);
+	while (!bench_done(&run, seconds)) {
+		fd = pcm_open(0);
+		if (fd < 0) {
+			err = -1;
+			break;
+		}
+		if (!capture) {
+			/* playback needs some data before START */
+			xfer.buf = buf;
+			xfer.frames = period_size;
+			ioctl(fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &xfer);
+		}
+		if (ioctl(fd, SNDRV_PCM_IOCTL_START) < 0) {
+			perror("start");
+			err = -1;
+		}
+		ioctl(fd, SNDRV_PCM_IOCTL_DROP);
+		ioctl(fd, SNDRV_PCM_IOCTL_HW_FREE);
+		close(fd);
+		if (err)
+			break;
+		run.ops++;
+	}
+	if (!err)
+		pcm_bench_end(&run, 0);
+	free(buf);
+	return err;
+}
+
+static int test_rw(void)
+{
+	struct bench_run run;
+	struct snd_xferi xfer;
+	snd_pcm_uframes_t pos = 0, buffer_size = period_size * periods;
+	unsigned long long frames = 0;
+	char *buf;
+	int fd, err = 0;
+
+	fd = pcm_open(0);
+	if (fd < 0)
+		return -1;
+	buf = calloc(period_size, FRAME_BYTES);
+	if (!buf) {
+		close(fd);
+		return -1;
+	}
+	/* capture has to run to have something to read */
+	if (capture && ioctl(fd, SNDRV_PCM_IOCTL_START) < 0) {
+		perror("start");
+		err = -1;
+	}
+	bench_begin(&run, capture ? "pcm_read" : "pcm_write", device);
+	while (!err && !bench_done(&run, seconds)) {
+		if (capture) {
+			xfer.buf = buf;
+			xfer.frames = period_size;
+			if (ioctl(fd, SNDRV_PCM_IOCTL_READI_FRAMES, &xfer) < 0) {
+				perror("readi");
+				err = -1;
+				break;
+			}
+		} else {
+			xfer.buf = buf;
+			xfer.frames = period_size;
+			if (ioctl(fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &xfer) < 0) {
+				perror("writei");
+				err = -1;
+				break;
+			}
+			pos += period_size;
+			if (pos >= buffer_size) {
+				/* take it all back, the stream never starts */
+				if (ioctl(fd, SNDRV_PCM_IOCTL_REWIND, &pos) < 0) {
+					perror("rewind");
+					err = -1;
+					break;
+				}
+				pos = 0;
+			}
+		}
+		frames += period_size;
+		run.ops++;
+	}
+	if (!err)
+		pcm_bench_end(&run, frames);
+	ioctl(fd, SNDRV_PCM_IOCTL_DROP);
+	close(fd);
+	free(buf);
+	return err;
+}
+
+static int test_mmap(void)
+{
+	struct bench_run run;
+	struct snd_pcm_sync_ptr sync;
+	snd_pcm_uframes_t buffer_size = period_size * periods;
+	unsigned long long frames = 0;
+	size_t bytes = buffer_size * FRAME_BYTES;
+	char *area, *buf;
+	int fd, err = 0;
+
+	if (capture) {
+		/* reading back a stopped buffer is not interesting */
+		return 0;
+	}
+	fd = pcm_open(1);
+	if (fd < 0)
+		return -1;
+	area = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		    SNDRV_PCM_MMAP_OFFSET_DATA);
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return -1;
+	}
+	buf = calloc(period_size, FRAME_BYTES);
+	if (!buf) {
+		munmap(area, bytes);
+		close(fd);
+		return -1;
+	}
+	memset(&sync, 0, sizeof(sync));
+	sync.c.control.avail_min = period_size;
+	bench_begin(&run, "pcm_mmap", device);
+	while (!bench_done(&run, seconds)) {
+		snd_pcm_uframes_t ofs = sync.c.control.appl_ptr % buffer_size;
+
+		memcpy(area + ofs * FRAME_BYTES, buf,
+		       period_size * FRAME_BYTES);
+		sync.flags = SNDRV_PCM_SYNC_PTR_HWSYNC;
+		sync.c.control.appl_ptr += period_size;
+		if (sync.c.control.appl_ptr >= buffer_size)
+			sync.c.control.appl_ptr = 0;
+		if (ioctl(fd, SNDRV_PCM_IOCTL_SYNC_PTR, &sync) < 0) {
+			perror("sync_ptr");
+			err = -1;
+			break;
+		}
+		frames += period_size;
+		run.ops++;
+	}
+	if (!err)
+		pcm_bench_end(&run, frames);
+	ioctl(fd, SNDRV_PCM_IOCTL_DROP);
+	munmap(area, bytes);
+	close(fd);
+	free(buf);
+	return err;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pcmbench [-t churn|rw|mmap] [-s seconds] "
+		"[-p period] [-n periods] [-c channels] [-r rate] device\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *test = NULL;
+	int c, err = 0;
+
+	while ((c = getopt(argc, argv, "t:s:p:n:c:r:")) != -1) {
+		switch (c) {
+		case 't':
+			test = optarg;
+			break;
+		case 's':
+			seconds = atof(optarg);
+			break;
+		case 'p':
+			period_size = atoi(optarg);
+			break;
+		case 'n':
+			periods = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !period_size || periods < 2 || !channels)
+		usage();
+	device = argv[optind];
+	capture = device[strlen(device) - 1] == 'c';
+
+	if (!test || !strcmp(test, "churn"))
+		err |= test_churn();
+	if (!test || !strcmp(test, "rw"))
+		err |= test_rw();
+	if (!test || !strcmp(test, "mmap"))
+		err |= test_mmap();
+	return err ? 1 : 0;
+}
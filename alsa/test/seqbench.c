@@ -0,0 +1,134 @@
+/*
+ * Sequencer core benchmark.
+ *
+ * Creates a client with one port on /dev/snd/seq and sends note events
+ * to itself with direct dispatch, reading them back from the input
+ * pool.  Reports the round trip event rate for several batch sizes,
+ * which mostly exercises the client write path, event cell allocation,
+ * delivery and the FIFO.
+ *
+ *   seqbench [-s seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+#include <sound/asequencer.h>
+#include "bench.h"
+
+#define DEVICE	"/dev/snd/seq"
+#define MAX_BATCH	256
+
+static double seconds = 2;
+
+static int run_batch(int fd, int client, int port, int batch)
+{
+	struct snd_seq_event ev[MAX_BATCH];
+	struct bench_run run;
+	struct pollfd pfd;
+	char name[32];
+	int i, got;
+	ssize_t n;
+
+	memset(ev, 0, sizeof(ev));
+	for (i = 0; i < batch; i++) {
+		ev[i].type = SNDRV_SEQ_EVENT_NOTEON;
+		ev[i].flags = SNDRV_SEQ_TIME_STAMP_TICK |
+			SNDRV_SEQ_EVENT_LENGTH_FIXED;
+		ev[i].queue = SNDRV_SEQ_QUEUE_DIRECT;
+		ev[i].source.port = port;
+		ev[i].dest.client = client;
+		ev[i].dest.port = port;
+		ev[i].data.note.note = 60 + (i & 15);
+		ev[i].data.note.velocity = 100;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	sprintf(name, "seq_direct_%d", batch);
+	bench_begin(&run, name, DEVICE);
+	while (!bench_done(&run, seconds)) {
+		n = write(fd, ev, batch * sizeof(ev[0]));
+		if (n != (ssize_t)(batch * sizeof(ev[0]))) {
+			perror("write");
+			return -1;
+		}
+		for (got = 0; got < batch; ) {
+			struct snd_seq_event in[MAX_BATCH];
+
+			if (poll(&pfd, 1, 1000) <= 0) {
+				fprintf(stderr, "lost events\n");
+				return -1;
+			}
+			n = read(fd, in, sizeof(in));
+			if (n < 0) {
+				perror("read");
+				return -1;
+			}
+			got += n / sizeof(in[0]);
+		}
+		/* count events, not writes */
+		run.ops += batch;
+	}
+	bench_end(&run, 0, NULL);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const int batches[] = { 1, 16, MAX_BATCH };
+	struct snd_seq_port_info port;
+	struct snd_seq_client_pool pool;
+	int c, i, fd, client;
+
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':
+			seconds = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: seqbench [-s seconds]\n");
+			return 1;
+		}
+	}
+	fd = open(DEVICE, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		perror(DEVICE);
+		return 1;
+	}
+	if (ioctl(fd, SNDRV_SEQ_IOCTL_CLIENT_ID, &client) < 0) {
+		perror("client_id");
+		return 1;
+	}
+
+	/* make room for a full batch in both directions */
+	memset(&pool, 0, sizeof(pool));
+	pool.client = client;
+	if (ioctl(fd, SNDRV_SEQ_IOCTL_GET_CLIENT_POOL, &pool) == 0) {
+		pool.output_pool = MAX_BATCH * 2;
+		pool.input_pool = MAX_BATCH * 2;
+		pool.output_room = MAX_BATCH;
+		ioctl(fd, SNDRV_SEQ_IOCTL_SET_CLIENT_POOL, &pool);
+	}
+
+	memset(&port, 0, sizeof(port));
+	port.addr.client = client;
+	strcpy(port.name, "seqbench");
+	port.capability = SNDRV_SEQ_PORT_CAP_READ | SNDRV_SEQ_PORT_CAP_WRITE;
+	port.type = SNDRV_SEQ_PORT_TYPE_APPLICATION;
+	if (ioctl(fd, SNDRV_SEQ_IOCTL_CREATE_PORT, &port) < 0) {
+		perror("create_port");
+		return 1;
+	}
+
+	for (i = 0; i < (int)(sizeof(batches) / sizeof(batches[0])); i++)
+		if (run_batch(fd, client, port.addr.port, batches[i]) < 0)
+			return 1;
+	close(fd);
+	return 0;
+}
@@ -61,6 +61,7 @@ struct snd_kcontrol_volatile {
 
 struct snd_kcontrol {
 	struct list_head list;		/* list of controls */
+	struct list_head hash_list;	/* list in card->ctl_hash */
 	struct snd_ctl_elem_id id;
 	unsigned int count;		/* count of same elements */
 	snd_kcontrol_info_t *info;
@@ -78,6 +79,18 @@ struct snd_kcontrol {
 
 #define snd_kcontrol(n) list_entry(n, struct snd_kcontrol, list)
 
+/* descriptor of a control instantiated on demand, see snd_ctl_add_lazy() */
+struct snd_kcontrol_lazy {
+	struct list_head list;		/* list in card->ctl_lazy */
+	struct snd_ctl_elem_id id;
+	const struct snd_kcontrol_new *knew;	/* template */
+	void *private_data;
+	unsigned long private_value;
+	/* called before the instance is added; not added on error */
+	int (*instantiate)(struct snd_kcontrol_lazy *lazy,
+			   struct snd_kcontrol *kctl);
+};
+
 struct snd_kctl_event {
 	struct list_head list;	/* list of events */
 	struct snd_ctl_elem_id id;
@@ -120,6 +133,15 @@ int snd_ctl_activate_id(struct snd_card *card, struct snd_ctl_elem_id *id,
 			int active);
 struct snd_kcontrol *snd_ctl_find_numid(struct snd_card * card, unsigned int numid);
 struct snd_kcontrol *snd_ctl_find_id(struct snd_card * card, struct snd_ctl_elem_id *id);
+int snd_ctl_enable_hash(struct snd_card *card);
+void snd_ctl_lazy_init(struct snd_kcontrol_lazy *lazy,
+		       const struct snd_kcontrol_new *knew, void *private_data);
+int snd_ctl_add_lazy(struct snd_card *card, struct snd_kcontrol_lazy *lazy);
+void snd_ctl_remove_lazy(struct snd_card *card,
+			 struct snd_kcontrol_lazy *lazy);
+struct snd_kcontrol_lazy *snd_ctl_find_lazy(struct snd_card *card,
+					    struct snd_ctl_elem_id *id);
+void snd_ctl_instantiate_lazy(struct snd_card *card);
 
 int snd_ctl_create(struct snd_card *card);
 
@@ -119,6 +119,8 @@ struct snd_card {
 	int controls_count;		/* count of all controls */
 	int user_ctl_count;		/* count of all user controls */
 	struct list_head controls;	/* all controls for this card */
+	struct list_head *ctl_hash;	/* controls hashed by name (optional) */
+	struct list_head ctl_lazy;	/* controls not instantiated yet */
 	struct list_head ctl_files;	/* active control files */
 
 	struct snd_info_entry *proc_root;	/* root for soundcard specific files */
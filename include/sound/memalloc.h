@@ -151,6 +151,12 @@ void snd_dma_free_pages(struct snd_dma_buffer *dmab);
 size_t snd_dma_get_reserved_buf(struct snd_dma_buffer *dmab, unsigned int id);
 int snd_dma_reserve_buf(struct snd_dma_buffer *dmab, unsigned int id);
 
+/* pool of released buffers */
+int snd_dma_pool_get(int type, struct device *dev, size_t size,
+		     struct snd_dma_buffer *dmab);
+void snd_dma_pool_put(struct snd_dma_buffer *dmab);
+void snd_dma_pool_flush(const struct snd_dma_device *dev);
+
 /* basic memory allocation functions */
 void *snd_malloc_pages(size_t size, gfp_t gfp_flags);
 void snd_free_pages(void *ptr, size_t size);
@@ -30,6 +30,7 @@
 #include <linux/mm.h>
 #include <linux/bitops.h>
 #include <linux/pm_qos.h>
+#include <linux/hrtimer.h>
 
 #define snd_pcm_substream_chip(substream) ((substream)->private_data)
 #define snd_pcm_chip(pcm) ((pcm)->private_data)
@@ -109,6 +110,7 @@ struct snd_pcm_ops {
 #define SNDRV_PCM_TRIGGER_PAUSE_RELEASE	4
 #define SNDRV_PCM_TRIGGER_SUSPEND	5
 #define SNDRV_PCM_TRIGGER_RESUME	6
+#define SNDRV_PCM_TRIGGER_START_AT	7	/* start at runtime->start_at_tstamp */
 
 #define SNDRV_PCM_POS_XRUN		((snd_pcm_uframes_t)-1)
 
@@ -273,6 +275,14 @@ struct snd_pcm_hw_constraint_list {
 };
 
 struct snd_pcm_hwptr_log;
+struct snd_pcm_hw_refine_cache;
+
+#ifdef CONFIG_SND_VERBOSE_PROCFS
+struct snd_pcm_hwptr_trace {
+	u64 seq;			/* number of recorded updates */
+	struct snd_pcm_hwptr_trace_entry entries[SNDRV_PCM_HWPTR_TRACE_ENTRIES];
+};
+#endif
 
 struct snd_pcm_runtime {
 	/* -- Status -- */
@@ -286,6 +296,8 @@ struct snd_pcm_runtime {
 	unsigned long hw_ptr_buffer_jiffies; /* buffer time in jiffies */
 	snd_pcm_sframes_t delay;	/* extra delay; typically FIFO size */
 	u64 hw_ptr_wrap;                /* offset for hw_ptr due to boundary wrap-around */
+	unsigned long xrun_count;	/* xruns detected by the PCM core */
+	unsigned long hw_ptr_corrections; /* positions fixed up by hw_ptr update */
 
 	/* -- HW params -- */
 	snd_pcm_access_t access;	/* access mode */
@@ -304,6 +316,7 @@ struct snd_pcm_runtime {
 	unsigned int rate_num;
 	unsigned int rate_den;
 	unsigned int no_period_wakeup: 1;
+	unsigned int timer_wakeup: 1;	/* wake up waiters by wakeup_timer */
 
 	/* -- SW params -- */
 	int tstamp_mode;		/* mmap timestamp is updated */
@@ -337,6 +350,7 @@ struct snd_pcm_runtime {
 	/* -- hardware description -- */
 	struct snd_pcm_hardware hw;
 	struct snd_pcm_hw_constraints hw_constraints;
+	struct snd_pcm_hw_refine_cache *hw_refine_cache;
 
 	/* -- interrupt callbacks -- */
 	void (*transfer_ack_begin)(struct snd_pcm_substream *substream);
@@ -345,6 +359,8 @@ struct snd_pcm_runtime {
 	/* -- timer -- */
 	unsigned int timer_resolution;	/* timer resolution */
 	int tstamp_type;		/* timestamp type */
+	struct timespec driver_trigger_tstamp;	/* when the driver was triggered */
+	struct timespec start_at_tstamp;	/* deadline for TRIGGER_START_AT */
 
 	/* -- DMA -- */           
 	unsigned char *dma_area;	/* DMA area */
@@ -383,6 +399,7 @@ struct snd_pcm_substream {
 	struct snd_dma_buffer dma_buffer;
 	unsigned int dma_buf_id;
 	size_t dma_max;
+	struct snd_dma_buffer *dma_buffer_cache; /* kept over hw_free */
 	/* -- hardware operations -- */
 	const struct snd_pcm_ops *ops;
 	/* -- runtime information -- */
@@ -390,6 +407,8 @@ struct snd_pcm_substream {
         /* -- timer section -- */
 	struct snd_timer *timer;		/* timer */
 	unsigned timer_running: 1;	/* time is running */
+	struct hrtimer wakeup_timer;	/* for runtime->timer_wakeup */
+	struct hrtimer start_at_timer;	/* emulated SNDRV_PCM_IOCTL_START_AT */
 	/* -- next substream -- */
 	struct snd_pcm_substream *next;
 	/* -- linked substreams -- */
@@ -415,6 +434,8 @@ struct snd_pcm_substream {
 	struct snd_info_entry *proc_status_entry;
 	struct snd_info_entry *proc_prealloc_entry;
 	struct snd_info_entry *proc_prealloc_max_entry;
+	struct snd_info_entry *proc_hwptr_trace_entry;
+	struct snd_pcm_hwptr_trace *hwptr_trace; /* kept until the PCM is freed */
 #endif
 	/* misc flags */
 	unsigned int hw_opened: 1;
@@ -437,6 +458,8 @@ struct snd_pcm_str {
 #ifdef CONFIG_SND_VERBOSE_PROCFS
 	struct snd_info_entry *proc_root;
 	struct snd_info_entry *proc_info_entry;
+	unsigned int hwptr_trace;	/* record hw_ptr updates of opened substreams */
+	struct snd_info_entry *proc_hwptr_trace_entry;
 #ifdef CONFIG_SND_PCM_XRUN_DEBUG
 	unsigned int xrun_debug;	/* 0 = disabled, 1 = verbose, 2 = stacktrace */
 	struct snd_info_entry *proc_xrun_debug_entry;
@@ -502,6 +525,7 @@ int snd_pcm_status(struct snd_pcm_substream *substream,
 		   struct snd_pcm_status *status);
 int snd_pcm_start(struct snd_pcm_substream *substream);
 int snd_pcm_stop(struct snd_pcm_substream *substream, snd_pcm_state_t status);
+void snd_pcm_start_at_timer_init(struct snd_pcm_substream *substream);
 int snd_pcm_drain_done(struct snd_pcm_substream *substream);
 #ifdef CONFIG_PM
 int snd_pcm_suspend(struct snd_pcm_substream *substream);
@@ -802,6 +826,8 @@ void _snd_pcm_hw_param_setempty(struct snd_pcm_hw_params *params, snd_pcm_hw_par
 int snd_pcm_hw_params_choose(struct snd_pcm_substream *substream, struct snd_pcm_hw_params *params);
 
 int snd_pcm_hw_refine(struct snd_pcm_substream *substream, struct snd_pcm_hw_params *params);
+int snd_pcm_hw_refine_cache_enable(struct snd_pcm_runtime *runtime);
+void snd_pcm_hw_refine_cache_invalidate(struct snd_pcm_runtime *runtime);
 
 int snd_pcm_hw_constraints_init(struct snd_pcm_substream *substream);
 int snd_pcm_hw_constraints_complete(struct snd_pcm_substream *substream);
@@ -886,6 +912,8 @@ int snd_pcm_playback_xrun_asap(struct snd_pcm_substream *substream);
 int snd_pcm_capture_xrun_asap(struct snd_pcm_substream *substream);
 void snd_pcm_playback_silence(struct snd_pcm_substream *substream, snd_pcm_uframes_t new_hw_ptr);
 void snd_pcm_period_elapsed(struct snd_pcm_substream *substream);
+void snd_pcm_wakeup_timer_init(struct snd_pcm_substream *substream);
+void snd_pcm_wakeup_timer_arm(struct snd_pcm_substream *substream);
 snd_pcm_sframes_t snd_pcm_lib_write(struct snd_pcm_substream *substream,
 				    const void __user *buf,
 				    snd_pcm_uframes_t frames);
@@ -895,6 +923,12 @@ snd_pcm_sframes_t snd_pcm_lib_writev(struct snd_pcm_substream *substream,
 				     void __user **bufs, snd_pcm_uframes_t frames);
 snd_pcm_sframes_t snd_pcm_lib_readv(struct snd_pcm_substream *substream,
 				    void __user **bufs, snd_pcm_uframes_t frames);
+snd_pcm_sframes_t snd_pcm_lib_writeiv(struct snd_pcm_substream *substream,
+				      const struct snd_xferi_seg *segs,
+				      unsigned int nsegs);
+snd_pcm_sframes_t snd_pcm_lib_readiv(struct snd_pcm_substream *substream,
+				     const struct snd_xferi_seg *segs,
+				     unsigned int nsegs);
 
 extern const struct snd_pcm_hw_constraint_list snd_pcm_known_rates;
 
@@ -950,6 +984,7 @@ int snd_pcm_lib_preallocate_pages_for_all(struct snd_pcm *pcm,
 					  size_t size, size_t max);
 int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size);
 int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream);
+void snd_pcm_lib_free_buffer_cache(struct snd_pcm_substream *substream);
 
 int _snd_pcm_lib_alloc_vmalloc_buffer(struct snd_pcm_substream *substream,
 				      size_t size, gfp_t gfp_flags);
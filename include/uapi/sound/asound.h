@@ -136,7 +136,7 @@ struct snd_hwdep_dsp_image {
  *                                                                           *
  *****************************************************************************/
 
-#define SNDRV_PCM_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 11)
+#define SNDRV_PCM_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 13)
 
 typedef unsigned long snd_pcm_uframes_t;
 typedef signed long snd_pcm_sframes_t;
@@ -261,6 +261,7 @@ typedef int __bitwise snd_pcm_subformat_t;
 #define SNDRV_PCM_INFO_SYNC_START	0x00400000	/* pcm support some kind of sync go */
 #define SNDRV_PCM_INFO_NO_PERIOD_WAKEUP	0x00800000	/* period wakeup can be disabled */
 #define SNDRV_PCM_INFO_HAS_WALL_CLOCK   0x01000000      /* has audio wall clock for audio/system time sync */
+#define SNDRV_PCM_INFO_START_AT		0x02000000	/* hardware can start at a given timestamp */
 #define SNDRV_PCM_INFO_FIFO_IN_FRAMES	0x80000000	/* internal kernel flag - FIFO size is in frames */
 
 typedef int __bitwise snd_pcm_state_t;
@@ -338,6 +339,7 @@ typedef int snd_pcm_hw_param_t;
 #define SNDRV_PCM_HW_PARAMS_NORESAMPLE	(1<<0)	/* avoid rate resampling */
 #define SNDRV_PCM_HW_PARAMS_EXPORT_BUFFER	(1<<1)	/* export buffer */
 #define SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP	(1<<2)	/* disable period wakeups */
+#define SNDRV_PCM_HW_PARAMS_TIMER_WAKEUP	(1<<3)	/* wake up by timer without periods */
 
 struct snd_interval {
 	unsigned int min, max;
@@ -411,7 +413,8 @@ struct snd_pcm_status {
 	snd_pcm_state_t suspended_state; /* suspended stream state */
 	__u32 reserved_alignment;	/* must be filled with zero */
 	struct timespec audio_tstamp;	/* from sample counter or wall clock */
-	unsigned char reserved[56-sizeof(struct timespec)]; /* must be filled with zero */
+	struct timespec driver_trigger_tstamp; /* time when the driver trigger was executed */
+	unsigned char reserved[56-2*sizeof(struct timespec)]; /* must be filled with zero */
 };
 
 struct snd_pcm_mmap_status {
@@ -444,6 +447,23 @@ struct snd_pcm_sync_ptr {
 	} c;
 };
 
+/* binary records of /proc/asound/cardX/pcmY/subZ/hwptr_trace */
+#define SNDRV_PCM_HWPTR_TRACE_ENTRIES	256	/* ring size, power of two */
+
+#define SNDRV_PCM_HWPTR_TRACE_IRQ	(1<<0)	/* update from period interrupt */
+#define SNDRV_PCM_HWPTR_TRACE_XRUN	(1<<1)	/* pointer callback reported xrun */
+#define SNDRV_PCM_HWPTR_TRACE_ERROR	(1<<2)	/* unexpected position, ignored */
+
+struct snd_pcm_hwptr_trace_entry {
+	unsigned long long seq;		/* update number, 0 = unused or in update */
+	unsigned long long tstamp;	/* monotonic time in nsec */
+	unsigned long long hw_ptr;	/* hw_ptr after the update */
+	unsigned int pos;		/* position from the pointer callback */
+	unsigned int delta;		/* frames hw_ptr advanced */
+	unsigned int jiffies;		/* lower 32 bits of jiffies */
+	unsigned int flags;		/* SNDRV_PCM_HWPTR_TRACE_* */
+};
+
 struct snd_xferi {
 	snd_pcm_sframes_t result;
 	void __user *buf;
@@ -456,6 +476,20 @@ struct snd_xfern {
 	snd_pcm_uframes_t frames;
 };
 
+/* one interleaved buffer of a vectored read/write */
+struct snd_xferi_seg {
+	void __user *buf;
+	snd_pcm_uframes_t frames;
+};
+
+#define SNDRV_PCM_XFERIV_SEGS_MAX	1024
+
+struct snd_xferiv {
+	snd_pcm_sframes_t result;	/* transferred frames */
+	struct snd_xferi_seg __user *segs;
+	unsigned int nsegs;		/* 1...SNDRV_PCM_XFERIV_SEGS_MAX */
+};
+
 enum {
 	SNDRV_PCM_TSTAMP_TYPE_GETTIMEOFDAY = 0,	/* gettimeofday equivalent */
 	SNDRV_PCM_TSTAMP_TYPE_MONOTONIC,	/* posix_clock_monotonic equivalent */
@@ -534,10 +568,13 @@ enum {
 #define SNDRV_PCM_IOCTL_RESUME		_IO('A', 0x47)
 #define SNDRV_PCM_IOCTL_XRUN		_IO('A', 0x48)
 #define SNDRV_PCM_IOCTL_FORWARD		_IOW('A', 0x49, snd_pcm_uframes_t)
+#define SNDRV_PCM_IOCTL_START_AT	_IOW('A', 0x4a, struct timespec)
 #define SNDRV_PCM_IOCTL_WRITEI_FRAMES	_IOW('A', 0x50, struct snd_xferi)
 #define SNDRV_PCM_IOCTL_READI_FRAMES	_IOR('A', 0x51, struct snd_xferi)
 #define SNDRV_PCM_IOCTL_WRITEN_FRAMES	_IOW('A', 0x52, struct snd_xfern)
 #define SNDRV_PCM_IOCTL_READN_FRAMES	_IOR('A', 0x53, struct snd_xfern)
+#define SNDRV_PCM_IOCTL_WRITEIV_FRAMES	_IOW('A', 0x54, struct snd_xferiv)
+#define SNDRV_PCM_IOCTL_READIV_FRAMES	_IOR('A', 0x55, struct snd_xferiv)
 #define SNDRV_PCM_IOCTL_LINK		_IOW('A', 0x60, int)
 #define SNDRV_PCM_IOCTL_UNLINK		_IO('A', 0x61)
 
@@ -25,6 +25,7 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/time.h>
+#include <linux/jhash.h>
 #include <sound/core.h>
 #include <sound/minors.h>
 #include <sound/info.h>
@@ -210,6 +211,7 @@ static struct snd_kcontrol *snd_ctl_new(struct snd_kcontrol *control,
 		return NULL;
 	}
 	*kctl = *control;
+	INIT_LIST_HEAD(&kctl->hash_list);
 	for (idx = 0; idx < kctl->count; idx++)
 		kctl->vd[idx].access = access;
 	return kctl;
@@ -299,6 +301,70 @@ static bool snd_ctl_remove_numid_conflict(struct snd_card *card,
 	return false;
 }
 
+/*
+ * optional hash table of controls
+ *
+ * The controls are hashed by iface and name, which are looked up at each
+ * snd_ctl_add() for checking duplicates.  The device, subdevice and index
+ * fields aren't included since some drivers change them after adding.
+ */
+#define SND_CTL_HASH_SIZE	64
+
+static inline struct list_head *snd_ctl_hash_head(struct snd_card *card,
+						  struct snd_ctl_elem_id *id)
+{
+	u32 key = jhash(id->name, strnlen(id->name, sizeof(id->name)),
+			id->iface);
+	return &card->ctl_hash[key & (SND_CTL_HASH_SIZE - 1)];
+}
+
+/* call with card->controls_rwsem write-locked */
+static void snd_ctl_hash_add(struct snd_card *card,
+			     struct snd_kcontrol *kcontrol)
+{
+	if (card->ctl_hash)
+		list_add_tail(&kcontrol->hash_list,
+			      snd_ctl_hash_head(card, &kcontrol->id));
+}
+
+/**
+ * snd_ctl_enable_hash - enable the hashed lookup of controls
+ * @card: the card instance
+ *
+ * Lets snd_ctl_find_id() (and thus snd_ctl_add()) look up the controls
+ * via a hash table instead of walking over the whole list.  This helps
+ * drivers creating many controls.  The drivers calling this must not
+ * modify the name or iface of the added controls except via
+ * snd_ctl_rename_id().
+ *
+ * Return: Zero if successful, or a negative error code on failure.
+ */
+int snd_ctl_enable_hash(struct snd_card *card)
+{
+	struct snd_kcontrol *kctl;
+	struct list_head *hash;
+	int i;
+
+	hash = kmalloc(sizeof(*hash) * SND_CTL_HASH_SIZE, GFP_KERNEL);
+	if (!hash)
+		return -ENOMEM;
+	for (i = 0; i < SND_CTL_HASH_SIZE; i++)
+		INIT_LIST_HEAD(&hash[i]);
+	down_write(&card->controls_rwsem);
+	if (card->ctl_hash) {
+		up_write(&card->controls_rwsem);
+		kfree(hash);
+		return 0;
+	}
+	card->ctl_hash = hash;
+	list_for_each_entry(kctl, &card->controls, list)
+		snd_ctl_hash_add(card, kctl);
+	up_write(&card->controls_rwsem);
+	return 0;
+}
+
+EXPORT_SYMBOL(snd_ctl_enable_hash);
+
 static int snd_ctl_find_hole(struct snd_card *card, unsigned int count)
 {
 	unsigned int iter = 100000;
@@ -339,7 +405,7 @@ int snd_ctl_add(struct snd_card *card, struct snd_kcontrol *kcontrol)
 		goto error;
 	id = kcontrol->id;
 	down_write(&card->controls_rwsem);
-	if (snd_ctl_find_id(card, &id)) {
+	if (snd_ctl_find_id(card, &id) || snd_ctl_find_lazy(card, &id)) {
 		up_write(&card->controls_rwsem);
 		snd_printd(KERN_ERR "control %i:%i:%i:%s:%i is already present\n",
 					id.iface,
@@ -356,6 +422,7 @@ int snd_ctl_add(struct snd_card *card, struct snd_kcontrol *kcontrol)
 		goto error;
 	}
 	list_add_tail(&kcontrol->list, &card->controls);
+	snd_ctl_hash_add(card, kcontrol);
 	card->controls_count += kcontrol->count;
 	kcontrol->id.numid = card->last_numid + 1;
 	card->last_numid += kcontrol->count;
@@ -421,6 +488,7 @@ add:
 		goto error;
 	}
 	list_add_tail(&kcontrol->list, &card->controls);
+	snd_ctl_hash_add(card, kcontrol);
 	card->controls_count += kcontrol->count;
 	kcontrol->id.numid = card->last_numid + 1;
 	card->last_numid += kcontrol->count;
@@ -454,6 +522,7 @@ int snd_ctl_remove(struct snd_card *card, struct snd_kcontrol *kcontrol)
 	if (snd_BUG_ON(!card || !kcontrol))
 		return -EINVAL;
 	list_del(&kcontrol->list);
+	list_del(&kcontrol->hash_list);
 	card->controls_count -= kcontrol->count;
 	id = kcontrol->id;
 	for (idx = 0; idx < kcontrol->count; idx++, id.index++, id.numid++)
@@ -604,6 +673,10 @@ int snd_ctl_rename_id(struct snd_card *card, struct snd_ctl_elem_id *src_id,
 	kctl->id = *dst_id;
 	kctl->id.numid = card->last_numid + 1;
 	card->last_numid += kctl->count;
+	if (card->ctl_hash) {
+		list_del(&kctl->hash_list);
+		snd_ctl_hash_add(card, kctl);
+	}
 	up_write(&card->controls_rwsem);
 	return 0;
 }
@@ -638,6 +711,25 @@ struct snd_kcontrol *snd_ctl_find_numid(struct snd_card *card, unsigned int numi
 
 EXPORT_SYMBOL(snd_ctl_find_numid);
 
+/* check whether the control of count elements matches with the given id */
+static bool snd_ctl_id_match(struct snd_ctl_elem_id *kid, unsigned int count,
+			     struct snd_ctl_elem_id *id)
+{
+	if (kid->iface != id->iface)
+		return false;
+	if (kid->device != id->device)
+		return false;
+	if (kid->subdevice != id->subdevice)
+		return false;
+	if (strncmp(kid->name, id->name, sizeof(kid->name)))
+		return false;
+	if (kid->index > id->index)
+		return false;
+	if (kid->index + count <= id->index)
+		return false;
+	return true;
+}
+
 /**
  * snd_ctl_find_id - find the control instance with the given id
  * @card: the card instance
@@ -660,26 +752,224 @@ struct snd_kcontrol *snd_ctl_find_id(struct snd_card *card,
 		return NULL;
 	if (id->numid != 0)
 		return snd_ctl_find_numid(card, id->numid);
+	if (card->ctl_hash) {
+		list_for_each_entry(kctl, snd_ctl_hash_head(card, id),
+				    hash_list) {
+			if (snd_ctl_id_match(&kctl->id, kctl->count, id))
+				return kctl;
+		}
+		return NULL;
+	}
 	list_for_each_entry(kctl, &card->controls, list) {
-		if (kctl->id.iface != id->iface)
-			continue;
-		if (kctl->id.device != id->device)
-			continue;
-		if (kctl->id.subdevice != id->subdevice)
-			continue;
-		if (strncmp(kctl->id.name, id->name, sizeof(kctl->id.name)))
-			continue;
-		if (kctl->id.index > id->index)
-			continue;
-		if (kctl->id.index + kctl->count <= id->index)
-			continue;
-		return kctl;
+		if (snd_ctl_id_match(&kctl->id, kctl->count, id))
+			return kctl;
 	}
 	return NULL;
 }
 
 EXPORT_SYMBOL(snd_ctl_find_id);
 
+/*
+ * lazy controls
+ *
+ * A driver creating many controls which are rarely used may register
+ * only a descriptor at probe time.  The control instance is created when
+ * user-space accesses the control elements of the card at first.  Until
+ * then, the control is neither listed nor found by snd_ctl_find_id(),
+ * but its id is still reserved.
+ */
+
+/**
+ * snd_ctl_lazy_init - initialize the lazy control descriptor
+ * @lazy: the descriptor to initialize
+ * @knew: the control template
+ * @private_data: the private data to set
+ *
+ * Initializes the id and the private value of the descriptor from the
+ * template.  The caller may modify them and set the instantiate callback
+ * before passing the descriptor to snd_ctl_add_lazy().  The template must
+ * be kept until the control is instantiated.
+ */
+void snd_ctl_lazy_init(struct snd_kcontrol_lazy *lazy,
+		       const struct snd_kcontrol_new *knew, void *private_data)
+{
+	memset(lazy, 0, sizeof(*lazy));
+	INIT_LIST_HEAD(&lazy->list);
+	lazy->id.iface = knew->iface;
+	lazy->id.device = knew->device;
+	lazy->id.subdevice = knew->subdevice;
+	if (knew->name)
+		strlcpy(lazy->id.name, knew->name, sizeof(lazy->id.name));
+	lazy->id.index = knew->index;
+	lazy->knew = knew;
+	lazy->private_data = private_data;
+	lazy->private_value = knew->private_value;
+}
+
+EXPORT_SYMBOL(snd_ctl_lazy_init);
+
+static inline unsigned int snd_ctl_lazy_count(struct snd_kcontrol_lazy *lazy)
+{
+	return lazy->knew->count ? lazy->knew->count : 1;
+}
+
+/* create the control instance; call with card->controls_rwsem write-locked */
+static int snd_ctl_instantiate(struct snd_card *card,
+			       struct snd_kcontrol_lazy *lazy)
+{
+	struct snd_ctl_elem_id id;
+	struct snd_kcontrol *kctl;
+	unsigned int idx;
+	int err;
+
+	list_del_init(&lazy->list);
+	kctl = snd_ctl_new1(lazy->knew, lazy->private_data);
+	if (!kctl)
+		return -ENOMEM;
+	kctl->id = lazy->id;
+	kctl->private_value = lazy->private_value;
+	if (snd_ctl_find_hole(card, kctl->count) < 0) {
+		snd_ctl_free_one(kctl);
+		return -ENOMEM;
+	}
+	if (lazy->instantiate) {
+		err = lazy->instantiate(lazy, kctl);
+		if (err < 0) {
+			snd_ctl_free_one(kctl);
+			return err;
+		}
+	}
+	list_add_tail(&kctl->list, &card->controls);
+	snd_ctl_hash_add(card, kctl);
+	card->controls_count += kctl->count;
+	kctl->id.numid = card->last_numid + 1;
+	card->last_numid += kctl->count;
+	id = kctl->id;
+	for (idx = 0; idx < kctl->count; idx++, id.index++, id.numid++)
+		snd_ctl_notify(card, SNDRV_CTL_EVENT_MASK_ADD, &id);
+	return 0;
+}
+
+/**
+ * snd_ctl_add_lazy - add the lazy control descriptor to the card
+ * @card: the card instance
+ * @lazy: the descriptor initialized via snd_ctl_lazy_init()
+ *
+ * Reserves the id of the control and defers the creation of the control
+ * instance until user-space accesses the controls of the card.  When the
+ * control device is already open, the control is created immediately.
+ * The descriptor is owned by the caller, and it must be kept until
+ * snd_ctl_remove_lazy() is called or the card is freed.
+ *
+ * Return: Zero if successful, or a negative error code on failure.
+ */
+int snd_ctl_add_lazy(struct snd_card *card, struct snd_kcontrol_lazy *lazy)
+{
+	struct snd_ctl_elem_id *id = &lazy->id;
+	bool opened;
+	int err = 0;
+
+	if (snd_BUG_ON(!card || !lazy->knew || !lazy->knew->info))
+		return -EINVAL;
+	down_write(&card->controls_rwsem);
+	if (snd_ctl_find_id(card, id) || snd_ctl_find_lazy(card, id)) {
+		up_write(&card->controls_rwsem);
+		snd_printd(KERN_ERR "control %i:%i:%i:%s:%i is already present\n",
+			   id->iface, id->device, id->subdevice, id->name,
+			   id->index);
+		return -EBUSY;
+	}
+	list_add_tail(&lazy->list, &card->ctl_lazy);
+	/* don't defer if user-space may be watching the controls already */
+	read_lock(&card->ctl_files_rwlock);
+	opened = !list_empty(&card->ctl_files);
+	read_unlock(&card->ctl_files_rwlock);
+	if (opened)
+		err = snd_ctl_instantiate(card, lazy);
+	up_write(&card->controls_rwsem);
+	return err;
+}
+
+EXPORT_SYMBOL(snd_ctl_add_lazy);
+
+/**
+ * snd_ctl_remove_lazy - remove the lazy control descriptor from the card
+ * @card: the card instance
+ * @lazy: the descriptor to remove
+ *
+ * Removes the descriptor if the control isn't instantiated yet.
+ * An already instantiated control has to be removed via snd_ctl_remove().
+ */
+void snd_ctl_remove_lazy(struct snd_card *card,
+			 struct snd_kcontrol_lazy *lazy)
+{
+	down_write(&card->controls_rwsem);
+	list_del_init(&lazy->list);
+	up_write(&card->controls_rwsem);
+}
+
+EXPORT_SYMBOL(snd_ctl_remove_lazy);
+
+/**
+ * snd_ctl_find_lazy - find the lazy control descriptor with the given id
+ * @card: the card instance
+ * @id: the id to search
+ *
+ * Finds the descriptor of a control not instantiated yet.  The id fields
+ * of the returned descriptor may be modified as long as they don't
+ * conflict with other controls.
+ *
+ * The caller must down card->controls_rwsem before calling this function
+ * (if the race condition can happen).
+ *
+ * Return: The pointer of the descriptor if found, or %NULL if not.
+ */
+struct snd_kcontrol_lazy *snd_ctl_find_lazy(struct snd_card *card,
+					    struct snd_ctl_elem_id *id)
+{
+	struct snd_kcontrol_lazy *lazy;
+
+	if (snd_BUG_ON(!card || !id))
+		return NULL;
+	if (id->numid != 0)
+		return NULL;
+	list_for_each_entry(lazy, &card->ctl_lazy, list) {
+		if (snd_ctl_id_match(&lazy->id, snd_ctl_lazy_count(lazy), id))
+			return lazy;
+	}
+	return NULL;
+}
+
+EXPORT_SYMBOL(snd_ctl_find_lazy);
+
+/**
+ * snd_ctl_instantiate_lazy - create all pending lazy controls of the card
+ * @card: the card instance
+ *
+ * Called before user-space accesses the control elements, and by the
+ * kernel users enumerating the controls by themselves.
+ */
+void snd_ctl_instantiate_lazy(struct snd_card *card)
+{
+	struct snd_kcontrol_lazy *lazy;
+	int err;
+
+	if (list_empty(&card->ctl_lazy))
+		return;
+	down_write(&card->controls_rwsem);
+	while (!list_empty(&card->ctl_lazy)) {
+		lazy = list_first_entry(&card->ctl_lazy,
+					struct snd_kcontrol_lazy, list);
+		err = snd_ctl_instantiate(card, lazy);
+		if (err < 0)
+			snd_printk(KERN_ERR "cannot create control %s:%i (%d)\n",
+				   lazy->id.name, lazy->id.index, err);
+	}
+	up_write(&card->controls_rwsem);
+}
+
+EXPORT_SYMBOL(snd_ctl_instantiate_lazy);
+
 static int snd_ctl_card_info(struct snd_card *card, struct snd_ctl_file * ctl,
 			     unsigned int cmd, void __user *arg)
 {
@@ -1357,6 +1647,8 @@ static long snd_ctl_ioctl(struct file *file, unsigned int cmd, unsigned long arg
 	card = ctl->card;
 	if (snd_BUG_ON(!card))
 		return -ENXIO;
+	/* user-space sees the lazy controls once it talks to us */
+	snd_ctl_instantiate_lazy(card);
 	switch (cmd) {
 	case SNDRV_CTL_IOCTL_PVERSION:
 		return put_user(SNDRV_CTL_VERSION, ip) ? -EFAULT : 0;
@@ -1655,6 +1947,10 @@ static int snd_ctl_dev_free(struct snd_device *device)
 		control = snd_kcontrol(card->controls.next);
 		snd_ctl_remove(card, control);
 	}
+	while (!list_empty(&card->ctl_lazy))
+		list_del_init(card->ctl_lazy.next);
+	kfree(card->ctl_hash);
+	card->ctl_hash = NULL;
 	up_write(&card->controls_rwsem);
 	return 0;
 }
@@ -405,6 +405,7 @@ static inline long snd_ctl_ioctl_compat(struct file *file, unsigned int cmd, uns
 	ctl = file->private_data;
 	if (snd_BUG_ON(!ctl || !ctl->card))
 		return -ENXIO;
+	snd_ctl_instantiate_lazy(ctl->card);
 
 	switch (cmd) {
 	case SNDRV_CTL_IOCTL_PVERSION:
@@ -32,6 +32,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/moduleparam.h>
 #include <linux/mutex.h>
+#include <linux/shrinker.h>
 #include <sound/memalloc.h>
 
 
@@ -56,6 +57,21 @@ struct snd_mem_list {
 /* id for pre-allocated buffers */
 #define SNDRV_DMA_DEVICE_UNUSED (unsigned int)-1
 
+/* pool of released buffers, bucketed by the allocation order */
+#define SND_POOL_BUCKETS	11	/* the last one takes all larger */
+
+static unsigned int pool_size;
+module_param(pool_size, uint, 0644);
+MODULE_PARM_DESC(pool_size, "Max. size of the released buffer pool in kB (0 = disabled).");
+
+static DEFINE_MUTEX(pool_mutex);
+static struct list_head pool_buckets[SND_POOL_BUCKETS];
+static unsigned long pool_bytes;	/* protected by pool_mutex */
+static unsigned int pool_count;
+static unsigned long pool_hits;
+static unsigned long pool_misses;
+static unsigned long pool_shrunk;	/* released under memory pressure */
+
 /*
  *
  *  Generic memory allocators
@@ -284,6 +300,178 @@ void snd_dma_free_pages(struct snd_dma_buffer *dmab)
 }
 
 
+/*
+ * pool of released buffers
+ *
+ * Buffers given back via snd_dma_pool_put() are kept per device, type
+ * and allocation order up to pool_size kB, so that reconfiguring a
+ * stream doesn't hit the page allocator each time.  A shrinker gives
+ * them back under memory pressure.
+ */
+
+static inline int pool_bucket(size_t size)
+{
+	return min_t(int, get_order(size), SND_POOL_BUCKETS - 1);
+}
+
+/* the memory actually held by the buffer */
+static size_t pool_buffer_bytes(const struct snd_dma_buffer *dmab)
+{
+	if (dmab->dev.type == SNDRV_DMA_TYPE_DEV_SG)
+		return PAGE_ALIGN(dmab->bytes);
+	return PAGE_SIZE << get_order(dmab->bytes);
+}
+
+/* release the oldest buffers until @bytes are free; pool_mutex held */
+static unsigned long pool_evict(unsigned long bytes)
+{
+	struct snd_mem_list *mem;
+	unsigned long freed = 0;
+	int i;
+
+	/* the largest buffers first, they are the hardest to get again */
+	for (i = SND_POOL_BUCKETS - 1; i >= 0 && freed < bytes; i--) {
+		while (freed < bytes && !list_empty(&pool_buckets[i])) {
+			mem = list_entry(pool_buckets[i].prev,
+					 struct snd_mem_list, list);
+			list_del(&mem->list);
+			freed += pool_buffer_bytes(&mem->buffer);
+			pool_bytes -= pool_buffer_bytes(&mem->buffer);
+			pool_count--;
+			snd_dma_free_pages(&mem->buffer);
+			kfree(mem);
+		}
+	}
+	return freed;
+}
+
+/**
+ * snd_dma_pool_get - take a buffer from the pool of released buffers
+ * @type: the DMA buffer type
+ * @device: the device pointer
+ * @size: the buffer size required
+ * @dmab: buffer allocation record to store the buffer
+ *
+ * Looks for a buffer of the same device, type and allocation order
+ * which is at least @size bytes long.  dmab->bytes is set to the size
+ * of the buffer found, which may be larger than @size.
+ *
+ * Return: Zero if a buffer is found, or -ENOMEM.
+ */
+int snd_dma_pool_get(int type, struct device *device, size_t size,
+		     struct snd_dma_buffer *dmab)
+{
+	struct snd_mem_list *mem;
+	int bucket = pool_bucket(size);
+
+	mutex_lock(&pool_mutex);
+	list_for_each_entry(mem, &pool_buckets[bucket], list) {
+		if (mem->buffer.dev.type == type &&
+		    mem->buffer.dev.dev == device &&
+		    mem->buffer.bytes >= size) {
+			list_del(&mem->list);
+			pool_bytes -= pool_buffer_bytes(&mem->buffer);
+			pool_count--;
+			pool_hits++;
+			mutex_unlock(&pool_mutex);
+			*dmab = mem->buffer;
+			kfree(mem);
+			return 0;
+		}
+	}
+	pool_misses++;
+	mutex_unlock(&pool_mutex);
+	return -ENOMEM;
+}
+
+/**
+ * snd_dma_pool_put - release a buffer to the pool
+ * @dmab: the buffer allocation record to release
+ *
+ * Keeps the buffer for the reuse by snd_dma_pool_get().  The oldest
+ * buffers are released when the pool gets larger than pool_size.
+ */
+void snd_dma_pool_put(struct snd_dma_buffer *dmab)
+{
+	unsigned long bytes = pool_buffer_bytes(dmab);
+	unsigned long max = (unsigned long)pool_size * 1024;
+	struct snd_mem_list *mem;
+
+	if (bytes > max)
+		goto free;
+	mem = kmalloc(sizeof(*mem), GFP_KERNEL);
+	if (!mem)
+		goto free;
+	mem->buffer = *dmab;
+	mem->id = SNDRV_DMA_DEVICE_UNUSED;
+	mutex_lock(&pool_mutex);
+	if (pool_bytes + bytes > max)
+		pool_evict(pool_bytes + bytes - max);
+	list_add(&mem->list, &pool_buckets[pool_bucket(dmab->bytes)]);
+	pool_bytes += bytes;
+	pool_count++;
+	mutex_unlock(&pool_mutex);
+	return;
+
+ free:
+	snd_dma_free_pages(dmab);
+}
+
+/**
+ * snd_dma_pool_flush - release the pooled buffers of a device
+ * @dev: the device to release the buffers of
+ *
+ * Must be called before the device goes away.
+ */
+void snd_dma_pool_flush(const struct snd_dma_device *dev)
+{
+	struct snd_mem_list *mem, *next;
+	int i;
+
+	mutex_lock(&pool_mutex);
+	for (i = 0; i < SND_POOL_BUCKETS; i++) {
+		list_for_each_entry_safe(mem, next, &pool_buckets[i], list) {
+			if (dev && (mem->buffer.dev.type != dev->type ||
+				    mem->buffer.dev.dev != dev->dev))
+				continue;
+			list_del(&mem->list);
+			pool_bytes -= pool_buffer_bytes(&mem->buffer);
+			pool_count--;
+			snd_dma_free_pages(&mem->buffer);
+			kfree(mem);
+		}
+	}
+	mutex_unlock(&pool_mutex);
+}
+
+static unsigned long snd_dma_pool_count(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	return pool_bytes >> PAGE_SHIFT;
+}
+
+static unsigned long snd_dma_pool_scan(struct shrinker *shrink,
+				       struct shrink_control *sc)
+{
+	unsigned long freed;
+
+	/* never wait here, we may be called from an allocation in
+	 * a path holding pool_mutex
+	 */
+	if (!mutex_trylock(&pool_mutex))
+		return SHRINK_STOP;
+	freed = pool_evict(sc->nr_to_scan << PAGE_SHIFT);
+	pool_shrunk += freed;
+	mutex_unlock(&pool_mutex);
+	return freed >> PAGE_SHIFT;
+}
+
+static struct shrinker snd_dma_pool_shrinker = {
+	.count_objects = snd_dma_pool_count,
+	.scan_objects = snd_dma_pool_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 /**
  * snd_dma_get_reserved - get the reserved buffer for the given device
  * @dmab: the buffer allocation record to store
@@ -393,6 +581,23 @@ static int snd_mem_proc_read(struct seq_file *seq, void *offset)
 			   (int)mem->buffer.bytes);
 	}
 	mutex_unlock(&list_mutex);
+
+	mutex_lock(&pool_mutex);
+	seq_printf(seq, "pool   : %lu bytes in %u buffers (max %u kB)\n",
+		   pool_bytes, pool_count, pool_size);
+	seq_printf(seq, "  hits = %lu, misses = %lu, shrunk = %lu bytes\n",
+		   pool_hits, pool_misses, pool_shrunk);
+	for (devno = 0; devno < SND_POOL_BUCKETS; devno++) {
+		int count = 0;
+
+		list_for_each_entry(mem, &pool_buckets[devno], list)
+			count++;
+		if (count)
+			seq_printf(seq, "  %s%lu kB : %d buffers\n",
+				   devno == SND_POOL_BUCKETS - 1 ? ">= " : "",
+				   (PAGE_SIZE << devno) / 1024, count);
+	}
+	mutex_unlock(&pool_mutex);
 	return 0;
 }
 
@@ -513,6 +718,11 @@ static const struct file_operations snd_mem_proc_fops = {
 
 static int __init snd_mem_init(void)
 {
+	int i;
+
+	for (i = 0; i < SND_POOL_BUCKETS; i++)
+		INIT_LIST_HEAD(&pool_buckets[i]);
+	register_shrinker(&snd_dma_pool_shrinker);
 #ifdef CONFIG_PROC_FS
 	snd_mem_proc = proc_create(SND_MEM_PROC_FILE, 0644, NULL,
 				   &snd_mem_proc_fops);
@@ -523,6 +733,8 @@ static int __init snd_mem_init(void)
 static void __exit snd_mem_exit(void)
 {
 	remove_proc_entry(SND_MEM_PROC_FILE, NULL);
+	unregister_shrinker(&snd_dma_pool_shrinker);
+	snd_dma_pool_flush(NULL);
 	free_all_reserved_pages();
 	if (snd_allocated_pages > 0)
 		printk(KERN_ERR "snd-malloc: Memory leak?  pages not freed = %li\n", snd_allocated_pages);
@@ -543,5 +755,9 @@ EXPORT_SYMBOL(snd_dma_free_pages);
 EXPORT_SYMBOL(snd_dma_get_reserved_buf);
 EXPORT_SYMBOL(snd_dma_reserve_buf);
 
+EXPORT_SYMBOL(snd_dma_pool_get);
+EXPORT_SYMBOL(snd_dma_pool_put);
+EXPORT_SYMBOL(snd_dma_pool_flush);
+
 EXPORT_SYMBOL(snd_malloc_pages);
 EXPORT_SYMBOL(snd_free_pages);
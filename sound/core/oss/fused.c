@@ -0,0 +1,460 @@
+/*
+ *  Fused conversion Plug-In
+ *
+ *  Combines linear format conversion, channel routing, linear rate
+ *  conversion and interleave changes in a single pass over the frames.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Library General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <linux/time.h>
+#include <asm/unaligned.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include "pcm_plugin.h"
+
+#define SHIFT	11
+#define BITS	(1<<SHIFT)
+#define R_MASK	(BITS-1)
+
+/*
+ *  Samples are converted to 32bit signed, MSB aligned values, routed
+ *  and interpolated in that form and converted to the destination
+ *  format when stored, so no precision is lost on the way.
+ */
+
+struct fused_sample {
+	unsigned int bytes;	/* physical size */
+	unsigned int shift;	/* 32 - width */
+	unsigned int big_endian:1;
+	unsigned int is_signed:1;
+	u32 flip;		/* MSB flip for unsigned formats */
+};
+
+struct fused_channel {
+	s32 last_S1;
+	s32 last_S2;
+	const char *src;	/* NULL if the channel is silent */
+	char *dst;
+	int src_step, dst_step;
+};
+
+struct fused_priv {
+	struct fused_sample src, dst;
+	unsigned int pitch;
+	unsigned int pos;
+	int resample;		/* 0 = none, 1 = expand, -1 = shrink */
+	snd_pcm_sframes_t old_src_frames, old_dst_frames;
+	struct fused_channel channels[0];
+};
+
+static void init_sample(struct fused_sample *s, snd_pcm_format_t format)
+{
+	s->bytes = snd_pcm_format_physical_width(format) / 8;
+	s->shift = 32 - snd_pcm_format_width(format);
+	s->big_endian = snd_pcm_format_big_endian(format) > 0;
+	s->is_signed = snd_pcm_format_signed(format) > 0;
+	s->flip = s->is_signed ? 0 : 0x80000000;
+}
+
+static inline s32 get_sample(const struct fused_sample *s, const char *p)
+{
+	const u8 *b = (const u8 *)p;
+	u32 v;
+
+	switch (s->bytes) {
+	case 1:
+		v = *b;
+		break;
+	case 2:
+		v = s->big_endian ? get_unaligned_be16(b) : get_unaligned_le16(b);
+		break;
+	case 3:
+		if (s->big_endian)
+			v = (b[0] << 16) | (b[1] << 8) | b[2];
+		else
+			v = (b[2] << 16) | (b[1] << 8) | b[0];
+		break;
+	default:
+		v = s->big_endian ? get_unaligned_be32(b) : get_unaligned_le32(b);
+		break;
+	}
+	return (v << s->shift) ^ s->flip;
+}
+
+static inline void put_sample(const struct fused_sample *s, char *p, s32 val)
+{
+	u8 *b = (u8 *)p;
+	u32 v = (u32)val ^ s->flip;
+
+	if (s->is_signed)
+		v = (u32)((s32)v >> s->shift);
+	else
+		v >>= s->shift;
+	switch (s->bytes) {
+	case 1:
+		*b = v;
+		break;
+	case 2:
+		if (s->big_endian)
+			put_unaligned_be16(v, b);
+		else
+			put_unaligned_le16(v, b);
+		break;
+	case 3:
+		if (s->big_endian) {
+			b[0] = v >> 16;
+			b[1] = v >> 8;
+			b[2] = v;
+		} else {
+			b[0] = v;
+			b[1] = v >> 8;
+			b[2] = v >> 16;
+		}
+		break;
+	default:
+		if (s->big_endian)
+			put_unaligned_be32(v, b);
+		else
+			put_unaligned_le32(v, b);
+		break;
+	}
+}
+
+static void fused_init(struct snd_pcm_plugin *plugin)
+{
+	struct fused_priv *data = (struct fused_priv *)plugin->extra_data;
+	unsigned int channel;
+
+	data->pos = 0;
+	for (channel = 0; channel < plugin->dst_format.channels; channel++) {
+		data->channels[channel].last_S1 = 0;
+		data->channels[channel].last_S2 = 0;
+	}
+}
+
+/*
+ * set up the per-channel pointers; the routing is the same as in the
+ * route plugin: a mono source feeds all channels, otherwise the
+ * channels are mapped 1:1 and the remaining ones are silenced
+ */
+static void fused_setup(struct snd_pcm_plugin *plugin,
+			const struct snd_pcm_plugin_channel *src_channels,
+			struct snd_pcm_plugin_channel *dst_channels,
+			snd_pcm_uframes_t dst_frames)
+{
+	struct fused_priv *data = (struct fused_priv *)plugin->extra_data;
+	unsigned int nsrcs = plugin->src_format.channels;
+	unsigned int channel;
+
+	for (channel = 0; channel < plugin->dst_format.channels; channel++) {
+		struct fused_channel *fc = &data->channels[channel];
+		const struct snd_pcm_plugin_channel *src;
+		struct snd_pcm_plugin_channel *dst = &dst_channels[channel];
+
+		src = NULL;
+		if (nsrcs <= 1)
+			src = src_channels;
+		else if (channel < nsrcs)
+			src = &src_channels[channel];
+		if (!src || !src->enabled) {
+			if (dst->wanted)
+				snd_pcm_area_silence(&dst->area, 0, dst_frames,
+						     plugin->dst_format.format);
+			dst->enabled = 0;
+			fc->src = NULL;
+			continue;
+		}
+		dst->enabled = 1;
+		fc->src = src->area.addr + src->area.first / 8;
+		fc->src_step = src->area.step / 8;
+		fc->dst = dst->area.addr + dst->area.first / 8;
+		fc->dst_step = dst->area.step / 8;
+	}
+}
+
+static void fused_convert(struct snd_pcm_plugin *plugin,
+			  snd_pcm_uframes_t frames)
+{
+	struct fused_priv *data = (struct fused_priv *)plugin->extra_data;
+	unsigned int nchannels = plugin->dst_format.channels;
+	unsigned int channel;
+	struct fused_channel *fc;
+
+	while (frames-- > 0) {
+		for (channel = 0, fc = data->channels; channel < nchannels;
+		     channel++, fc++) {
+			if (!fc->src)
+				continue;
+			put_sample(&data->dst, fc->dst,
+				   get_sample(&data->src, fc->src));
+			fc->src += fc->src_step;
+			fc->dst += fc->dst_step;
+		}
+	}
+}
+
+static inline void fused_next_frame(struct fused_priv *data,
+				    unsigned int nchannels, int avail)
+{
+	unsigned int channel;
+	struct fused_channel *fc;
+
+	for (channel = 0, fc = data->channels; channel < nchannels;
+	     channel++, fc++) {
+		if (!fc->src)
+			continue;
+		fc->last_S1 = fc->last_S2;
+		if (avail) {
+			fc->last_S2 = get_sample(&data->src, fc->src);
+			fc->src += fc->src_step;
+		}
+	}
+}
+
+static inline void fused_put_frame(struct fused_priv *data,
+				   unsigned int nchannels, unsigned int pos)
+{
+	unsigned int channel;
+	struct fused_channel *fc;
+	s32 val;
+
+	for (channel = 0, fc = data->channels; channel < nchannels;
+	     channel++, fc++) {
+		if (!fc->src)
+			continue;
+		val = fc->last_S1 +
+			(s32)((((s64)fc->last_S2 - fc->last_S1) * pos) >> SHIFT);
+		put_sample(&data->dst, fc->dst, val);
+		fc->dst += fc->dst_step;
+	}
+}
+
+static void fused_expand(struct snd_pcm_plugin *plugin,
+			 int src_frames, int dst_frames)
+{
+	struct fused_priv *data = (struct fused_priv *)plugin->extra_data;
+	unsigned int nchannels = plugin->dst_format.channels;
+	unsigned int pos = data->pos;
+
+	while (dst_frames-- > 0) {
+		if (pos & ~R_MASK) {
+			pos &= R_MASK;
+			fused_next_frame(data, nchannels, src_frames-- > 0);
+		}
+		fused_put_frame(data, nchannels, pos);
+		pos += data->pitch;
+	}
+	data->pos = pos;
+}
+
+static void fused_shrink(struct snd_pcm_plugin *plugin,
+			 int src_frames, int dst_frames)
+{
+	struct fused_priv *data = (struct fused_priv *)plugin->extra_data;
+	unsigned int nchannels = plugin->dst_format.channels;
+	unsigned int pos = data->pos;
+
+	while (dst_frames > 0) {
+		fused_next_frame(data, nchannels, src_frames-- > 0);
+		if (pos & ~R_MASK) {
+			pos &= R_MASK;
+			fused_put_frame(data, nchannels, pos);
+			dst_frames--;
+		}
+		pos += data->pitch;
+	}
+	data->pos = pos;
+}
+
+static snd_pcm_sframes_t fused_src_frames(struct snd_pcm_plugin *plugin,
+					  snd_pcm_uframes_t frames)
+{
+	struct fused_priv *data;
+	snd_pcm_sframes_t res;
+
+	if (snd_BUG_ON(!plugin))
+		return -ENXIO;
+	if (frames == 0)
+		return 0;
+	data = (struct fused_priv *)plugin->extra_data;
+	if (data->resample > 0)
+		res = (((frames * data->pitch) + (BITS/2)) >> SHIFT);
+	else
+		res = (((frames << SHIFT) + (data->pitch / 2)) / data->pitch);
+	if (data->old_src_frames > 0) {
+		snd_pcm_sframes_t frames1 = frames, res1 = data->old_dst_frames;
+		while (data->old_src_frames < frames1) {
+			frames1 >>= 1;
+			res1 <<= 1;
+		}
+		while (data->old_src_frames > frames1) {
+			frames1 <<= 1;
+			res1 >>= 1;
+		}
+		if (data->old_src_frames == frames1)
+			return res1;
+	}
+	data->old_src_frames = frames;
+	data->old_dst_frames = res;
+	return res;
+}
+
+static snd_pcm_sframes_t fused_dst_frames(struct snd_pcm_plugin *plugin,
+					  snd_pcm_uframes_t frames)
+{
+	struct fused_priv *data;
+	snd_pcm_sframes_t res;
+
+	if (snd_BUG_ON(!plugin))
+		return -ENXIO;
+	if (frames == 0)
+		return 0;
+	data = (struct fused_priv *)plugin->extra_data;
+	if (data->resample > 0)
+		res = (((frames << SHIFT) + (data->pitch / 2)) / data->pitch);
+	else
+		res = (((frames * data->pitch) + (BITS/2)) >> SHIFT);
+	if (data->old_dst_frames > 0) {
+		snd_pcm_sframes_t frames1 = frames, res1 = data->old_src_frames;
+		while (data->old_dst_frames < frames1) {
+			frames1 >>= 1;
+			res1 <<= 1;
+		}
+		while (data->old_dst_frames > frames1) {
+			frames1 <<= 1;
+			res1 >>= 1;
+		}
+		if (data->old_dst_frames == frames1)
+			return res1;
+	}
+	data->old_dst_frames = frames;
+	data->old_src_frames = res;
+	return res;
+}
+
+static snd_pcm_sframes_t fused_transfer(struct snd_pcm_plugin *plugin,
+			      const struct snd_pcm_plugin_channel *src_channels,
+			      struct snd_pcm_plugin_channel *dst_channels,
+			      snd_pcm_uframes_t frames)
+{
+	struct fused_priv *data;
+	snd_pcm_uframes_t dst_frames;
+
+	if (snd_BUG_ON(!plugin || !src_channels || !dst_channels))
+		return -ENXIO;
+	if (frames == 0)
+		return 0;
+#ifdef CONFIG_SND_DEBUG
+	{
+		unsigned int channel;
+		for (channel = 0; channel < plugin->src_format.channels; channel++) {
+			if (snd_BUG_ON(src_channels[channel].area.first % 8 ||
+				       src_channels[channel].area.step % 8))
+				return -ENXIO;
+		}
+		for (channel = 0; channel < plugin->dst_format.channels; channel++) {
+			if (snd_BUG_ON(dst_channels[channel].area.first % 8 ||
+				       dst_channels[channel].area.step % 8))
+				return -ENXIO;
+		}
+	}
+#endif
+	data = (struct fused_priv *)plugin->extra_data;
+	if (!data->resample) {
+		fused_setup(plugin, src_channels, dst_channels, frames);
+		fused_convert(plugin, frames);
+		return frames;
+	}
+	dst_frames = fused_dst_frames(plugin, frames);
+	if (dst_frames > dst_channels[0].frames)
+		dst_frames = dst_channels[0].frames;
+	fused_setup(plugin, src_channels, dst_channels, dst_frames);
+	if (data->resample > 0)
+		fused_expand(plugin, frames, dst_frames);
+	else
+		fused_shrink(plugin, frames, dst_frames);
+	return dst_frames;
+}
+
+static int fused_action(struct snd_pcm_plugin *plugin,
+			enum snd_pcm_plugin_action action,
+			unsigned long udata)
+{
+	if (snd_BUG_ON(!plugin))
+		return -ENXIO;
+	switch (action) {
+	case INIT:
+	case PREPARE:
+		fused_init(plugin);
+		break;
+	default:
+		break;
+	}
+	return 0;	/* silenty ignore other actions */
+}
+
+int snd_pcm_plugin_build_fused(struct snd_pcm_substream *plug,
+			       struct snd_pcm_plugin_format *src_format,
+			       struct snd_pcm_plugin_format *dst_format,
+			       struct snd_pcm_plugin **r_plugin)
+{
+	int err;
+	struct fused_priv *data;
+	struct snd_pcm_plugin *plugin;
+
+	if (snd_BUG_ON(!r_plugin))
+		return -ENXIO;
+	*r_plugin = NULL;
+
+	if (snd_BUG_ON(!src_format->channels || !dst_format->channels))
+		return -ENXIO;
+	if (snd_BUG_ON(!snd_pcm_format_linear(src_format->format) ||
+		       !snd_pcm_format_linear(dst_format->format)))
+		return -ENXIO;
+	if (snd_BUG_ON(snd_pcm_format_physical_width(src_format->format) > 32 ||
+		       snd_pcm_format_physical_width(dst_format->format) > 32))
+		return -ENXIO;
+
+	err = snd_pcm_plugin_build(plug, "fused conversion",
+				   src_format, dst_format,
+				   sizeof(struct fused_priv) +
+				   dst_format->channels * sizeof(struct fused_channel),
+				   &plugin);
+	if (err < 0)
+		return err;
+	data = (struct fused_priv *)plugin->extra_data;
+	init_sample(&data->src, src_format->format);
+	init_sample(&data->dst, dst_format->format);
+	if (src_format->rate < dst_format->rate) {
+		data->pitch = ((src_format->rate << SHIFT) + (dst_format->rate >> 1)) / dst_format->rate;
+		data->resample = 1;
+	} else if (src_format->rate > dst_format->rate) {
+		data->pitch = ((dst_format->rate << SHIFT) + (src_format->rate >> 1)) / src_format->rate;
+		data->resample = -1;
+	}
+	fused_init(plugin);
+	data->old_src_frames = data->old_dst_frames = 0;
+	plugin->transfer = fused_transfer;
+	if (data->resample) {
+		plugin->src_frames = fused_src_frames;
+		plugin->dst_frames = fused_dst_frames;
+	}
+	plugin->action = fused_action;
+	*r_plugin = plugin;
+	return 0;
+}
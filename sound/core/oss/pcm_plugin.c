@@ -358,6 +358,32 @@ snd_pcm_format_t snd_pcm_plug_slave_format(snd_pcm_format_t format,
 	}
 }
 
+/*
+ *  Linear format, channel and rate conversions are done by one plugin
+ *  in a single pass when more than one of them (or an interleave change)
+ *  is needed, instead of a chain of plugins with a buffer each.
+ */
+static int snd_pcm_plug_fusable(struct snd_pcm_plugin_format *src,
+				struct snd_pcm_plugin_format *dst,
+				snd_pcm_access_t src_access,
+				snd_pcm_access_t dst_access)
+{
+	int stages;
+
+	if (!snd_pcm_format_linear(src->format) ||
+	    !snd_pcm_format_linear(dst->format))
+		return 0;
+	stages = (src->format != dst->format) +
+		 (src->channels != dst->channels) +
+		 (src_access != dst_access);
+	if (!rate_match(src->rate, dst->rate)) {
+		if (!snd_pcm_plugin_rate_linear())
+			return 0;
+		stages++;
+	}
+	return stages > 1;
+}
+
 int snd_pcm_plug_format_plugins(struct snd_pcm_substream *plug,
 				struct snd_pcm_hw_params *params,
 				struct snd_pcm_hw_params *slave_params)
@@ -410,6 +436,27 @@ int snd_pcm_plug_format_plugins(struct snd_pcm_substream *plug,
 		 dstformat.rate,
 		 dstformat.channels);
 
+	/* all linear conversions at once */
+	if (snd_pcm_plug_fusable(&srcformat, &dstformat, src_access, dst_access)) {
+		if (rate_match(srcformat.rate, dstformat.rate))
+			tmpformat.rate = srcformat.rate;
+		else
+			tmpformat.rate = dstformat.rate;
+		tmpformat.format = dstformat.format;
+		tmpformat.channels = dstformat.channels;
+		err = snd_pcm_plugin_build_fused(plug, &srcformat, &tmpformat,
+						 &plugin);
+		pdprintf("fused conversion: returns %i\n", err);
+		if (err < 0)
+			return err;
+		err = snd_pcm_plugin_append(plugin);
+		if (err < 0) {
+			snd_pcm_plugin_free(plugin);
+			return err;
+		}
+		return 0;
+	}
+
 	/* Format change (linearization) */
 	if (! rate_match(srcformat.rate, dstformat.rate) &&
 	    ! snd_pcm_format_linear(srcformat.format)) {
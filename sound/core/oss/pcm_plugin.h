@@ -120,6 +120,11 @@ int snd_pcm_plugin_build_copy(struct snd_pcm_substream *handle,
 			      struct snd_pcm_plugin_format *src_format,
 			      struct snd_pcm_plugin_format *dst_format,
 			      struct snd_pcm_plugin **r_plugin);
+int snd_pcm_plugin_build_fused(struct snd_pcm_substream *handle,
+			       struct snd_pcm_plugin_format *src_format,
+			       struct snd_pcm_plugin_format *dst_format,
+			       struct snd_pcm_plugin **r_plugin);
+int snd_pcm_plugin_rate_linear(void);
 
 int snd_pcm_plug_format_plugins(struct snd_pcm_substream *substream,
 				struct snd_pcm_hw_params *params,
@@ -20,6 +20,9 @@
  */
   
 #include <linux/time.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include "pcm_plugin.h"
@@ -28,6 +31,12 @@
 #define BITS	(1<<SHIFT)
 #define R_MASK	(BITS-1)
 
+static int rate_quality;
+module_param(rate_quality, int, 0644);
+MODULE_PARM_DESC(rate_quality, "Rate conversion quality (0 = linear, 1-3 = windowed sinc).");
+
+struct rate_sinc;
+
 /*
  *  Basic rate conversion plugin
  */
@@ -46,15 +55,20 @@ struct rate_priv {
 	unsigned int pitch;
 	unsigned int pos;
 	rate_f func;
+	struct rate_sinc *sinc;
 	snd_pcm_sframes_t old_src_frames, old_dst_frames;
 	struct rate_channel channels[0];
 };
 
+static void sinc_reset(struct rate_sinc *sinc, unsigned int channels);
+
 static void rate_init(struct snd_pcm_plugin *plugin)
 {
 	unsigned int channel;
 	struct rate_priv *data = (struct rate_priv *)plugin->extra_data;
 	data->pos = 0;
+	if (data->sinc)
+		sinc_reset(data->sinc, plugin->src_format.channels);
 	for (channel = 0; channel < plugin->src_format.channels; channel++) {
 		data->channels[channel].last_S1 = 0;
 		data->channels[channel].last_S2 = 0;
@@ -180,6 +194,362 @@ static void resample_shrink(struct snd_pcm_plugin *plugin,
 	data->pos = pos;
 }
 
+/*
+ *  Band-limited rate conversion
+ *
+ *  A windowed sinc (Blackman-Harris) low-pass is sampled into a table
+ *  of phases x taps Q14 coefficients when the plugin is built.  The input
+ *  is de-interleaved in blocks into per-channel history buffers, so every
+ *  output sample is the dot product of two contiguous s16 arrays.  The
+ *  position advances in the same units as the linear converter (pitch
+ *  and BITS), so the frame counts of rate_src_frames()/rate_dst_frames()
+ *  hold for both.
+ */
+
+#define SINC_BLOCK		256	/* input frames de-interleaved at once */
+#define SINC_COEF_SHIFT		14
+#define SINC_MAX_COEFS		(256 * 1024)
+#define SINC_ROLLOFF		1009317315	/* 0.94 in Q30 */
+#define SINC_PI			3373259426LL	/* pi in Q30 */
+
+static const struct {
+	unsigned int zeros;	/* zero crossings on each side */
+	unsigned int phases;
+} sinc_quality[] = {
+	{ 8, 128 },
+	{ 16, 256 },
+	{ 32, 1024 },
+};
+
+struct rate_sinc {
+	unsigned int taps;	/* filter length in input frames */
+	unsigned int phases;	/* coefficient sets */
+	unsigned int unit;	/* input frame in position units */
+	unsigned int step;	/* position advance per output frame */
+	unsigned int pos;	/* next output, in units from hist[0] */
+	unsigned int fill;	/* frames in the history buffers */
+	unsigned int size;	/* frames per history buffer */
+	s16 *coef;		/* [phases][taps] */
+	s16 *hist;		/* [channels][size] */
+};
+
+/* sin(2 * pi * phase / 2^32) in Q30 */
+static s32 sinc_sin(u32 phase)
+{
+	unsigned int quarter = phase >> 30;
+	s64 t, t2, r;
+
+	t = phase & 0x3fffffff;
+	if (quarter & 1)
+		t = 0x40000000 - t;
+	/* Taylor series of sin(pi / 2 * t) up to t^9 */
+	t2 = (t * t) >> 30;
+	r = 172272;
+	r = -5026995 + ((r * t2) >> 30);
+	r = 85569306 + ((r * t2) >> 30);
+	r = -693598668 + ((r * t2) >> 30);
+	r = 1686629713 + ((r * t2) >> 30);
+	r = (r * t) >> 30;
+	return (quarter & 2) ? -r : r;
+}
+
+/* sin(pi * x) and cos(pi * x) for x in Q30 */
+static inline s32 sin_pi(s64 x)
+{
+	return sinc_sin((u32)(x * 2));
+}
+
+static inline s32 cos_pi(s64 x)
+{
+	return sinc_sin((u32)(x * 2) + 0x40000000);
+}
+
+/* fc * sinc(fc * d) * window(d / half) in Q30; d and fc in Q30 */
+static s32 sinc_tap(s64 d, s64 fc, unsigned int half)
+{
+	s64 x, u, val, w;
+
+	u = div_s64(d, half);
+	if (u <= -(1LL << 30) || u >= (1LL << 30))
+		return 0;
+	x = ((fc >> 10) * d) >> 20;
+	if (!x)
+		val = 1 << 30;
+	else
+		val = div64_s64(div64_s64((s64)sin_pi(x) << 30, x) << 30,
+				SINC_PI);
+	w = 385204879 +				/* 0.35875 */
+	    ((524297395LL * cos_pi(u) +		/* 0.48829 */
+	      151698245LL * cos_pi(2 * u) +	/* 0.14128 */
+	      12541305LL * cos_pi(3 * u)) >> 30); /* 0.01168 */
+	return (((fc * val) >> 30) * w) >> 30;
+}
+
+static int sinc_init_coef(struct rate_sinc *sinc, unsigned int zeros,
+			  unsigned int src_rate, unsigned int dst_rate)
+{
+	s64 fc = SINC_ROLLOFF;
+	unsigned int half, p, k;
+	s32 *h;
+
+	if (dst_rate < src_rate)
+		fc = div_u64((u64)SINC_ROLLOFF * dst_rate, src_rate);
+	half = div64_u64(((u64)zeros << 30) + fc - 1, fc);
+	sinc->taps = 2 * half;
+	while (sinc->phases > 1 &&
+	       sinc->phases * sinc->taps > SINC_MAX_COEFS)
+		sinc->phases >>= 1;
+	sinc->coef = vmalloc(sinc->phases * sinc->taps * sizeof(s16));
+	h = kmalloc(sinc->taps * sizeof(*h), GFP_KERNEL);
+	if (!sinc->coef || !h) {
+		kfree(h);
+		return -ENOMEM;
+	}
+	for (p = 0; p < sinc->phases; p++) {
+		s64 f = div_u64((u64)p << 30, sinc->phases);
+		s16 *coef = sinc->coef + p * sinc->taps;
+		s64 sum = 0;
+
+		for (k = 0; k < sinc->taps; k++) {
+			h[k] = sinc_tap(((s64)k - (half - 1)) * (1LL << 30) - f,
+					fc, half);
+			sum += h[k];
+		}
+		/* unity gain at DC for every phase */
+		for (k = 0; k < sinc->taps; k++)
+			coef[k] = clamp_t(s64, div64_s64((s64)h[k] <<
+							 SINC_COEF_SHIFT, sum),
+					  -32768, 32767);
+	}
+	kfree(h);
+	return 0;
+}
+
+static void sinc_reset(struct rate_sinc *sinc, unsigned int channels)
+{
+	/* taps - 1 frames of silence, so that an output needs the input
+	 * only up to its own position like the linear conversion
+	 */
+	memset(sinc->hist, 0, channels * sinc->size * sizeof(s16));
+	sinc->fill = sinc->taps - 1;
+	sinc->pos = 0;
+}
+
+static void sinc_free(struct rate_sinc *sinc)
+{
+	if (!sinc)
+		return;
+	vfree(sinc->coef);
+	vfree(sinc->hist);
+	kfree(sinc);
+}
+
+static inline s16 *sinc_sample(const struct snd_pcm_channel_area *area,
+			       unsigned int frame)
+{
+	return (s16 *)((char *)area->addr + area->first / 8 +
+		       frame * (area->step / 8));
+}
+
+/* base address if all channels are enabled and interleaved, else NULL */
+static s16 *sinc_interleaved(const struct snd_pcm_plugin_channel *channels,
+			     unsigned int nchannels)
+{
+	unsigned int channel;
+
+	for (channel = 0; channel < nchannels; channel++) {
+		const struct snd_pcm_channel_area *area = &channels[channel].area;
+		if (!channels[channel].enabled ||
+		    area->addr != channels[0].area.addr ||
+		    area->first != channel * 16 ||
+		    area->step != nchannels * 16)
+			return NULL;
+	}
+	return channels[0].area.addr;
+}
+
+static inline s32 sinc_dot(const s16 *x, const s16 *h, unsigned int n)
+{
+	unsigned int i;
+	s32 acc = 0;
+
+	for (i = 0; i < n; i++)
+		acc += x[i] * h[i];
+	return acc;
+}
+
+/* drop the frames before the current position */
+static void sinc_compact(struct rate_sinc *sinc, unsigned int channels)
+{
+	unsigned int drop = min(sinc->pos / sinc->unit, sinc->fill);
+	unsigned int channel;
+	s16 *hist;
+
+	if (!drop)
+		return;
+	for (channel = 0, hist = sinc->hist; channel < channels;
+	     channel++, hist += sinc->size)
+		memmove(hist, hist + drop, (sinc->fill - drop) * sizeof(s16));
+	sinc->fill -= drop;
+	sinc->pos -= drop * sinc->unit;
+}
+
+/* append input frames to the history */
+static void sinc_append(struct rate_sinc *sinc,
+			const struct snd_pcm_plugin_channel *src_channels,
+			const s16 *src, unsigned int channels,
+			unsigned int src_pos, unsigned int frames)
+{
+	unsigned int channel, i;
+	s16 *hist;
+
+	if (src) {
+		src += src_pos * channels;
+		for (i = 0; i < frames; i++)
+			for (channel = 0, hist = sinc->hist + sinc->fill + i;
+			     channel < channels; channel++, hist += sinc->size)
+				*hist = *src++;
+	} else {
+		for (channel = 0, hist = sinc->hist + sinc->fill;
+		     channel < channels; channel++, hist += sinc->size) {
+			const struct snd_pcm_channel_area *area =
+				&src_channels[channel].area;
+			if (!src_channels[channel].enabled)
+				continue;
+			for (i = 0; i < frames; i++)
+				hist[i] = *sinc_sample(area, src_pos + i);
+		}
+	}
+	sinc->fill += frames;
+}
+
+/* the input ran out before the requested output: repeat the last
+ * frame as input, like the linear conversion holding its last sample;
+ * the position and the history simply go on in the next call
+ */
+static void sinc_hold(struct rate_sinc *sinc, unsigned int channels,
+		      unsigned int frames)
+{
+	unsigned int channel, i;
+	s16 *hist;
+
+	for (channel = 0, hist = sinc->hist + sinc->fill;
+	     channel < channels; channel++, hist += sinc->size)
+		for (i = 0; i < frames; i++)
+			hist[i] = sinc->fill ? hist[-1] : 0;
+	sinc->fill += frames;
+}
+
+static void resample_sinc(struct snd_pcm_plugin *plugin,
+			  const struct snd_pcm_plugin_channel *src_channels,
+			  struct snd_pcm_plugin_channel *dst_channels,
+			  int src_frames, int dst_frames)
+{
+	struct rate_priv *data = (struct rate_priv *)plugin->extra_data;
+	struct rate_sinc *sinc = data->sinc;
+	unsigned int channels = plugin->src_format.channels;
+	unsigned int channel, ip, frames;
+	int src_pos = 0, dst_pos = 0;
+	const s16 *src;
+	s16 *dst;
+
+	for (channel = 0; channel < channels; channel++) {
+		if (src_channels[channel].enabled) {
+			dst_channels[channel].enabled = 1;
+			continue;
+		}
+		if (dst_channels[channel].wanted)
+			snd_pcm_area_silence(&dst_channels[channel].area, 0,
+					     dst_frames,
+					     plugin->dst_format.format);
+		dst_channels[channel].enabled = 0;
+	}
+	src = sinc_interleaved(src_channels, channels);
+	dst = sinc_interleaved(dst_channels, channels);
+
+	while (dst_pos < dst_frames) {
+		ip = sinc->pos / sinc->unit;
+		if (ip + sinc->taps <= sinc->fill) {
+			unsigned int phase =
+				div_u64((u64)(sinc->pos % sinc->unit) *
+					sinc->phases, sinc->unit);
+			const s16 *h = sinc->coef + phase * sinc->taps;
+			const s16 *hist = sinc->hist + ip;
+
+			for (channel = 0; channel < channels;
+			     channel++, hist += sinc->size) {
+				s32 val;
+
+				if (!dst_channels[channel].enabled)
+					continue;
+				val = sinc_dot(hist, h, sinc->taps) >>
+						SINC_COEF_SHIFT;
+				val = clamp(val, -32768, 32767);
+				if (dst)
+					dst[dst_pos * channels + channel] = val;
+				else
+					*sinc_sample(&dst_channels[channel].area,
+						     dst_pos) = val;
+			}
+			dst_pos++;
+			sinc->pos += sinc->step;
+			continue;
+		}
+		sinc_compact(sinc, channels);
+		ip = sinc->pos / sinc->unit;
+		if (src_pos < src_frames) {
+			frames = min_t(unsigned int, src_frames - src_pos,
+				       SINC_BLOCK);
+			frames = min(frames, sinc->size - sinc->fill);
+			sinc_append(sinc, src_channels, src, channels,
+				    src_pos, frames);
+			src_pos += frames;
+		} else {
+			sinc_hold(sinc, channels,
+				  ip + sinc->taps - sinc->fill);
+		}
+	}
+}
+
+static struct rate_sinc *sinc_new(unsigned int quality, unsigned int channels,
+				  unsigned int src_rate, unsigned int dst_rate,
+				  unsigned int pitch)
+{
+	struct rate_sinc *sinc;
+
+	sinc = kzalloc(sizeof(*sinc), GFP_KERNEL);
+	if (!sinc)
+		return NULL;
+	sinc->phases = sinc_quality[quality - 1].phases;
+	if (sinc_init_coef(sinc, sinc_quality[quality - 1].zeros,
+			   src_rate, dst_rate) < 0)
+		goto error;
+	if (src_rate < dst_rate) {
+		sinc->unit = BITS;
+		sinc->step = pitch;
+	} else {
+		sinc->unit = pitch;
+		sinc->step = BITS;
+	}
+	sinc->size = 2 * sinc->taps + SINC_BLOCK + sinc->step / sinc->unit;
+	sinc->hist = vmalloc(channels * sinc->size * sizeof(s16));
+	if (!sinc->hist)
+		goto error;
+	sinc_reset(sinc, channels);
+	return sinc;
+
+ error:
+	sinc_free(sinc);
+	return NULL;
+}
+
+static void rate_private_free(struct snd_pcm_plugin *plugin)
+{
+	struct rate_priv *data = (struct rate_priv *)plugin->extra_data;
+
+	sinc_free(data->sinc);
+}
+
 static snd_pcm_sframes_t rate_src_frames(struct snd_pcm_plugin *plugin, snd_pcm_uframes_t frames)
 {
 	struct rate_priv *data;
@@ -297,6 +667,12 @@ static int rate_action(struct snd_pcm_plugin *plugin,
 	return 0;	/* silenty ignore other actions */
 }
 
+/* can the rate conversion be done by linear interpolation? */
+int snd_pcm_plugin_rate_linear(void)
+{
+	return rate_quality <= 0;
+}
+
 int snd_pcm_plugin_build_rate(struct snd_pcm_substream *plug,
 			      struct snd_pcm_plugin_format *src_format,
 			      struct snd_pcm_plugin_format *dst_format,
@@ -337,6 +713,19 @@ int snd_pcm_plugin_build_rate(struct snd_pcm_substream *plug,
 		data->func = resample_shrink;
 	}
 	data->pos = 0;
+	if (rate_quality > 0) {
+		unsigned int quality = min_t(unsigned int, rate_quality,
+					     ARRAY_SIZE(sinc_quality));
+		data->sinc = sinc_new(quality, src_format->channels,
+				      src_format->rate, dst_format->rate,
+				      data->pitch);
+		if (!data->sinc) {
+			snd_pcm_plugin_free(plugin);
+			return -ENOMEM;
+		}
+		data->func = resample_sinc;
+		plugin->private_free = rate_private_free;
+	}
 	rate_init(plugin);
 	data->old_src_frames = data->old_dst_frames = 0;
 	plugin->transfer = rate_transfer;
@@ -25,6 +25,7 @@
 #include <linux/time.h>
 #include <linux/mutex.h>
 #include <linux/device.h>
+#include <linux/uaccess.h>
 #include <sound/core.h>
 #include <sound/minors.h>
 #include <sound/pcm.h>
@@ -460,6 +461,9 @@ static void snd_pcm_substream_proc_status_read(struct snd_info_entry *entry,
 	snd_iprintf(buffer, "owner_pid   : %d\n", pid_vnr(substream->pid));
 	snd_iprintf(buffer, "trigger_time: %ld.%09ld\n",
 		status.trigger_tstamp.tv_sec, status.trigger_tstamp.tv_nsec);
+	snd_iprintf(buffer, "driver_time : %ld.%09ld\n",
+		status.driver_trigger_tstamp.tv_sec,
+		status.driver_trigger_tstamp.tv_nsec);
 	snd_iprintf(buffer, "tstamp      : %ld.%09ld\n",
 		status.tstamp.tv_sec, status.tstamp.tv_nsec);
 	snd_iprintf(buffer, "delay       : %ld\n", status.delay);
@@ -472,6 +476,62 @@ static void snd_pcm_substream_proc_status_read(struct snd_info_entry *entry,
 	mutex_unlock(&substream->pcm->open_mutex);
 }
 
+static ssize_t snd_pcm_substream_proc_hwptr_trace_read(struct snd_info_entry *entry,
+							void *file_private_data,
+							struct file *file,
+							char __user *buf,
+							size_t count, loff_t pos)
+{
+	struct snd_pcm_substream *substream = entry->private_data;
+	struct snd_pcm_hwptr_trace *trace = ACCESS_ONCE(substream->hwptr_trace);
+	struct snd_pcm_hwptr_trace_entry *snap;
+	ssize_t ret = count;
+	u64 seq;
+	int i;
+
+	if (!trace)
+		return 0;
+	snap = kmalloc(sizeof(trace->entries), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+	/* take a snapshot; the records updated while copying are marked
+	 * with zero seq, as they may be torn
+	 */
+	for (i = 0; i < SNDRV_PCM_HWPTR_TRACE_ENTRIES; i++) {
+		seq = ACCESS_ONCE(trace->entries[i].seq);
+		smp_rmb();
+		snap[i] = trace->entries[i];
+		smp_rmb();
+		if (ACCESS_ONCE(trace->entries[i].seq) != seq)
+			seq = 0;
+		snap[i].seq = seq;
+	}
+	if (copy_to_user(buf, (char *)snap + pos, count))
+		ret = -EFAULT;
+	kfree(snap);
+	return ret;
+}
+
+static struct snd_info_entry_ops snd_pcm_substream_proc_hwptr_trace_ops = {
+	.read = snd_pcm_substream_proc_hwptr_trace_read,
+};
+
+static void snd_pcm_hwptr_trace_read(struct snd_info_entry *entry,
+				     struct snd_info_buffer *buffer)
+{
+	struct snd_pcm_str *pstr = entry->private_data;
+	snd_iprintf(buffer, "%u\n", pstr->hwptr_trace);
+}
+
+static void snd_pcm_hwptr_trace_write(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
+{
+	struct snd_pcm_str *pstr = entry->private_data;
+	char line[64];
+	if (!snd_info_get_line(buffer, line, sizeof(line)))
+		pstr->hwptr_trace = !!simple_strtoul(line, NULL, 10);
+}
+
 #ifdef CONFIG_SND_PCM_XRUN_DEBUG
 static void snd_pcm_xrun_debug_read(struct snd_info_entry *entry,
 				    struct snd_info_buffer *buffer)
@@ -516,6 +576,19 @@ static int snd_pcm_stream_proc_init(struct snd_pcm_str *pstr)
 	}
 	pstr->proc_info_entry = entry;
 
+	if ((entry = snd_info_create_card_entry(pcm->card, "hwptr_trace",
+						pstr->proc_root)) != NULL) {
+		entry->c.text.read = snd_pcm_hwptr_trace_read;
+		entry->c.text.write = snd_pcm_hwptr_trace_write;
+		entry->mode |= S_IWUSR;
+		entry->private_data = pstr;
+		if (snd_info_register(entry) < 0) {
+			snd_info_free_entry(entry);
+			entry = NULL;
+		}
+	}
+	pstr->proc_hwptr_trace_entry = entry;
+
 #ifdef CONFIG_SND_PCM_XRUN_DEBUG
 	if ((entry = snd_info_create_card_entry(pcm->card, "xrun_debug",
 						pstr->proc_root)) != NULL) {
@@ -539,6 +612,8 @@ static int snd_pcm_stream_proc_done(struct snd_pcm_str *pstr)
 	snd_info_free_entry(pstr->proc_xrun_debug_entry);
 	pstr->proc_xrun_debug_entry = NULL;
 #endif
+	snd_info_free_entry(pstr->proc_hwptr_trace_entry);
+	pstr->proc_hwptr_trace_entry = NULL;
 	snd_info_free_entry(pstr->proc_info_entry);
 	pstr->proc_info_entry = NULL;
 	snd_info_free_entry(pstr->proc_root);
@@ -604,6 +679,18 @@ static int snd_pcm_substream_proc_init(struct snd_pcm_substream *substream)
 	}
 	substream->proc_status_entry = entry;
 
+	if ((entry = snd_info_create_card_entry(card, "hwptr_trace", substream->proc_root)) != NULL) {
+		entry->content = SNDRV_INFO_CONTENT_DATA;
+		entry->c.ops = &snd_pcm_substream_proc_hwptr_trace_ops;
+		entry->size = sizeof(substream->hwptr_trace->entries);
+		entry->private_data = substream;
+		if (snd_info_register(entry) < 0) {
+			snd_info_free_entry(entry);
+			entry = NULL;
+		}
+	}
+	substream->proc_hwptr_trace_entry = entry;
+
 	return 0;
 }
 
@@ -617,6 +704,10 @@ static int snd_pcm_substream_proc_done(struct snd_pcm_substream *substream)
 	substream->proc_sw_params_entry = NULL;
 	snd_info_free_entry(substream->proc_status_entry);
 	substream->proc_status_entry = NULL;
+	snd_info_free_entry(substream->proc_hwptr_trace_entry);
+	substream->proc_hwptr_trace_entry = NULL;
+	kfree(substream->hwptr_trace);
+	substream->hwptr_trace = NULL;
 	snd_info_free_entry(substream->proc_root);
 	substream->proc_root = NULL;
 	return 0;
@@ -690,6 +781,8 @@ int snd_pcm_new_stream(struct snd_pcm *pcm, int stream, int substream_count)
 				return err;
 			}
 		}
+		snd_pcm_wakeup_timer_init(substream);
+		snd_pcm_start_at_timer_init(substream);
 		substream->group = &substream->self_group;
 		spin_lock_init(&substream->self_group.lock);
 		INIT_LIST_HEAD(&substream->self_group.substreams);
@@ -899,7 +992,7 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 		return -EINVAL;
 	}
 
-	if (file->f_flags & O_APPEND) {
+	if (file && (file->f_flags & O_APPEND)) {
 		if (prefer_subdevice < 0) {
 			if (pstr->substream_count > 1)
 				return -EINVAL; /* must be unique */
@@ -958,10 +1051,17 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 
 	runtime->status->state = SNDRV_PCM_STATE_OPEN;
 
+#ifdef CONFIG_SND_VERBOSE_PROCFS
+	/* the trace ring is optional; it simply stays off without memory */
+	if (pstr->hwptr_trace && !substream->hwptr_trace && !pcm->internal)
+		substream->hwptr_trace = kzalloc(sizeof(*substream->hwptr_trace),
+						 GFP_KERNEL);
+#endif
+
 	substream->runtime = runtime;
 	substream->private_data = pcm->private_data;
 	substream->ref_count = 1;
-	substream->f_flags = file->f_flags;
+	substream->f_flags = file ? file->f_flags : 0;
 	substream->pid = get_pid(task_pid(current));
 	pstr->substream_opened++;
 	*rsubstream = substream;
@@ -975,6 +1075,9 @@ void snd_pcm_detach_substream(struct snd_pcm_substream *substream)
 	if (PCM_RUNTIME_CHECK(substream))
 		return;
 	runtime = substream->runtime;
+	hrtimer_cancel(&substream->wakeup_timer);
+	hrtimer_cancel(&substream->start_at_timer);
+	snd_pcm_lib_free_buffer_cache(substream);
 	if (runtime->private_free != NULL)
 		runtime->private_free(runtime);
 	snd_free_pages((void*)runtime->status,
@@ -982,6 +1085,7 @@ void snd_pcm_detach_substream(struct snd_pcm_substream *substream)
 	snd_free_pages((void*)runtime->control,
 		       PAGE_ALIGN(sizeof(struct snd_pcm_mmap_control)));
 	kfree(runtime->hw_constraints.rules);
+	kfree(runtime->hw_refine_cache);
 #ifdef CONFIG_SND_PCM_XRUN_DEBUG
 	kfree(runtime->hwptr_log);
 #endif
@@ -192,7 +192,8 @@ struct snd_pcm_status32 {
 	s32 suspended_state;
 	u32 reserved_alignment;
 	struct compat_timespec audio_tstamp;
-	unsigned char reserved[56-sizeof(struct compat_timespec)];
+	struct compat_timespec driver_trigger_tstamp;
+	unsigned char reserved[56-2*sizeof(struct compat_timespec)];
 } __attribute__((packed));
 
 
@@ -216,12 +217,24 @@ static int snd_pcm_status_user_compat(struct snd_pcm_substream *substream,
 	    put_user(status.avail_max, &src->avail_max) ||
 	    put_user(status.overrange, &src->overrange) ||
 	    put_user(status.suspended_state, &src->suspended_state) ||
-	    compat_put_timespec(&status.audio_tstamp, &src->audio_tstamp))
+	    compat_put_timespec(&status.audio_tstamp, &src->audio_tstamp) ||
+	    compat_put_timespec(&status.driver_trigger_tstamp,
+				&src->driver_trigger_tstamp))
 		return -EFAULT;
 
 	return err;
 }
 
+static int snd_pcm_ioctl_start_at_compat(struct snd_pcm_substream *substream,
+					 struct compat_timespec __user *src)
+{
+	struct timespec ts;
+
+	if (compat_get_timespec(&ts, src))
+		return -EFAULT;
+	return snd_pcm_start_at(substream, &ts);
+}
+
 /* both for HW_PARAMS and HW_REFINE */
 static int snd_pcm_ioctl_hw_params_compat(struct snd_pcm_substream *substream,
 					  int refine, 
@@ -359,6 +372,67 @@ static int snd_pcm_ioctl_xfern_compat(struct snd_pcm_substream *substream,
 }
 
 
+/* snd_xferiv needs remapping of the segment array */
+struct snd_xferi_seg32 {
+	u32 buf;
+	u32 frames;
+};
+
+struct snd_xferiv32 {
+	s32 result;
+	u32 segs;
+	u32 nsegs;
+};
+
+static int snd_pcm_ioctl_xferiv_compat(struct snd_pcm_substream *substream,
+				       int dir, struct snd_xferiv32 __user *data32)
+{
+	compat_caddr_t buf;
+	struct snd_xferi_seg32 __user *segptr;
+	struct snd_xferi_seg *segs;
+	u32 nsegs;
+	int err, i;
+
+	if (! substream->runtime)
+		return -ENOTTY;
+	if (substream->stream != dir)
+		return -EINVAL;
+	if (substream->runtime->status->state == SNDRV_PCM_STATE_OPEN)
+		return -EBADFD;
+
+	if (get_user(buf, &data32->segs) ||
+	    get_user(nsegs, &data32->nsegs))
+		return -EFAULT;
+	if (!nsegs || nsegs > SNDRV_PCM_XFERIV_SEGS_MAX)
+		return -EINVAL;
+	segptr = compat_ptr(buf);
+	segs = kmalloc(sizeof(*segs) * nsegs, GFP_KERNEL);
+	if (segs == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nsegs; i++) {
+		u32 ptr, frames;
+		if (get_user(ptr, &segptr->buf) ||
+		    get_user(frames, &segptr->frames)) {
+			kfree(segs);
+			return -EFAULT;
+		}
+		segs[i].buf = compat_ptr(ptr);
+		segs[i].frames = frames;
+		segptr++;
+	}
+	if (dir == SNDRV_PCM_STREAM_PLAYBACK)
+		err = snd_pcm_lib_writeiv(substream, segs, nsegs);
+	else
+		err = snd_pcm_lib_readiv(substream, segs, nsegs);
+	if (err >= 0) {
+		if (put_user(err, &data32->result))
+			err = -EFAULT;
+	}
+	kfree(segs);
+	return err;
+}
+
+
 struct snd_pcm_mmap_status32 {
 	s32 state;
 	s32 pad1;
@@ -455,10 +529,13 @@ enum {
 	SNDRV_PCM_IOCTL_CHANNEL_INFO32 = _IOR('A', 0x32, struct snd_pcm_channel_info32),
 	SNDRV_PCM_IOCTL_REWIND32 = _IOW('A', 0x46, u32),
 	SNDRV_PCM_IOCTL_FORWARD32 = _IOW('A', 0x49, u32),
+	SNDRV_PCM_IOCTL_START_AT32 = _IOW('A', 0x4a, struct compat_timespec),
 	SNDRV_PCM_IOCTL_WRITEI_FRAMES32 = _IOW('A', 0x50, struct snd_xferi32),
 	SNDRV_PCM_IOCTL_READI_FRAMES32 = _IOR('A', 0x51, struct snd_xferi32),
 	SNDRV_PCM_IOCTL_WRITEN_FRAMES32 = _IOW('A', 0x52, struct snd_xfern32),
 	SNDRV_PCM_IOCTL_READN_FRAMES32 = _IOR('A', 0x53, struct snd_xfern32),
+	SNDRV_PCM_IOCTL_WRITEIV_FRAMES32 = _IOW('A', 0x54, struct snd_xferiv32),
+	SNDRV_PCM_IOCTL_READIV_FRAMES32 = _IOR('A', 0x55, struct snd_xferiv32),
 	SNDRV_PCM_IOCTL_SYNC_PTR32 = _IOWR('A', 0x23, struct snd_pcm_sync_ptr32),
 
 };
@@ -524,12 +601,18 @@ static long snd_pcm_ioctl_compat(struct file *file, unsigned int cmd, unsigned l
 		return snd_pcm_ioctl_xfern_compat(substream, SNDRV_PCM_STREAM_PLAYBACK, argp);
 	case SNDRV_PCM_IOCTL_READN_FRAMES32:
 		return snd_pcm_ioctl_xfern_compat(substream, SNDRV_PCM_STREAM_CAPTURE, argp);
+	case SNDRV_PCM_IOCTL_WRITEIV_FRAMES32:
+		return snd_pcm_ioctl_xferiv_compat(substream, SNDRV_PCM_STREAM_PLAYBACK, argp);
+	case SNDRV_PCM_IOCTL_READIV_FRAMES32:
+		return snd_pcm_ioctl_xferiv_compat(substream, SNDRV_PCM_STREAM_CAPTURE, argp);
 	case SNDRV_PCM_IOCTL_DELAY32:
 		return snd_pcm_ioctl_delay_compat(substream, argp);
 	case SNDRV_PCM_IOCTL_REWIND32:
 		return snd_pcm_ioctl_rewind_compat(substream, argp);
 	case SNDRV_PCM_IOCTL_FORWARD32:
 		return snd_pcm_ioctl_forward_compat(substream, argp);
+	case SNDRV_PCM_IOCTL_START_AT32:
+		return snd_pcm_ioctl_start_at_compat(substream, argp);
 	}
 
 	return -ENOIOCTLCMD;
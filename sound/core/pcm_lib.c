@@ -22,6 +22,8 @@
 
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
 #include <linux/math64.h>
 #include <linux/export.h>
 #include <sound/core.h>
@@ -168,6 +170,7 @@ static void xrun(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
 
+	runtime->xrun_count++;
 	if (runtime->tstamp_mode == SNDRV_PCM_TSTAMP_ENABLE)
 		snd_pcm_gettime(runtime, (struct timespec *)&runtime->status->tstamp);
 	snd_pcm_stop(substream, SNDRV_PCM_STATE_XRUN);
@@ -276,6 +279,51 @@ static void xrun_log_show(struct snd_pcm_substream *substream)
 
 #endif
 
+#ifdef CONFIG_SND_VERBOSE_PROCFS
+/*
+ * hw_ptr trace ring, exported via the hwptr_trace proc file
+ *
+ * The ring is allocated at open time when the stream's hwptr_trace proc
+ * switch is on.  The writer is always serialized by the stream lock, so
+ * the ring itself is lock-less; readers use the seq field of each entry
+ * to order the records and to skip the one being written.
+ */
+#define hwptr_trace_enabled(substream) \
+	unlikely((substream)->hwptr_trace && (substream)->pstr->hwptr_trace)
+
+static void hwptr_trace(struct snd_pcm_substream *substream,
+			snd_pcm_uframes_t pos, snd_pcm_uframes_t old_hw_ptr,
+			snd_pcm_uframes_t new_hw_ptr, unsigned int flags)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_hwptr_trace *trace = substream->hwptr_trace;
+	struct snd_pcm_hwptr_trace_entry *entry;
+	snd_pcm_sframes_t delta;
+	u64 seq;
+
+	seq = ++trace->seq;
+	entry = &trace->entries[(seq - 1) &
+				(SNDRV_PCM_HWPTR_TRACE_ENTRIES - 1)];
+	entry->seq = 0;
+	smp_wmb();
+	delta = new_hw_ptr - old_hw_ptr;
+	if (delta < 0)
+		delta += runtime->boundary;
+	entry->tstamp = ktime_to_ns(ktime_get());
+	entry->hw_ptr = new_hw_ptr;
+	entry->pos = pos;
+	entry->delta = delta;
+	entry->jiffies = jiffies;
+	entry->flags = flags;
+	smp_wmb();
+	entry->seq = seq;
+}
+#else /* !CONFIG_SND_VERBOSE_PROCFS */
+#define hwptr_trace_enabled(substream)	0
+#define hwptr_trace(substream, pos, old_hw_ptr, new_hw_ptr, flags) \
+	do { } while (0)
+#endif
+
 int snd_pcm_update_state(struct snd_pcm_substream *substream,
 			 struct snd_pcm_runtime *runtime)
 {
@@ -338,6 +386,10 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 	}
 
 	if (pos == SNDRV_PCM_POS_XRUN) {
+		if (hwptr_trace_enabled(substream))
+			hwptr_trace(substream, pos, old_hw_ptr, old_hw_ptr,
+				    SNDRV_PCM_HWPTR_TRACE_XRUN |
+				    (in_interrupt ? SNDRV_PCM_HWPTR_TRACE_IRQ : 0));
 		xrun(substream);
 		return -EPIPE;
 	}
@@ -366,6 +418,7 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 			/* check for double acknowledged interrupts */
 			hdelta = curr_jiffies - runtime->hw_ptr_jiffies;
 			if (hdelta > runtime->hw_ptr_buffer_jiffies/2) {
+				runtime->hw_ptr_corrections++;
 				hw_base += runtime->buffer_size;
 				if (hw_base >= runtime->boundary) {
 					hw_base = 0;
@@ -419,6 +472,7 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 		hdelta = jdelta - delta * HZ / runtime->rate;
 		xrun_threshold = runtime->hw_ptr_buffer_jiffies / 2 + 1;
 		while (hdelta > xrun_threshold) {
+			runtime->hw_ptr_corrections++;
 			delta += runtime->buffer_size;
 			hw_base += runtime->buffer_size;
 			if (hw_base >= runtime->boundary) {
@@ -433,6 +487,7 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 
 	/* something must be really wrong */
 	if (delta >= runtime->buffer_size + runtime->period_size) {
+		runtime->hw_ptr_corrections++;
 		hw_ptr_error(substream,
 			       "Unexpected hw_pointer value %s"
 			       "(stream=%i, pos=%ld, new_hw_ptr=%ld, "
@@ -440,6 +495,10 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 				     in_interrupt ? "[Q] " : "[P]",
 				     substream->stream, (long)pos,
 				     (long)new_hw_ptr, (long)old_hw_ptr);
+		if (hwptr_trace_enabled(substream))
+			hwptr_trace(substream, pos, old_hw_ptr, old_hw_ptr,
+				    SNDRV_PCM_HWPTR_TRACE_ERROR |
+				    (in_interrupt ? SNDRV_PCM_HWPTR_TRACE_IRQ : 0));
 		return 0;
 	}
 
@@ -462,6 +521,7 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 		delta = jdelta /
 			(((runtime->period_size * HZ) / runtime->rate)
 								+ HZ/100);
+		runtime->hw_ptr_corrections++;
 		/* move new_hw_ptr according jiffies not pos variable */
 		new_hw_ptr = old_hw_ptr;
 		hw_base = delta;
@@ -492,6 +552,7 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 	}
  no_jiffies_check:
 	if (delta > runtime->period_size + runtime->period_size / 2) {
+		runtime->hw_ptr_corrections++;
 		hw_ptr_error(substream,
 			     "Lost interrupts? %s"
 			     "(stream=%i, delta=%ld, new_hw_ptr=%ld, "
@@ -503,6 +564,9 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 	}
 
  no_delta_check:
+	if (hwptr_trace_enabled(substream))
+		hwptr_trace(substream, pos, old_hw_ptr, new_hw_ptr,
+			    in_interrupt ? SNDRV_PCM_HWPTR_TRACE_IRQ : 0);
 	if (runtime->status->hw_ptr == new_hw_ptr)
 		return 0;
 
@@ -1193,6 +1257,7 @@ int snd_pcm_hw_rule_add(struct snd_pcm_runtime *runtime, unsigned int cond,
 	}
 	constrs->rules_num++;
 	va_end(args);
+	snd_pcm_hw_refine_cache_invalidate(runtime);
 	return 0;
 }
 
@@ -1213,6 +1278,7 @@ int snd_pcm_hw_constraint_mask(struct snd_pcm_runtime *runtime, snd_pcm_hw_param
 {
 	struct snd_pcm_hw_constraints *constrs = &runtime->hw_constraints;
 	struct snd_mask *maskp = constrs_mask(constrs, var);
+	snd_pcm_hw_refine_cache_invalidate(runtime);
 	*maskp->bits &= mask;
 	memset(maskp->bits + 1, 0, (SNDRV_MASK_MAX-32) / 8); /* clear rest */
 	if (*maskp->bits == 0)
@@ -1235,6 +1301,7 @@ int snd_pcm_hw_constraint_mask64(struct snd_pcm_runtime *runtime, snd_pcm_hw_par
 {
 	struct snd_pcm_hw_constraints *constrs = &runtime->hw_constraints;
 	struct snd_mask *maskp = constrs_mask(constrs, var);
+	snd_pcm_hw_refine_cache_invalidate(runtime);
 	maskp->bits[0] &= (u_int32_t)mask;
 	maskp->bits[1] &= (u_int32_t)(mask >> 32);
 	memset(maskp->bits + 2, 0, (SNDRV_MASK_MAX-64) / 8); /* clear rest */
@@ -1256,6 +1323,7 @@ int snd_pcm_hw_constraint_mask64(struct snd_pcm_runtime *runtime, snd_pcm_hw_par
 int snd_pcm_hw_constraint_integer(struct snd_pcm_runtime *runtime, snd_pcm_hw_param_t var)
 {
 	struct snd_pcm_hw_constraints *constrs = &runtime->hw_constraints;
+	snd_pcm_hw_refine_cache_invalidate(runtime);
 	return snd_interval_setinteger(constrs_interval(constrs, var));
 }
 
@@ -1282,6 +1350,7 @@ int snd_pcm_hw_constraint_minmax(struct snd_pcm_runtime *runtime, snd_pcm_hw_par
 	t.max = max;
 	t.openmin = t.openmax = 0;
 	t.integer = 0;
+	snd_pcm_hw_refine_cache_invalidate(runtime);
 	return snd_interval_refine(constrs_interval(constrs, var), &t);
 }
 
@@ -1863,6 +1932,94 @@ void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
 
 EXPORT_SYMBOL(snd_pcm_period_elapsed);
 
+/*
+ * Timer-driven wakeups
+ *
+ * With SNDRV_PCM_HW_PARAMS_TIMER_WAKEUP the stream runs without period
+ * interrupts and the sleepers are woken by an hrtimer instead.  The
+ * expiry is computed from the current position, the rate and the
+ * wakeup threshold (avail_min or the transfer wakeup size), and it is
+ * recomputed at each expiry, so the wakeups follow the actual progress
+ * of the hardware.  This requires an accurate pointer callback, hence
+ * it's available only for drivers without SNDRV_PCM_INFO_BATCH.
+ */
+#define WAKEUP_TIMER_MIN_NS	(100 * NSEC_PER_USEC)
+
+static u64 snd_pcm_wakeup_timer_ns(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t avail, target;
+	u64 ns;
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		avail = snd_pcm_playback_avail(runtime);
+	else
+		avail = snd_pcm_capture_avail(runtime);
+	if (runtime->status->state == SNDRV_PCM_STATE_DRAINING)
+		target = runtime->buffer_size;
+	else if (runtime->twake)
+		target = runtime->twake;
+	else
+		target = runtime->control->avail_min ? : 1;
+	if (avail >= target)
+		return 0;
+	ns = div_u64((u64)(target - avail) * NSEC_PER_SEC, runtime->rate);
+	return max_t(u64, ns, WAKEUP_TIMER_MIN_NS);
+}
+
+static enum hrtimer_restart snd_pcm_wakeup_timer_func(struct hrtimer *timer)
+{
+	struct snd_pcm_substream *substream =
+		container_of(timer, struct snd_pcm_substream, wakeup_timer);
+	struct snd_pcm_runtime *runtime;
+	unsigned long flags;
+	u64 ns = 0;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	runtime = substream->runtime;
+	if (!runtime || !runtime->timer_wakeup || !snd_pcm_running(substream))
+		goto unlock;
+	/* wakes up the sleepers via snd_pcm_update_state() */
+	if (snd_pcm_update_hw_ptr(substream) < 0)
+		goto unlock;
+	if (!snd_pcm_running(substream))
+		goto unlock;
+	if (waitqueue_active(&runtime->sleep) ||
+	    waitqueue_active(&runtime->tsleep))
+		ns = snd_pcm_wakeup_timer_ns(substream);
+ unlock:
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+	if (!ns)
+		return HRTIMER_NORESTART;
+	hrtimer_forward_now(timer, ns_to_ktime(ns));
+	return HRTIMER_RESTART;
+}
+
+/* called once at the substream creation */
+void snd_pcm_wakeup_timer_init(struct snd_pcm_substream *substream)
+{
+	hrtimer_init(&substream->wakeup_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	substream->wakeup_timer.function = snd_pcm_wakeup_timer_func;
+}
+
+/*
+ * (Re-)arm the wakeup timer before a sleep for avail_min, twake or
+ * drain; called with the stream lock held
+ */
+void snd_pcm_wakeup_timer_arm(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	u64 ns;
+
+	if (!runtime->timer_wakeup || !snd_pcm_running(substream))
+		return;
+	ns = snd_pcm_wakeup_timer_ns(substream);
+	if (ns)
+		hrtimer_start(&substream->wakeup_timer, ns_to_ktime(ns),
+			      HRTIMER_MODE_REL);
+}
+
 /*
  * Wait until avail_min data becomes available
  * Returns a negative error code if any error occurs during operation.
@@ -1913,6 +2070,7 @@ static int wait_for_avail(struct snd_pcm_substream *substream,
 			avail = snd_pcm_capture_avail(runtime);
 		if (avail >= runtime->twake)
 			break;
+		snd_pcm_wakeup_timer_arm(substream);
 		snd_pcm_stream_unlock_irq(substream);
 
 		tout = schedule_timeout(wait_time);
@@ -2380,6 +2538,241 @@ snd_pcm_sframes_t snd_pcm_lib_readv(struct snd_pcm_substream *substream,
 
 EXPORT_SYMBOL(snd_pcm_lib_readv);
 
+/*
+ * vectored interleaved read/write
+ *
+ * snd_pcm_lib_write1() and snd_pcm_lib_read1() drop the stream lock and
+ * call ack for each contiguous chunk.  Here all frames available at once
+ * are copied from/to the user buffers, split at the segment borders and
+ * at the ring buffer wrap, in a single unlocked section followed by a
+ * single ack.
+ */
+static int snd_pcm_lib_segs_transfer(struct snd_pcm_substream *substream,
+				     snd_pcm_uframes_t appl_ofs,
+				     const struct snd_xferi_seg *segs,
+				     unsigned int *segp,
+				     snd_pcm_uframes_t *seg_offp,
+				     snd_pcm_uframes_t frames,
+				     transfer_f transfer)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	unsigned int seg = *segp;
+	snd_pcm_uframes_t seg_off = *seg_offp;
+	snd_pcm_uframes_t n;
+	int err;
+
+	while (frames > 0) {
+		if (seg_off >= segs[seg].frames) {
+			seg++;
+			seg_off = 0;
+			continue;
+		}
+		n = segs[seg].frames - seg_off;
+		if (n > frames)
+			n = frames;
+		if (n > runtime->buffer_size - appl_ofs)
+			n = runtime->buffer_size - appl_ofs;
+		err = transfer(substream, appl_ofs,
+			       (unsigned long)segs[seg].buf, seg_off, n);
+		if (err < 0)
+			return err;
+		frames -= n;
+		seg_off += n;
+		appl_ofs += n;
+		if (appl_ofs >= runtime->buffer_size)
+			appl_ofs = 0;
+	}
+	*segp = seg;
+	*seg_offp = seg_off;
+	return 0;
+}
+
+static snd_pcm_sframes_t snd_pcm_lib_xferiv1(struct snd_pcm_substream *substream,
+					     const struct snd_xferi_seg *segs,
+					     unsigned int nsegs,
+					     int nonblock)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int is_playback = substream->stream == SNDRV_PCM_STREAM_PLAYBACK;
+	transfer_f transfer = is_playback ? snd_pcm_lib_write_transfer :
+		snd_pcm_lib_read_transfer;
+	snd_pcm_uframes_t size = 0;
+	snd_pcm_uframes_t xfer = 0;
+	snd_pcm_uframes_t seg_off = 0;
+	snd_pcm_uframes_t avail;
+	unsigned int seg = 0;
+	unsigned int k;
+	int err = 0;
+
+	for (k = 0; k < nsegs; k++) {
+		if (segs[k].frames > LONG_MAX - size)
+			return -EINVAL;
+		size += segs[k].frames;
+	}
+	if (size == 0)
+		return 0;
+
+	snd_pcm_stream_lock_irq(substream);
+	switch (runtime->status->state) {
+	case SNDRV_PCM_STATE_PREPARED:
+		if (!is_playback && size >= runtime->start_threshold) {
+			err = snd_pcm_start(substream);
+			if (err < 0)
+				goto _end_unlock;
+		}
+		break;
+	case SNDRV_PCM_STATE_DRAINING:
+		if (is_playback) {
+			err = -EBADFD;
+			goto _end_unlock;
+		}
+		break;
+	case SNDRV_PCM_STATE_RUNNING:
+	case SNDRV_PCM_STATE_PAUSED:
+		break;
+	case SNDRV_PCM_STATE_XRUN:
+		err = -EPIPE;
+		goto _end_unlock;
+	case SNDRV_PCM_STATE_SUSPENDED:
+		err = -ESTRPIPE;
+		goto _end_unlock;
+	default:
+		err = -EBADFD;
+		goto _end_unlock;
+	}
+
+	runtime->twake = runtime->control->avail_min ? : 1;
+	if (runtime->status->state == SNDRV_PCM_STATE_RUNNING)
+		snd_pcm_update_hw_ptr(substream);
+	if (is_playback)
+		avail = snd_pcm_playback_avail(runtime);
+	else
+		avail = snd_pcm_capture_avail(runtime);
+	while (xfer < size) {
+		snd_pcm_uframes_t frames, appl_ptr;
+		if (!avail) {
+			if (!is_playback &&
+			    runtime->status->state == SNDRV_PCM_STATE_DRAINING) {
+				snd_pcm_stop(substream, SNDRV_PCM_STATE_SETUP);
+				goto _end_unlock;
+			}
+			if (nonblock) {
+				err = -EAGAIN;
+				goto _end_unlock;
+			}
+			runtime->twake = min_t(snd_pcm_uframes_t, size - xfer,
+					runtime->control->avail_min ? : 1);
+			err = wait_for_avail(substream, &avail);
+			if (err < 0)
+				goto _end_unlock;
+			if (!avail)
+				continue; /* draining */
+		}
+		frames = min(size - xfer, avail);
+		appl_ptr = runtime->control->appl_ptr;
+		snd_pcm_stream_unlock_irq(substream);
+		err = snd_pcm_lib_segs_transfer(substream,
+						appl_ptr % runtime->buffer_size,
+						segs, &seg, &seg_off, frames,
+						transfer);
+		snd_pcm_stream_lock_irq(substream);
+		if (err < 0)
+			goto _end_unlock;
+		switch (runtime->status->state) {
+		case SNDRV_PCM_STATE_XRUN:
+			err = -EPIPE;
+			goto _end_unlock;
+		case SNDRV_PCM_STATE_SUSPENDED:
+			err = -ESTRPIPE;
+			goto _end_unlock;
+		default:
+			break;
+		}
+		appl_ptr += frames;
+		if (appl_ptr >= runtime->boundary)
+			appl_ptr -= runtime->boundary;
+		runtime->control->appl_ptr = appl_ptr;
+		if (substream->ops->ack)
+			substream->ops->ack(substream);
+
+		xfer += frames;
+		avail -= frames;
+		if (is_playback &&
+		    runtime->status->state == SNDRV_PCM_STATE_PREPARED &&
+		    snd_pcm_playback_hw_avail(runtime) >= (snd_pcm_sframes_t)runtime->start_threshold) {
+			err = snd_pcm_start(substream);
+			if (err < 0)
+				goto _end_unlock;
+		}
+	}
+ _end_unlock:
+	runtime->twake = 0;
+	if (xfer > 0 && err >= 0)
+		snd_pcm_update_state(substream, runtime);
+	snd_pcm_stream_unlock_irq(substream);
+	return xfer > 0 ? (snd_pcm_sframes_t)xfer : err;
+}
+
+/**
+ * snd_pcm_lib_writeiv - write interleaved frames from several buffers
+ * @substream: the PCM substream
+ * @segs: the array of user buffers and their sizes in frames
+ * @nsegs: the number of elements in @segs
+ *
+ * Return: The number of written frames, or a negative error code when
+ * nothing was written.
+ */
+snd_pcm_sframes_t snd_pcm_lib_writeiv(struct snd_pcm_substream *substream,
+				      const struct snd_xferi_seg *segs,
+				      unsigned int nsegs)
+{
+	struct snd_pcm_runtime *runtime;
+	int nonblock;
+	int err;
+
+	err = pcm_sanity_check(substream);
+	if (err < 0)
+		return err;
+	runtime = substream->runtime;
+	nonblock = !!(substream->f_flags & O_NONBLOCK);
+
+	if (runtime->access != SNDRV_PCM_ACCESS_RW_INTERLEAVED &&
+	    runtime->channels > 1)
+		return -EINVAL;
+	return snd_pcm_lib_xferiv1(substream, segs, nsegs, nonblock);
+}
+
+EXPORT_SYMBOL(snd_pcm_lib_writeiv);
+
+/**
+ * snd_pcm_lib_readiv - read interleaved frames into several buffers
+ * @substream: the PCM substream
+ * @segs: the array of user buffers and their sizes in frames
+ * @nsegs: the number of elements in @segs
+ *
+ * Return: The number of read frames, or a negative error code when
+ * nothing was read.
+ */
+snd_pcm_sframes_t snd_pcm_lib_readiv(struct snd_pcm_substream *substream,
+				     const struct snd_xferi_seg *segs,
+				     unsigned int nsegs)
+{
+	struct snd_pcm_runtime *runtime;
+	int nonblock;
+	int err;
+
+	err = pcm_sanity_check(substream);
+	if (err < 0)
+		return err;
+	runtime = substream->runtime;
+	nonblock = !!(substream->f_flags & O_NONBLOCK);
+	if (runtime->access != SNDRV_PCM_ACCESS_RW_INTERLEAVED)
+		return -EINVAL;
+	return snd_pcm_lib_xferiv1(substream, segs, nsegs, nonblock);
+}
+
+EXPORT_SYMBOL(snd_pcm_lib_readiv);
+
 /*
  * standard channel mapping helpers
  */
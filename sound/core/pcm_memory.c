@@ -100,6 +100,9 @@ static void snd_pcm_lib_preallocate_dma_free(struct snd_pcm_substream *substream
 int snd_pcm_lib_preallocate_free(struct snd_pcm_substream *substream)
 {
 	snd_pcm_lib_preallocate_dma_free(substream);
+	/* the device may go away, so drop the pooled buffers */
+	if (substream->dma_buffer.dev.type != SNDRV_DMA_TYPE_CONTINUOUS)
+		snd_dma_pool_flush(&substream->dma_buffer.dev);
 #ifdef CONFIG_SND_VERBOSE_PROCFS
 	snd_info_free_entry(substream->proc_prealloc_max_entry);
 	substream->proc_prealloc_max_entry = NULL;
@@ -366,12 +369,21 @@ int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size)
 	if (substream->dma_buffer.area != NULL &&
 	    substream->dma_buffer.bytes >= size) {
 		dmab = &substream->dma_buffer; /* use the pre-allocated buffer */
+	} else if (substream->dma_buffer_cache &&
+		   substream->dma_buffer_cache->bytes >= size) {
+		/* reuse the buffer of the last hw_params */
+		dmab = substream->dma_buffer_cache;
+		substream->dma_buffer_cache = NULL;
 	} else {
+		snd_pcm_lib_free_buffer_cache(substream);
 		dmab = kzalloc(sizeof(*dmab), GFP_KERNEL);
 		if (! dmab)
 			return -ENOMEM;
 		dmab->dev = substream->dma_buffer.dev;
-		if (snd_dma_alloc_pages(substream->dma_buffer.dev.type,
+		if (snd_dma_pool_get(substream->dma_buffer.dev.type,
+				     substream->dma_buffer.dev.dev,
+				     size, dmab) < 0 &&
+		    snd_dma_alloc_pages(substream->dma_buffer.dev.type,
 					substream->dma_buffer.dev.dev,
 					size, dmab) < 0) {
 			kfree(dmab);
@@ -403,9 +415,11 @@ int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream)
 	if (runtime->dma_area == NULL)
 		return 0;
 	if (runtime->dma_buffer_p != &substream->dma_buffer) {
-		/* it's a newly allocated buffer.  release it now. */
-		snd_dma_free_pages(runtime->dma_buffer_p);
-		kfree(runtime->dma_buffer_p);
+		/* it's a newly allocated buffer.  keep it until the next
+		 * hw_params or the close, as it's likely to fit again
+		 */
+		snd_pcm_lib_free_buffer_cache(substream);
+		substream->dma_buffer_cache = runtime->dma_buffer_p;
 	}
 	snd_pcm_set_runtime_buffer(substream, NULL);
 	return 0;
@@ -413,6 +427,25 @@ int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream)
 
 EXPORT_SYMBOL(snd_pcm_lib_free_pages);
 
+/**
+ * snd_pcm_lib_free_buffer_cache - release the buffer kept over hw_free
+ * @substream: the pcm substream instance
+ *
+ * Gives the buffer which snd_pcm_lib_free_pages() kept for the reuse
+ * by the next snd_pcm_lib_malloc_pages() call back to the buffer pool.
+ * Called when the substream is closed.
+ */
+void snd_pcm_lib_free_buffer_cache(struct snd_pcm_substream *substream)
+{
+	struct snd_dma_buffer *dmab = substream->dma_buffer_cache;
+
+	if (!dmab)
+		return;
+	substream->dma_buffer_cache = NULL;
+	snd_dma_pool_put(dmab);
+	kfree(dmab);
+}
+
 int _snd_pcm_lib_alloc_vmalloc_buffer(struct snd_pcm_substream *substream,
 				      size_t size, gfp_t gfp_flags)
 {
@@ -161,8 +161,115 @@ static const char * const snd_pcm_hw_param_names[] = {
 };
 #endif
 
-int snd_pcm_hw_refine(struct snd_pcm_substream *substream, 
-		      struct snd_pcm_hw_params *params)
+/*
+ * hw_refine result cache
+ *
+ * Audio servers probe the configuration space with dozens of refine
+ * calls per open.  When the driver's rules depend only on the
+ * constraints given at open time, the result for the same input is
+ * always the same, so it can be looked up instead of running the rules.
+ */
+#define HW_REFINE_CACHE_SIZE	8
+
+struct snd_pcm_hw_refine_cache_entry {
+	struct snd_pcm_hw_params in;
+	struct snd_pcm_hw_params out;
+	int result;
+};
+
+struct snd_pcm_hw_refine_cache {
+	spinlock_t lock;
+	unsigned int used;	/* number of valid entries */
+	unsigned int next;	/* entry to be replaced next */
+	struct snd_pcm_hw_refine_cache_entry entries[HW_REFINE_CACHE_SIZE];
+};
+
+/**
+ * snd_pcm_hw_refine_cache_enable - enable caching of hw_refine results
+ * @runtime: the runtime instance
+ *
+ * Call this from the open callback when all hw_rule functions of the
+ * driver depend only on their parameters and the private data given at
+ * open time, i.e. not on the state of other streams or the hardware.
+ * The cache is flushed whenever a constraint or rule is added; a driver
+ * changing its constraints in another way has to call
+ * snd_pcm_hw_refine_cache_invalidate().
+ *
+ * Return: Zero if successful, or a negative error code on failure.
+ */
+int snd_pcm_hw_refine_cache_enable(struct snd_pcm_runtime *runtime)
+{
+	struct snd_pcm_hw_refine_cache *cache;
+
+	if (runtime->hw_refine_cache)
+		return 0;
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return -ENOMEM;
+	spin_lock_init(&cache->lock);
+	runtime->hw_refine_cache = cache;
+	return 0;
+}
+EXPORT_SYMBOL(snd_pcm_hw_refine_cache_enable);
+
+/**
+ * snd_pcm_hw_refine_cache_invalidate - drop the cached hw_refine results
+ * @runtime: the runtime instance
+ */
+void snd_pcm_hw_refine_cache_invalidate(struct snd_pcm_runtime *runtime)
+{
+	struct snd_pcm_hw_refine_cache *cache = runtime->hw_refine_cache;
+
+	if (!cache)
+		return;
+	spin_lock(&cache->lock);
+	cache->used = 0;
+	cache->next = 0;
+	spin_unlock(&cache->lock);
+}
+EXPORT_SYMBOL(snd_pcm_hw_refine_cache_invalidate);
+
+static int hw_refine_cache_lookup(struct snd_pcm_hw_refine_cache *cache,
+				  struct snd_pcm_hw_params *params, int *result)
+{
+	struct snd_pcm_hw_refine_cache_entry *e;
+	unsigned int k;
+	int found = 0;
+
+	spin_lock(&cache->lock);
+	for (k = 0; k < cache->used; k++) {
+		e = &cache->entries[k];
+		if (!memcmp(&e->in, params, sizeof(*params))) {
+			memcpy(params, &e->out, sizeof(*params));
+			*result = e->result;
+			found = 1;
+			break;
+		}
+	}
+	spin_unlock(&cache->lock);
+	return found;
+}
+
+static void hw_refine_cache_store(struct snd_pcm_hw_refine_cache *cache,
+				  const struct snd_pcm_hw_params *in,
+				  const struct snd_pcm_hw_params *out,
+				  int result)
+{
+	struct snd_pcm_hw_refine_cache_entry *e;
+
+	spin_lock(&cache->lock);
+	e = &cache->entries[cache->next];
+	memcpy(&e->in, in, sizeof(*in));
+	memcpy(&e->out, out, sizeof(*out));
+	e->result = result;
+	cache->next = (cache->next + 1) % HW_REFINE_CACHE_SIZE;
+	if (cache->used < HW_REFINE_CACHE_SIZE)
+		cache->used++;
+	spin_unlock(&cache->lock);
+}
+
+static int snd_pcm_hw_refine_rules(struct snd_pcm_substream *substream,
+				   struct snd_pcm_hw_params *params)
 {
 	unsigned int k;
 	struct snd_pcm_hardware *hw;
@@ -174,15 +281,6 @@ int snd_pcm_hw_refine(struct snd_pcm_substream *substream,
 	unsigned int stamp = 2;
 	int changed, again;
 
-	params->info = 0;
-	params->fifo_size = 0;
-	if (params->rmask & (1 << SNDRV_PCM_HW_PARAM_SAMPLE_BITS))
-		params->msbits = 0;
-	if (params->rmask & (1 << SNDRV_PCM_HW_PARAM_RATE)) {
-		params->rate_num = 0;
-		params->rate_den = 0;
-	}
-
 	for (k = SNDRV_PCM_HW_PARAM_FIRST_MASK; k <= SNDRV_PCM_HW_PARAM_LAST_MASK; k++) {
 		m = hw_param_mask(params, k);
 		if (snd_mask_empty(m))
@@ -332,6 +430,35 @@ int snd_pcm_hw_refine(struct snd_pcm_substream *substream,
 	return 0;
 }
 
+int snd_pcm_hw_refine(struct snd_pcm_substream *substream, 
+		      struct snd_pcm_hw_params *params)
+{
+	struct snd_pcm_hw_refine_cache *cache = substream->runtime->hw_refine_cache;
+	struct snd_pcm_hw_params *in;
+	int err;
+
+	params->info = 0;
+	params->fifo_size = 0;
+	if (params->rmask & (1 << SNDRV_PCM_HW_PARAM_SAMPLE_BITS))
+		params->msbits = 0;
+	if (params->rmask & (1 << SNDRV_PCM_HW_PARAM_RATE)) {
+		params->rate_num = 0;
+		params->rate_den = 0;
+	}
+
+	if (!cache)
+		return snd_pcm_hw_refine_rules(substream, params);
+	if (hw_refine_cache_lookup(cache, params, &err))
+		return err;
+	in = kmemdup(params, sizeof(*params), GFP_KERNEL);
+	err = snd_pcm_hw_refine_rules(substream, params);
+	if (in) {
+		hw_refine_cache_store(cache, in, params, err);
+		kfree(in);
+	}
+	return err;
+}
+
 EXPORT_SYMBOL(snd_pcm_hw_refine);
 
 static int snd_pcm_hw_refine_user(struct snd_pcm_substream *substream,
@@ -434,6 +561,9 @@ static int snd_pcm_hw_params(struct snd_pcm_substream *substream,
 	runtime->no_period_wakeup =
 			(params->info & SNDRV_PCM_INFO_NO_PERIOD_WAKEUP) &&
 			(params->flags & SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP);
+	runtime->timer_wakeup = runtime->no_period_wakeup &&
+			!(params->info & SNDRV_PCM_INFO_BATCH) &&
+			(params->flags & SNDRV_PCM_HW_PARAMS_TIMER_WAKEUP);
 
 	bits = snd_pcm_format_physical_width(runtime->format);
 	runtime->sample_bits = bits;
@@ -518,6 +648,8 @@ static int snd_pcm_hw_free(struct snd_pcm_substream *substream)
 	snd_pcm_stream_unlock_irq(substream);
 	if (atomic_read(&substream->mmap_count))
 		return -EBADFD;
+	hrtimer_cancel(&substream->wakeup_timer);
+	hrtimer_cancel(&substream->start_at_timer);
 	if (substream->ops->hw_free)
 		result = substream->ops->hw_free(substream);
 	snd_pcm_set_state(substream, SNDRV_PCM_STATE_OPEN);
@@ -598,6 +730,7 @@ int snd_pcm_status(struct snd_pcm_substream *substream,
 	if (status->state == SNDRV_PCM_STATE_OPEN)
 		goto _end;
 	status->trigger_tstamp = runtime->trigger_tstamp;
+	status->driver_trigger_tstamp = runtime->driver_trigger_tstamp;
 	if (snd_pcm_running(substream)) {
 		snd_pcm_update_hw_ptr(substream);
 		if (runtime->tstamp_mode == SNDRV_PCM_TSTAMP_ENABLE) {
@@ -701,6 +834,20 @@ static void snd_pcm_trigger_tstamp(struct snd_pcm_substream *substream)
 	runtime->trigger_master = NULL;
 }
 
+/*
+ * hardware-synced substreams inherit the time at which the driver of
+ * their trigger master was called
+ */
+static void snd_pcm_driver_trigger_tstamp(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_substream *master = runtime->trigger_master;
+
+	if (master && master != substream)
+		runtime->driver_trigger_tstamp =
+			master->runtime->driver_trigger_tstamp;
+}
+
 struct action_ops {
 	int (*pre_action)(struct snd_pcm_substream *substream, int state);
 	int (*do_action)(struct snd_pcm_substream *substream, int state);
@@ -861,9 +1008,15 @@ static int snd_pcm_pre_start(struct snd_pcm_substream *substream, int state)
 
 static int snd_pcm_do_start(struct snd_pcm_substream *substream, int state)
 {
-	if (substream->runtime->trigger_master != substream)
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int err;
+
+	if (runtime->trigger_master != substream)
 		return 0;
-	return substream->ops->trigger(substream, SNDRV_PCM_TRIGGER_START);
+	err = substream->ops->trigger(substream, SNDRV_PCM_TRIGGER_START);
+	if (!err)
+		snd_pcm_gettime(runtime, &runtime->driver_trigger_tstamp);
+	return err;
 }
 
 static void snd_pcm_undo_start(struct snd_pcm_substream *substream, int state)
@@ -875,6 +1028,8 @@ static void snd_pcm_undo_start(struct snd_pcm_substream *substream, int state)
 static void snd_pcm_post_start(struct snd_pcm_substream *substream, int state)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
+	hrtimer_try_to_cancel(&substream->start_at_timer);
+	snd_pcm_driver_trigger_tstamp(substream);
 	snd_pcm_trigger_tstamp(substream);
 	runtime->hw_ptr_jiffies = jiffies;
 	runtime->hw_ptr_buffer_jiffies = (runtime->buffer_size * HZ) / 
@@ -907,6 +1062,106 @@ int snd_pcm_start(struct snd_pcm_substream *substream)
 			      SNDRV_PCM_STATE_RUNNING);
 }
 
+/*
+ * start_at callbacks
+ *
+ * When all linked substreams have SNDRV_PCM_INFO_START_AT, the drivers
+ * are asked to start the DMA by themselves at runtime->start_at_tstamp
+ * and the streams enter RUNNING right away.  Otherwise the start is
+ * emulated by start_at_timer, which calls snd_pcm_start() at the deadline.
+ */
+static int snd_pcm_do_start_at(struct snd_pcm_substream *substream, int state)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int err;
+
+	if (runtime->trigger_master != substream)
+		return 0;
+	err = substream->ops->trigger(substream, SNDRV_PCM_TRIGGER_START_AT);
+	if (!err)
+		runtime->driver_trigger_tstamp = runtime->start_at_tstamp;
+	return err;
+}
+
+static struct action_ops snd_pcm_action_start_at = {
+	.pre_action = snd_pcm_pre_start,
+	.do_action = snd_pcm_do_start_at,
+	.undo_action = snd_pcm_undo_start,
+	.post_action = snd_pcm_post_start
+};
+
+static enum hrtimer_restart snd_pcm_start_at_timer_func(struct hrtimer *timer)
+{
+	struct snd_pcm_substream *substream =
+		container_of(timer, struct snd_pcm_substream, start_at_timer);
+	unsigned long flags;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	if (substream->runtime &&
+	    substream->runtime->status->state == SNDRV_PCM_STATE_PREPARED)
+		snd_pcm_start(substream);
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+	return HRTIMER_NORESTART;
+}
+
+void snd_pcm_start_at_timer_init(struct snd_pcm_substream *substream)
+{
+	hrtimer_init(&substream->start_at_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_ABS);
+	substream->start_at_timer.function = snd_pcm_start_at_timer_func;
+}
+
+/*
+ * start all linked streams at the given time of the stream's timestamp
+ * clock (SNDRV_PCM_TSTAMP_TYPE_*)
+ */
+static int snd_pcm_start_at(struct snd_pcm_substream *substream,
+			    const struct timespec *ts)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_substream *s;
+	ktime_t expires;
+	int hw_start_at = 1;
+	int res = 0;
+
+	if (!timespec_valid(ts))
+		return -EINVAL;
+	expires = timespec_to_ktime(*ts);
+	if (runtime->tstamp_type != SNDRV_PCM_TSTAMP_TYPE_MONOTONIC)
+		expires = ktime_add(ktime_sub(expires, ktime_get_real()),
+				    ktime_get());
+
+	snd_pcm_stream_lock_irq(substream);
+	if (runtime->status->state != SNDRV_PCM_STATE_PREPARED) {
+		res = -EBADFD;
+		goto _unlock;
+	}
+	snd_pcm_group_for_each_entry(s, substream) {
+		s->runtime->start_at_tstamp = *ts;
+		if (!(s->runtime->hw.info & SNDRV_PCM_INFO_START_AT))
+			hw_start_at = 0;
+	}
+	if (hw_start_at)
+		res = snd_pcm_action(&snd_pcm_action_start_at, substream,
+				     SNDRV_PCM_STATE_RUNNING);
+	else
+		hrtimer_start(&substream->start_at_timer, expires,
+			      HRTIMER_MODE_ABS);
+ _unlock:
+	snd_pcm_stream_unlock_irq(substream);
+	return res;
+}
+
+static int snd_pcm_start_at_user(struct snd_pcm_substream *substream,
+				 struct timespec __user *_ts)
+{
+	struct timespec ts;
+
+	if (copy_from_user(&ts, _ts, sizeof(ts)))
+		return -EFAULT;
+	return snd_pcm_start_at(substream, &ts);
+}
+
 /*
  * stop callbacks
  */
@@ -922,8 +1177,11 @@ static int snd_pcm_pre_stop(struct snd_pcm_substream *substream, int state)
 static int snd_pcm_do_stop(struct snd_pcm_substream *substream, int state)
 {
 	if (substream->runtime->trigger_master == substream &&
-	    snd_pcm_running(substream))
+	    snd_pcm_running(substream)) {
 		substream->ops->trigger(substream, SNDRV_PCM_TRIGGER_STOP);
+		snd_pcm_gettime(substream->runtime,
+				&substream->runtime->driver_trigger_tstamp);
+	}
 	return 0; /* unconditonally stop all substreams */
 }
 
@@ -931,12 +1189,17 @@ static void snd_pcm_post_stop(struct snd_pcm_substream *substream, int state)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	if (runtime->status->state != state) {
+		if (snd_pcm_running(substream))
+			snd_pcm_driver_trigger_tstamp(substream);
 		snd_pcm_trigger_tstamp(substream);
 		if (substream->timer)
 			snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MSTOP,
 					 &runtime->trigger_tstamp);
 		runtime->status->state = state;
 	}
+	if (runtime->timer_wakeup)
+		hrtimer_try_to_cancel(&substream->wakeup_timer);
+	hrtimer_try_to_cancel(&substream->start_at_timer);
 	wake_up(&runtime->sleep);
 	wake_up(&runtime->tsleep);
 }
@@ -1515,6 +1778,13 @@ static int snd_pcm_drain(struct snd_pcm_substream *substream,
 			break; /* all drained */
 		init_waitqueue_entry(&wait, current);
 		add_wait_queue(&to_check->sleep, &wait);
+		/* the timer of a linked stream is armed under its own lock */
+		if (s != substream)
+			spin_lock_nested(&s->self_group.lock,
+					 SINGLE_DEPTH_NESTING);
+		snd_pcm_wakeup_timer_arm(s);
+		if (s != substream)
+			spin_unlock(&s->self_group.lock);
 		snd_pcm_stream_unlock_irq(substream);
 		up_read(&snd_pcm_link_rwsem);
 		snd_power_unlock(card);
@@ -2574,6 +2844,8 @@ static int snd_pcm_common_ioctl1(struct file *file,
 		return snd_pcm_reset(substream);
 	case SNDRV_PCM_IOCTL_START:
 		return snd_pcm_action_lock_irq(&snd_pcm_action_start, substream, SNDRV_PCM_STATE_RUNNING);
+	case SNDRV_PCM_IOCTL_START_AT:
+		return snd_pcm_start_at_user(substream, arg);
 	case SNDRV_PCM_IOCTL_LINK:
 		return snd_pcm_link(substream, (int)(unsigned long) arg);
 	case SNDRV_PCM_IOCTL_UNLINK:
@@ -2611,6 +2883,35 @@ static int snd_pcm_common_ioctl1(struct file *file,
 	return -ENOTTY;
 }
 
+static int snd_pcm_xferiv_user(struct snd_pcm_substream *substream,
+				struct snd_xferiv __user *_xferiv)
+{
+	struct snd_xferiv xferiv;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_xferi_seg *segs;
+	snd_pcm_sframes_t result;
+
+	if (runtime->status->state == SNDRV_PCM_STATE_OPEN)
+		return -EBADFD;
+	if (put_user(0, &_xferiv->result))
+		return -EFAULT;
+	if (copy_from_user(&xferiv, _xferiv, sizeof(xferiv)))
+		return -EFAULT;
+	if (!xferiv.nsegs || xferiv.nsegs > SNDRV_PCM_XFERIV_SEGS_MAX)
+		return -EINVAL;
+
+	segs = memdup_user(xferiv.segs, sizeof(*segs) * xferiv.nsegs);
+	if (IS_ERR(segs))
+		return PTR_ERR(segs);
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		result = snd_pcm_lib_writeiv(substream, segs, xferiv.nsegs);
+	else
+		result = snd_pcm_lib_readiv(substream, segs, xferiv.nsegs);
+	kfree(segs);
+	__put_user(result, &_xferiv->result);
+	return result < 0 ? result : 0;
+}
+
 static int snd_pcm_playback_ioctl1(struct file *file,
 				   struct snd_pcm_substream *substream,
 				   unsigned int cmd, void __user *arg)
@@ -2661,6 +2962,8 @@ static int snd_pcm_playback_ioctl1(struct file *file,
 		__put_user(result, &_xfern->result);
 		return result < 0 ? result : 0;
 	}
+	case SNDRV_PCM_IOCTL_WRITEIV_FRAMES:
+		return snd_pcm_xferiv_user(substream, arg);
 	case SNDRV_PCM_IOCTL_REWIND:
 	{
 		snd_pcm_uframes_t frames;
@@ -2741,6 +3044,8 @@ static int snd_pcm_capture_ioctl1(struct file *file,
 		__put_user(result, &_xfern->result);
 		return result < 0 ? result : 0;
 	}
+	case SNDRV_PCM_IOCTL_READIV_FRAMES:
+		return snd_pcm_xferiv_user(substream, arg);
 	case SNDRV_PCM_IOCTL_REWIND:
 	{
 		snd_pcm_uframes_t frames;
@@ -2973,6 +3278,7 @@ static unsigned int snd_pcm_playback_poll(struct file *file, poll_table * wait)
 		/* Fall through */
 	case SNDRV_PCM_STATE_DRAINING:
 		mask = 0;
+		snd_pcm_wakeup_timer_arm(substream);
 		break;
 	default:
 		mask = POLLOUT | POLLWRNORM | POLLERR;
@@ -3010,6 +3316,7 @@ static unsigned int snd_pcm_capture_poll(struct file *file, poll_table * wait)
 			break;
 		}
 		mask = 0;
+		snd_pcm_wakeup_timer_arm(substream);
 		break;
 	case SNDRV_PCM_STATE_DRAINING:
 		if (avail > 0) {
@@ -3192,6 +3499,43 @@ static const struct vm_operations_struct snd_pcm_vm_ops_data_fault = {
 #endif
 #endif
 
+#ifdef CONFIG_SND_DMA_SGBUF
+/*
+ * map all physically contiguous chunks of a SG-buffer at once instead of
+ * faulting in each page
+ */
+static int snd_pcm_mmap_sgbuf(struct snd_pcm_substream *substream,
+			      struct vm_area_struct *area)
+{
+	unsigned long offset = area->vm_pgoff << PAGE_SHIFT;
+	unsigned long start = area->vm_start;
+	unsigned long pfn, size;
+	struct page *page;
+	int err;
+
+	while (start < area->vm_end) {
+		page = snd_pcm_sgbuf_ops_page(substream, offset);
+		if (!page)
+			return -EINVAL;
+		pfn = page_to_pfn(page);
+		for (size = PAGE_SIZE; start + size < area->vm_end;
+		     size += PAGE_SIZE) {
+			page = snd_pcm_sgbuf_ops_page(substream, offset + size);
+			if (!page ||
+			    page_to_pfn(page) != pfn + (size >> PAGE_SHIFT))
+				break;
+		}
+		err = remap_pfn_range(area, start, pfn, size,
+				      area->vm_page_prot);
+		if (err < 0)
+			return err;
+		start += size;
+		offset += size;
+	}
+	return 0;
+}
+#endif
+
 /*
  * mmap the DMA buffer on RAM
  */
@@ -3212,6 +3556,12 @@ int snd_pcm_lib_default_mmap(struct snd_pcm_substream *substream,
 	    !plat_device_is_coherent(substream->dma_buffer.dev.dev))
 		area->vm_page_prot = pgprot_noncached(area->vm_page_prot);
 #endif /* ARCH_HAS_DMA_MMAP_COHERENT */
+#ifdef CONFIG_SND_DMA_SGBUF
+	/* private mappings can't be remapped partially */
+	if (substream->ops->page == snd_pcm_sgbuf_ops_page &&
+	    (area->vm_flags & VM_SHARED))
+		return snd_pcm_mmap_sgbuf(substream, area);
+#endif
 	/* mmap with fault handler */
 	area->vm_ops = &snd_pcm_vm_ops_data_fault;
 	return 0;
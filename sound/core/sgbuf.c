@@ -23,6 +23,7 @@
 #include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/export.h>
+#include <linux/moduleparam.h>
 #include <sound/memalloc.h>
 
 
@@ -63,6 +64,12 @@ int snd_free_sgbuf_pages(struct snd_dma_buffer *dmab)
 }
 
 #define MAX_ALLOC_PAGES		32
+/* 2MB, the size of a huge page on x86 */
+#define MAX_LARGE_ALLOC_PAGES	((2 * 1024 * 1024) >> PAGE_SHIFT)
+
+static bool sgbuf_large_chunks;
+module_param(sgbuf_large_chunks, bool, 0644);
+MODULE_PARM_DESC(sgbuf_large_chunks, "Allocate SG-buffers in contiguous chunks of up to 2MB.");
 
 void *snd_malloc_sgbuf_pages(struct device *device,
 			     size_t size, struct snd_dma_buffer *dmab,
@@ -91,8 +98,11 @@ void *snd_malloc_sgbuf_pages(struct device *device,
 		goto _failed;
 	sgbuf->page_table = pgtable;
 
-	/* allocate pages */
-	maxpages = MAX_ALLOC_PAGES;
+	/* allocate pages; with sgbuf_large_chunks, try the largest chunks
+	 * first and go down to what is available, which reduces the TLB
+	 * pressure of big multi-channel buffers
+	 */
+	maxpages = sgbuf_large_chunks ? MAX_LARGE_ALLOC_PAGES : MAX_ALLOC_PAGES;
 	while (pages > 0) {
 		chunk = pages;
 		/* don't be too eager to take a huge chunk */
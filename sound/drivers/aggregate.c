@@ -0,0 +1,1099 @@
+/*
+ *  Aggregate soundcard
+ *
+ *  Presents the PCM devices of several (usually identical) cards as one
+ *  wide PCM device.  The channels of each frame are split over the member
+ *  substreams in the order given by the members module option, e.g.
+ *
+ *    members=1:0:2,2:0:2,3:0:2
+ *
+ *  gives a 6 channel device whose channels 0-1 go to hw:1,0, 2-3 to hw:2,0
+ *  and 4-5 to hw:3,0 (card:device:channels).  Playback and capture of the
+ *  aggregate device open the playback and capture substreams of the
+ *  members.
+ *
+ *  The members are opened in the kernel and fed from a work item, like
+ *  the cables of snd-aloop but without a timer of our own: the position
+ *  of the aggregate device advances as the data is moved to or from the
+ *  members, so it follows the clocks of the member hardware.  The drift
+ *  of each member against the first one is measured from the hardware
+ *  pointers and compensated by slipping single frames.
+ *
+ *  Unlike the shared buffer mode of snd-aloop, the data is copied: each
+ *  member period is gathered into a bounce buffer and passed to the
+ *  member via snd_pcm_lib_write/read().  A member buffer can't be a view
+ *  of ours since it holds only its own channels in its own layout, the
+ *  frame slipping needs a frame more or less per member, and going
+ *  through the PCM core keeps the pointers and xrun handling of the
+ *  member driver intact.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/uaccess.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include <sound/pcm_params.h>
+#include <sound/info.h>
+#include <sound/initval.h>
+
+MODULE_DESCRIPTION("Aggregate soundcard");
+MODULE_LICENSE("GPL");
+MODULE_SUPPORTED_DEVICE("{{ALSA,Aggregate soundcard}}");
+
+#define MAX_MEMBERS		8
+#define DEFAULT_CHANNELS	2
+
+static int index[SNDRV_CARDS] = SNDRV_DEFAULT_IDX;	/* Index 0-MAX */
+static char *id[SNDRV_CARDS] = SNDRV_DEFAULT_STR;	/* ID for this card */
+static bool enable[SNDRV_CARDS] = {1, [1 ... (SNDRV_CARDS - 1)] = 0};
+static char *members[SNDRV_CARDS];
+static int max_drift[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 32};
+
+module_param_array(index, int, NULL, 0444);
+MODULE_PARM_DESC(index, "Index value for aggregate soundcard.");
+module_param_array(id, charp, NULL, 0444);
+MODULE_PARM_DESC(id, "ID string for aggregate soundcard.");
+module_param_array(enable, bool, NULL, 0444);
+MODULE_PARM_DESC(enable, "Enable this aggregate soundcard.");
+module_param_array(members, charp, NULL, 0444);
+MODULE_PARM_DESC(members, "Member PCMs as card:device[:channels],...");
+module_param_array(max_drift, int, NULL, 0444);
+MODULE_PARM_DESC(max_drift, "Drift in frames against the first member before a frame is slipped.");
+
+/* one card:device:channels entry of the members option */
+struct aggregate_member {
+	int card;
+	int device;
+	unsigned int channels;
+	unsigned int first;		/* first channel in the wide frame */
+};
+
+/* a member substream opened for one direction of the aggregate device */
+struct aggregate_link {
+	struct aggregate_member *member;
+	struct snd_pcm_substream *substream;
+	void *buf;			/* period + 1 frames of this member */
+	/* drift tracking, in member frames */
+	snd_pcm_uframes_t last_hw_ptr;
+	u64 frames;			/* frames moved by the member hardware */
+	long offset;			/* frames slipped so far */
+	long drift;			/* current drift against member 0 */
+	long drift_avg;			/* filtered drift, 8 bit fraction */
+	unsigned long slips;
+	unsigned long xruns;
+};
+
+struct aggregate;
+
+struct aggregate_pcm {
+	struct aggregate *agg;
+	struct snd_pcm_substream *substream;
+	struct aggregate_link links[MAX_MEMBERS];
+	unsigned int num_links;
+	spinlock_t lock;
+	struct delayed_work work;
+	unsigned long tick;		/* work interval in jiffies */
+	/* protected by lock */
+	unsigned int running: 1;
+	unsigned int start_pending: 1;
+	unsigned int drain: 1;		/* stopped at the end of a drain */
+	snd_pcm_uframes_t hw_ptr;	/* frames moved, in appl_ptr units */
+	snd_pcm_uframes_t buf_pos;	/* hw_ptr % buffer_size */
+	snd_pcm_uframes_t period_pos;
+	/* work only */
+	unsigned int members_running: 1;
+	unsigned int sample_bytes;
+	unsigned int frame_bytes;
+};
+
+struct aggregate {
+	struct snd_card *card;
+	struct snd_pcm *pcm;
+	struct aggregate_member members[MAX_MEMBERS];
+	unsigned int num_members;
+	unsigned int channels;
+	int max_drift;
+	struct mutex open_lock;
+	struct aggregate_pcm *streams[2];
+};
+
+static struct platform_device *devices[SNDRV_CARDS];
+
+/*
+ * Registered PCM devices which can be used as members; filled via
+ * snd_pcm_notify() and protected by sources_lock.  An entry goes away
+ * when its card is disconnected, while opened members keep a reference
+ * on the card until they are closed.
+ */
+struct aggregate_source {
+	struct list_head list;
+	struct snd_pcm *pcm;
+};
+
+static LIST_HEAD(sources);
+static DEFINE_MUTEX(sources_lock);
+
+static int aggregate_source_register(struct snd_pcm *pcm)
+{
+	struct aggregate_source *src;
+
+	if (!strcmp(pcm->card->driver, "Aggregate"))
+		return 0;
+	src = kzalloc(sizeof(*src), GFP_KERNEL);
+	if (!src)
+		return -ENOMEM;
+	src->pcm = pcm;
+	mutex_lock(&sources_lock);
+	list_add_tail(&src->list, &sources);
+	mutex_unlock(&sources_lock);
+	return 0;
+}
+
+static int aggregate_source_unregister(struct snd_pcm *pcm)
+{
+	struct aggregate_source *src;
+
+	mutex_lock(&sources_lock);
+	list_for_each_entry(src, &sources, list) {
+		if (src->pcm == pcm) {
+			list_del(&src->list);
+			kfree(src);
+			break;
+		}
+	}
+	mutex_unlock(&sources_lock);
+	return 0;
+}
+
+static struct snd_pcm_notify aggregate_notify = {
+	.n_register =	aggregate_source_register,
+	.n_disconnect =	aggregate_source_unregister,
+	.n_unregister =	aggregate_source_unregister,
+};
+
+/*
+ * Find a member PCM and take a reference on its card and on the module
+ * of its driver; the card can't be freed nor the driver unloaded before
+ * aggregate_source_put() then.
+ */
+static struct snd_pcm *aggregate_source_get(int card, int device)
+{
+	struct aggregate_source *src;
+	struct snd_pcm *pcm = NULL;
+
+	mutex_lock(&sources_lock);
+	list_for_each_entry(src, &sources, list) {
+		if (src->pcm->card->number != card ||
+		    src->pcm->device != device)
+			continue;
+		spin_lock(&src->pcm->card->files_lock);
+		if (!src->pcm->card->shutdown &&
+		    try_module_get(src->pcm->card->module)) {
+			atomic_inc(&src->pcm->card->refcount);
+			pcm = src->pcm;
+		}
+		spin_unlock(&src->pcm->card->files_lock);
+		break;
+	}
+	mutex_unlock(&sources_lock);
+	return pcm;
+}
+
+static void aggregate_source_put(struct snd_pcm *pcm)
+{
+	/* the card may be gone after snd_card_unref() */
+	module_put(pcm->card->module);
+	snd_card_unref(pcm->card);
+}
+
+/*
+ * member substreams
+ */
+
+static int aggregate_link_open(struct aggregate_pcm *apcm,
+			       struct aggregate_link *link, int stream)
+{
+	struct aggregate_member *m = link->member;
+	struct snd_pcm *pcm;
+	int err;
+
+	pcm = aggregate_source_get(m->card, m->device);
+	if (!pcm)
+		return -ENODEV;
+	/* called in open_mutex of our own PCM */
+	mutex_lock_nested(&pcm->open_mutex, SINGLE_DEPTH_NESTING);
+	err = snd_pcm_open_substream(pcm, stream, NULL, &link->substream);
+	mutex_unlock(&pcm->open_mutex);
+	if (err < 0) {
+		aggregate_source_put(pcm);
+		return err;
+	}
+	link->substream->f_flags = O_NONBLOCK;
+	return 0;
+}
+
+static void aggregate_link_close(struct aggregate_link *link)
+{
+	struct snd_pcm *pcm;
+
+	if (!link->substream)
+		return;
+	pcm = link->substream->pcm;
+	mutex_lock_nested(&pcm->open_mutex, SINGLE_DEPTH_NESTING);
+	snd_pcm_release_substream(link->substream);
+	mutex_unlock(&pcm->open_mutex);
+	aggregate_source_put(pcm);
+	link->substream = NULL;
+}
+
+static int aggregate_link_hw_params(struct aggregate_link *link,
+				    struct snd_pcm_hw_params *params)
+{
+	struct snd_pcm_substream *substream = link->substream;
+	struct snd_pcm_hw_params *hw;
+	struct snd_pcm_sw_params *sw;
+	struct snd_pcm_runtime *runtime;
+	int err;
+
+	hw = kmalloc(sizeof(*hw), GFP_KERNEL);
+	sw = kzalloc(sizeof(*sw), GFP_KERNEL);
+	if (!hw || !sw) {
+		err = -ENOMEM;
+		goto out;
+	}
+	_snd_pcm_hw_params_any(hw);
+	snd_mask_none(hw_param_mask(hw, SNDRV_PCM_HW_PARAM_ACCESS));
+	snd_mask_set(hw_param_mask(hw, SNDRV_PCM_HW_PARAM_ACCESS),
+		     SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	snd_mask_none(hw_param_mask(hw, SNDRV_PCM_HW_PARAM_FORMAT));
+	snd_mask_set(hw_param_mask(hw, SNDRV_PCM_HW_PARAM_FORMAT),
+		     params_format(params));
+	snd_interval_copy(hw_param_interval(hw, SNDRV_PCM_HW_PARAM_RATE),
+			  hw_param_interval_c(params, SNDRV_PCM_HW_PARAM_RATE));
+	snd_interval_copy(hw_param_interval(hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE),
+			  hw_param_interval_c(params,
+					      SNDRV_PCM_HW_PARAM_PERIOD_SIZE));
+	snd_interval_copy(hw_param_interval(hw, SNDRV_PCM_HW_PARAM_BUFFER_SIZE),
+			  hw_param_interval_c(params,
+					      SNDRV_PCM_HW_PARAM_BUFFER_SIZE));
+	hw_param_interval(hw, SNDRV_PCM_HW_PARAM_CHANNELS)->min =
+		link->member->channels;
+	hw_param_interval(hw, SNDRV_PCM_HW_PARAM_CHANNELS)->max =
+		link->member->channels;
+	err = snd_pcm_kernel_ioctl(substream, SNDRV_PCM_IOCTL_HW_PARAMS, hw);
+	if (err < 0)
+		goto out;
+
+	/* the work item starts and stops the member explicitly */
+	runtime = substream->runtime;
+	sw->tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sw->period_step = 1;
+	sw->avail_min = 1;
+	sw->start_threshold = runtime->boundary;
+	sw->stop_threshold = runtime->buffer_size;
+	err = snd_pcm_kernel_ioctl(substream, SNDRV_PCM_IOCTL_SW_PARAMS, sw);
+	if (err < 0)
+		goto out;
+
+	vfree(link->buf);
+	link->buf = vmalloc(frames_to_bytes(runtime, runtime->period_size + 1));
+	if (!link->buf)
+		err = -ENOMEM;
+ out:
+	kfree(hw);
+	kfree(sw);
+	return err;
+}
+
+/* update the drift of a member from its hardware pointer; in work */
+static void aggregate_link_sync(struct aggregate_link *link)
+{
+	struct snd_pcm_substream *substream = link->substream;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_sframes_t delta;
+
+	snd_pcm_kernel_ioctl(substream, SNDRV_PCM_IOCTL_HWSYNC, NULL);
+	snd_pcm_stream_lock_irq(substream);
+	delta = runtime->status->hw_ptr - link->last_hw_ptr;
+	if (delta < 0)
+		delta += runtime->boundary;
+	link->last_hw_ptr = runtime->status->hw_ptr;
+	snd_pcm_stream_unlock_irq(substream);
+	link->frames += delta;
+}
+
+static snd_pcm_uframes_t aggregate_link_avail(struct aggregate_link *link)
+{
+	struct snd_pcm_substream *substream = link->substream;
+	snd_pcm_uframes_t avail;
+
+	snd_pcm_stream_lock_irq(substream);
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		avail = snd_pcm_playback_avail(substream->runtime);
+	else
+		avail = snd_pcm_capture_avail(substream->runtime);
+	snd_pcm_stream_unlock_irq(substream);
+	return avail;
+}
+
+static int aggregate_link_transfer(struct aggregate_link *link,
+				   snd_pcm_uframes_t frames)
+{
+	struct snd_pcm_substream *substream = link->substream;
+	snd_pcm_sframes_t res;
+	mm_segment_t fs;
+
+	fs = get_fs();
+	set_fs(get_ds());
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		res = snd_pcm_lib_write(substream,
+					(void __force __user *)link->buf,
+					frames);
+	else
+		res = snd_pcm_lib_read(substream,
+				       (void __force __user *)link->buf,
+				       frames);
+	set_fs(fs);
+	if (res < 0)
+		return res;
+	return res == frames ? 0 : -EPIPE;
+}
+
+/*
+ * data transfer
+ */
+
+/*
+ * Decide whether a member slips a frame in this round: +1 moves one
+ * frame more to/from the member than to/from the others, -1 one frame
+ * less.  Either way its content moves by one frame against member 0.
+ */
+static int aggregate_slip(struct aggregate_pcm *apcm,
+			  struct aggregate_link *link)
+{
+	long limit = (long)apcm->agg->max_drift << 8;
+
+	if (link == apcm->links || !apcm->agg->max_drift)
+		return 0;
+	link->drift = (long)(link->frames - apcm->links[0].frames) -
+		link->offset;
+	link->drift_avg += ((link->drift << 8) - link->drift_avg) / 16;
+	if (link->drift_avg > limit)
+		return 1;
+	if (link->drift_avg < -limit)
+		return -1;
+	return 0;
+}
+
+static void aggregate_copy_out(struct aggregate_pcm *apcm,
+			       struct aggregate_link *link,
+			       const char *src, snd_pcm_uframes_t frames,
+			       int slip)
+{
+	unsigned int bytes = link->member->channels * apcm->sample_bytes;
+	char *dst = link->buf;
+	snd_pcm_uframes_t i;
+
+	src += link->member->first * apcm->sample_bytes;
+	if (slip < 0) {
+		/* drop the first frame */
+		src += apcm->frame_bytes;
+		frames--;
+	}
+	for (i = 0; i < frames; i++) {
+		memcpy(dst, src, bytes);
+		dst += bytes;
+		src += apcm->frame_bytes;
+	}
+	if (slip > 0)	/* repeat the last frame */
+		memcpy(dst, dst - bytes, bytes);
+}
+
+static void aggregate_copy_in(struct aggregate_pcm *apcm,
+			      struct aggregate_link *link,
+			      char *dst, snd_pcm_uframes_t frames,
+			      int slip)
+{
+	unsigned int bytes = link->member->channels * apcm->sample_bytes;
+	const char *src = link->buf;
+	snd_pcm_uframes_t i;
+
+	dst += link->member->first * apcm->sample_bytes;
+	if (slip > 0)	/* drop the first frame */
+		src += bytes;
+	for (i = 0; i < frames; i++) {
+		if (slip < 0 && i == frames - 1)
+			src -= bytes;	/* repeat the previous frame */
+		memcpy(dst, src, bytes);
+		src += bytes;
+		dst += apcm->frame_bytes;
+	}
+}
+
+/*
+ * Move as many frames as the aggregate buffer and all members allow,
+ * in chunks of up to a period; returns a negative error on xrun.
+ */
+static int aggregate_forward(struct aggregate_pcm *apcm)
+{
+	struct snd_pcm_substream *substream = apcm->substream;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int playback = substream->stream == SNDRV_PCM_STREAM_PLAYBACK;
+	snd_pcm_uframes_t avail, frames, chunk, pos;
+	snd_pcm_sframes_t queued;
+	int slip[MAX_MEMBERS];
+	int elapsed = 0;
+	unsigned int i;
+	int err;
+
+	/* frames written by the application resp. not yet read by it */
+	snd_pcm_stream_lock_irq(substream);
+	if (playback)
+		queued = runtime->control->appl_ptr - apcm->hw_ptr;
+	else
+		queued = apcm->hw_ptr - runtime->control->appl_ptr;
+	snd_pcm_stream_unlock_irq(substream);
+	if (queued < 0)
+		queued += runtime->boundary;
+	frames = playback ? queued : runtime->buffer_size - queued;
+	for (i = 0; i < apcm->num_links; i++) {
+		/* one spare frame for slipping */
+		avail = aggregate_link_avail(&apcm->links[i]);
+		avail = avail ? avail - 1 : 0;
+		if (avail < frames)
+			frames = avail;
+	}
+
+	while (frames > 0) {
+		pos = apcm->buf_pos;
+		chunk = min3(frames, runtime->period_size,
+			     runtime->buffer_size - pos);
+		for (i = 0; i < apcm->num_links; i++) {
+			struct aggregate_link *link = &apcm->links[i];
+
+			slip[i] = chunk > 1 ? aggregate_slip(apcm, link) : 0;
+			if (playback)
+				aggregate_copy_out(apcm, link,
+					runtime->dma_area +
+					frames_to_bytes(runtime, pos),
+					chunk, slip[i]);
+			err = aggregate_link_transfer(link, chunk + slip[i]);
+			if (err < 0) {
+				link->xruns++;
+				return err;
+			}
+			if (!playback)
+				aggregate_copy_in(apcm, link,
+					runtime->dma_area +
+					frames_to_bytes(runtime, pos),
+					chunk, slip[i]);
+			if (slip[i]) {
+				link->offset += slip[i];
+				link->drift_avg -= (long)slip[i] << 8;
+				link->slips++;
+			}
+		}
+		frames -= chunk;
+
+		spin_lock_irq(&apcm->lock);
+		apcm->hw_ptr += chunk;
+		if (apcm->hw_ptr >= runtime->boundary)
+			apcm->hw_ptr -= runtime->boundary;
+		apcm->buf_pos = (pos + chunk) % runtime->buffer_size;
+		apcm->period_pos += chunk;
+		if (apcm->period_pos >= runtime->period_size) {
+			apcm->period_pos %= runtime->period_size;
+			elapsed = 1;
+		}
+		spin_unlock_irq(&apcm->lock);
+	}
+
+	/* report the data queued in the members as delay */
+	avail = aggregate_link_avail(&apcm->links[0]);
+	if (playback)
+		runtime->delay = apcm->links[0].substream->runtime->buffer_size -
+			avail;
+	else
+		runtime->delay = avail;
+	if (elapsed)
+		snd_pcm_period_elapsed(substream);
+	return 0;
+}
+
+static int aggregate_members_start(struct aggregate_pcm *apcm)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < apcm->num_links; i++) {
+		struct aggregate_link *link = &apcm->links[i];
+
+		err = snd_pcm_kernel_ioctl(link->substream,
+					   SNDRV_PCM_IOCTL_START, NULL);
+		if (err < 0)
+			return err;
+		link->last_hw_ptr = link->substream->runtime->status->hw_ptr;
+		link->frames = 0;
+		link->offset = 0;
+		link->drift = 0;
+		link->drift_avg = 0;
+	}
+	apcm->members_running = 1;
+	return 0;
+}
+
+static void aggregate_members_stop(struct aggregate_pcm *apcm, int drain)
+{
+	unsigned int i;
+
+	/* non-blocking drain: the members stop when they run empty */
+	for (i = 0; i < apcm->num_links; i++)
+		snd_pcm_kernel_ioctl(apcm->links[i].substream,
+				     drain ? SNDRV_PCM_IOCTL_DRAIN :
+					     SNDRV_PCM_IOCTL_DROP, NULL);
+	apcm->members_running = 0;
+}
+
+static void aggregate_work(struct work_struct *work)
+{
+	struct aggregate_pcm *apcm =
+		container_of(work, struct aggregate_pcm, work.work);
+	struct snd_pcm_substream *substream = apcm->substream;
+	unsigned int running, start, drain, i;
+	int err;
+
+	spin_lock_irq(&apcm->lock);
+	running = apcm->running;
+	start = apcm->start_pending;
+	drain = apcm->drain;
+	apcm->start_pending = 0;
+	spin_unlock_irq(&apcm->lock);
+
+	if (!running) {
+		if (apcm->members_running)
+			aggregate_members_stop(apcm, drain);
+		return;
+	}
+
+	if (start) {
+		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+			/* prefill the members before they start */
+			err = aggregate_forward(apcm);
+			if (err < 0)
+				goto xrun;
+		}
+		err = aggregate_members_start(apcm);
+		if (err < 0)
+			goto xrun;
+	} else {
+		for (i = 0; i < apcm->num_links; i++)
+			aggregate_link_sync(&apcm->links[i]);
+		err = aggregate_forward(apcm);
+		if (err < 0)
+			goto xrun;
+	}
+	schedule_delayed_work(&apcm->work, apcm->tick);
+	return;
+
+ xrun:
+	snd_pcm_stream_lock_irq(substream);
+	if (snd_pcm_running(substream))
+		snd_pcm_stop(substream, SNDRV_PCM_STATE_XRUN);
+	snd_pcm_stream_unlock_irq(substream);
+	aggregate_members_stop(apcm, 0);
+}
+
+/*
+ * PCM interface
+ */
+
+static int aggregate_trigger(struct snd_pcm_substream *substream, int cmd)
+{
+	struct aggregate_pcm *apcm = substream->runtime->private_data;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+		spin_lock(&apcm->lock);
+		apcm->running = 1;
+		apcm->start_pending = 1;
+		apcm->drain = 0;
+		spin_unlock(&apcm->lock);
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		spin_lock(&apcm->lock);
+		apcm->running = 0;
+		apcm->drain = substream->runtime->status->state ==
+			SNDRV_PCM_STATE_DRAINING;
+		spin_unlock(&apcm->lock);
+		break;
+	default:
+		return -EINVAL;
+	}
+	/* the members are started and stopped from the work */
+	mod_delayed_work(system_wq, &apcm->work, 0);
+	return 0;
+}
+
+static snd_pcm_uframes_t aggregate_pointer(struct snd_pcm_substream *substream)
+{
+	struct aggregate_pcm *apcm = substream->runtime->private_data;
+	snd_pcm_uframes_t pos;
+
+	spin_lock(&apcm->lock);
+	pos = apcm->buf_pos;
+	spin_unlock(&apcm->lock);
+	return pos;
+}
+
+static int aggregate_prepare(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct aggregate_pcm *apcm = runtime->private_data;
+	unsigned int i;
+	int err;
+
+	cancel_delayed_work_sync(&apcm->work);
+	if (apcm->members_running)
+		aggregate_members_stop(apcm, 0);
+	for (i = 0; i < apcm->num_links; i++) {
+		err = snd_pcm_kernel_ioctl(apcm->links[i].substream,
+					   SNDRV_PCM_IOCTL_PREPARE, NULL);
+		if (err < 0)
+			return err;
+	}
+	apcm->sample_bytes = snd_pcm_format_physical_width(runtime->format) / 8;
+	apcm->frame_bytes = frames_to_bytes(runtime, 1);
+	apcm->hw_ptr = runtime->status->hw_ptr;
+	apcm->buf_pos = 0;
+	apcm->period_pos = 0;
+	runtime->delay = 0;
+	/* twice per period, the members buffer the rest */
+	apcm->tick = max_t(unsigned long, 1,
+			   msecs_to_jiffies(runtime->period_size * 500 /
+					    runtime->rate));
+	return 0;
+}
+
+static int aggregate_hw_params(struct snd_pcm_substream *substream,
+			       struct snd_pcm_hw_params *params)
+{
+	struct aggregate_pcm *apcm = substream->runtime->private_data;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < apcm->num_links; i++) {
+		err = aggregate_link_hw_params(&apcm->links[i], params);
+		if (err < 0)
+			return err;
+	}
+	return snd_pcm_lib_alloc_vmalloc_buffer(substream,
+						params_buffer_bytes(params));
+}
+
+static int aggregate_hw_free(struct snd_pcm_substream *substream)
+{
+	struct aggregate_pcm *apcm = substream->runtime->private_data;
+	unsigned int i;
+
+	cancel_delayed_work_sync(&apcm->work);
+	if (apcm->members_running)
+		aggregate_members_stop(apcm, 0);
+	for (i = 0; i < apcm->num_links; i++) {
+		snd_pcm_kernel_ioctl(apcm->links[i].substream,
+				     SNDRV_PCM_IOCTL_HW_FREE, NULL);
+		vfree(apcm->links[i].buf);
+		apcm->links[i].buf = NULL;
+	}
+	return snd_pcm_lib_free_vmalloc_buffer(substream);
+}
+
+static struct snd_pcm_hardware aggregate_pcm_hardware = {
+	.info =		(SNDRV_PCM_INFO_INTERLEAVED | SNDRV_PCM_INFO_MMAP |
+			 SNDRV_PCM_INFO_MMAP_VALID |
+			 SNDRV_PCM_INFO_BLOCK_TRANSFER),
+	.formats =	(SNDRV_PCM_FMTBIT_S16_LE | SNDRV_PCM_FMTBIT_S16_BE |
+			 SNDRV_PCM_FMTBIT_S24_3LE | SNDRV_PCM_FMTBIT_S24_3BE |
+			 SNDRV_PCM_FMTBIT_S24_LE | SNDRV_PCM_FMTBIT_S24_BE |
+			 SNDRV_PCM_FMTBIT_S32_LE | SNDRV_PCM_FMTBIT_S32_BE),
+	.rates =	SNDRV_PCM_RATE_CONTINUOUS | SNDRV_PCM_RATE_8000_192000,
+	.rate_min =		8000,
+	.rate_max =		192000,
+	.buffer_bytes_max =	4 * 1024 * 1024,
+	.period_bytes_min =	64,
+	.period_bytes_max =	1024 * 1024,
+	.periods_min =		2,
+	.periods_max =		1024,
+	.fifo_size =		0,
+};
+
+/* what all members of this direction can do */
+static void aggregate_restrict_hw(struct snd_pcm_hardware *hw,
+				  struct snd_pcm_substream *member)
+{
+	struct snd_pcm_hardware *mhw = &member->runtime->hw;
+
+	hw->formats &= mhw->formats;
+	if (!(mhw->rates & SNDRV_PCM_RATE_CONTINUOUS))
+		hw->rates &= mhw->rates;
+	hw->rate_min = max(hw->rate_min, mhw->rate_min);
+	hw->rate_max = min(hw->rate_max, mhw->rate_max);
+}
+
+static void aggregate_pcm_free(struct snd_pcm_runtime *runtime)
+{
+	kfree(runtime->private_data);
+}
+
+static int aggregate_open(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct aggregate *agg = substream->private_data;
+	struct aggregate_pcm *apcm;
+	unsigned int i;
+	int err;
+
+	apcm = kzalloc(sizeof(*apcm), GFP_KERNEL);
+	if (!apcm)
+		return -ENOMEM;
+	apcm->agg = agg;
+	apcm->substream = substream;
+	spin_lock_init(&apcm->lock);
+	INIT_DELAYED_WORK(&apcm->work, aggregate_work);
+	runtime->private_data = apcm;
+	runtime->private_free = aggregate_pcm_free;
+
+	runtime->hw = aggregate_pcm_hardware;
+	runtime->hw.channels_min = agg->channels;
+	runtime->hw.channels_max = agg->channels;
+	for (i = 0; i < agg->num_members; i++) {
+		struct aggregate_link *link = &apcm->links[i];
+
+		link->member = &agg->members[i];
+		err = aggregate_link_open(apcm, link, substream->stream);
+		if (err < 0) {
+			snd_printk(KERN_ERR "aggregate: cannot open member "
+				   "%d:%d (%d)\n", link->member->card,
+				   link->member->device, err);
+			goto error;
+		}
+		apcm->num_links++;
+		aggregate_restrict_hw(&runtime->hw, link->substream);
+	}
+	if (!runtime->hw.formats || runtime->hw.rate_min > runtime->hw.rate_max) {
+		err = -EINVAL;
+		goto error;
+	}
+
+	err = snd_pcm_hw_constraint_integer(runtime,
+					    SNDRV_PCM_HW_PARAM_PERIODS);
+	if (err < 0)
+		goto error;
+	mutex_lock(&agg->open_lock);
+	agg->streams[substream->stream] = apcm;
+	mutex_unlock(&agg->open_lock);
+	return 0;
+
+ error:
+	for (i = 0; i < apcm->num_links; i++)
+		aggregate_link_close(&apcm->links[i]);
+	apcm->num_links = 0;
+	return err;
+}
+
+static int aggregate_close(struct snd_pcm_substream *substream)
+{
+	struct aggregate *agg = substream->private_data;
+	struct aggregate_pcm *apcm = substream->runtime->private_data;
+	unsigned int i;
+
+	cancel_delayed_work_sync(&apcm->work);
+	mutex_lock(&agg->open_lock);
+	agg->streams[substream->stream] = NULL;
+	mutex_unlock(&agg->open_lock);
+	for (i = 0; i < apcm->num_links; i++) {
+		aggregate_link_close(&apcm->links[i]);
+		vfree(apcm->links[i].buf);
+		apcm->links[i].buf = NULL;
+	}
+	return 0;
+}
+
+static struct snd_pcm_ops aggregate_pcm_ops = {
+	.open =		aggregate_open,
+	.close =	aggregate_close,
+	.ioctl =	snd_pcm_lib_ioctl,
+	.hw_params =	aggregate_hw_params,
+	.hw_free =	aggregate_hw_free,
+	.prepare =	aggregate_prepare,
+	.trigger =	aggregate_trigger,
+	.pointer =	aggregate_pointer,
+	.page =		snd_pcm_lib_get_vmalloc_page,
+	.mmap =		snd_pcm_lib_mmap_vmalloc,
+};
+
+static int aggregate_pcm_new(struct aggregate *agg)
+{
+	struct snd_pcm *pcm;
+	int err;
+
+	err = snd_pcm_new(agg->card, "Aggregate PCM", 0, 1, 1, &pcm);
+	if (err < 0)
+		return err;
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &aggregate_pcm_ops);
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &aggregate_pcm_ops);
+	pcm->private_data = agg;
+	pcm->info_flags = 0;
+	strcpy(pcm->name, "Aggregate PCM");
+	agg->pcm = pcm;
+	return 0;
+}
+
+/* parse "card:device[:channels],..." */
+static int aggregate_parse_members(struct aggregate *agg, const char *str)
+{
+	struct aggregate_member *m;
+	int card, device, channels, n;
+
+	agg->num_members = 0;
+	agg->channels = 0;
+	while (str && *str) {
+		if (agg->num_members >= MAX_MEMBERS)
+			return -EINVAL;
+		channels = DEFAULT_CHANNELS;
+		n = sscanf(str, "%d:%d:%d", &card, &device, &channels);
+		if (n < 2 || card < 0 || card >= SNDRV_CARDS ||
+		    device < 0 || channels < 1)
+			return -EINVAL;
+		m = &agg->members[agg->num_members++];
+		m->card = card;
+		m->device = device;
+		m->channels = channels;
+		m->first = agg->channels;
+		agg->channels += channels;
+		str = strchr(str, ',');
+		if (str)
+			str++;
+	}
+	return agg->num_members ? 0 : -EINVAL;
+}
+
+#ifdef CONFIG_PROC_FS
+
+static void print_stream_info(struct snd_info_buffer *buffer,
+			      struct aggregate_pcm *apcm, const char *id)
+{
+	unsigned int i;
+
+	snd_iprintf(buffer, "%s:\n", id);
+	if (!apcm) {
+		snd_iprintf(buffer, "  inactive\n");
+		return;
+	}
+	snd_iprintf(buffer, "  running: %u\n", apcm->running);
+	snd_iprintf(buffer, "  hw_ptr: %lu\n", apcm->hw_ptr);
+	snd_iprintf(buffer, "  delay: %ld\n", apcm->substream->runtime->delay);
+	for (i = 0; i < apcm->num_links; i++) {
+		struct aggregate_link *link = &apcm->links[i];
+
+		snd_iprintf(buffer, "  member %d:%d channels %u-%u\n",
+			    link->member->card, link->member->device,
+			    link->member->first,
+			    link->member->first + link->member->channels - 1);
+		snd_iprintf(buffer, "    frames:\t%llu\n", link->frames);
+		snd_iprintf(buffer, "    drift:\t%ld (avg %ld)\n",
+			    link->drift, link->drift_avg >> 8);
+		snd_iprintf(buffer, "    slips:\t%lu\n", link->slips);
+		snd_iprintf(buffer, "    xruns:\t%lu\n", link->xruns);
+	}
+}
+
+static void aggregate_proc_read(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct aggregate *agg = entry->private_data;
+
+	mutex_lock(&agg->open_lock);
+	snd_iprintf(buffer, "channels: %u\n", agg->channels);
+	snd_iprintf(buffer, "max_drift: %d\n", agg->max_drift);
+	print_stream_info(buffer, agg->streams[SNDRV_PCM_STREAM_PLAYBACK],
+			  "Playback");
+	print_stream_info(buffer, agg->streams[SNDRV_PCM_STREAM_CAPTURE],
+			  "Capture");
+	mutex_unlock(&agg->open_lock);
+}
+
+static void aggregate_proc_new(struct aggregate *agg)
+{
+	struct snd_info_entry *entry;
+
+	if (!snd_card_proc_new(agg->card, "aggregate", &entry))
+		snd_info_set_text_ops(entry, agg, aggregate_proc_read);
+}
+
+#else /* !CONFIG_PROC_FS */
+
+#define aggregate_proc_new(agg) do { } while (0)
+
+#endif
+
+static int aggregate_probe(struct platform_device *devptr)
+{
+	struct snd_card *card;
+	struct aggregate *agg;
+	int dev = devptr->id;
+	int err;
+
+	err = snd_card_create(index[dev], id[dev], THIS_MODULE,
+			      sizeof(struct aggregate), &card);
+	if (err < 0)
+		return err;
+	agg = card->private_data;
+	agg->card = card;
+	agg->max_drift = max(max_drift[dev], 0);
+	mutex_init(&agg->open_lock);
+
+	err = aggregate_parse_members(agg, members[dev]);
+	if (err < 0) {
+		snd_printk(KERN_ERR "aggregate: invalid members option '%s'\n",
+			   members[dev] ? members[dev] : "");
+		goto __nodev;
+	}
+	err = aggregate_pcm_new(agg);
+	if (err < 0)
+		goto __nodev;
+	aggregate_proc_new(agg);
+	strcpy(card->driver, "Aggregate");
+	strcpy(card->shortname, "Aggregate");
+	sprintf(card->longname, "Aggregate %i (%u channels)", dev + 1,
+		agg->channels);
+	err = snd_card_register(card);
+	if (!err) {
+		platform_set_drvdata(devptr, card);
+		return 0;
+	}
+      __nodev:
+	snd_card_free(card);
+	return err;
+}
+
+static int aggregate_remove(struct platform_device *devptr)
+{
+	snd_card_free(platform_get_drvdata(devptr));
+	return 0;
+}
+
+#ifdef CONFIG_PM_SLEEP
+static int aggregate_suspend(struct device *pdev)
+{
+	struct snd_card *card = dev_get_drvdata(pdev);
+	struct aggregate *agg = card->private_data;
+
+	snd_power_change_state(card, SNDRV_CTL_POWER_D3hot);
+	snd_pcm_suspend_all(agg->pcm);
+	return 0;
+}
+
+static int aggregate_resume(struct device *pdev)
+{
+	struct snd_card *card = dev_get_drvdata(pdev);
+
+	snd_power_change_state(card, SNDRV_CTL_POWER_D0);
+	return 0;
+}
+
+static SIMPLE_DEV_PM_OPS(aggregate_pm, aggregate_suspend, aggregate_resume);
+#define AGGREGATE_PM_OPS	&aggregate_pm
+#else
+#define AGGREGATE_PM_OPS	NULL
+#endif
+
+#define SND_AGGREGATE_DRIVER	"snd_aggregate"
+
+static struct platform_driver aggregate_driver = {
+	.probe		= aggregate_probe,
+	.remove		= aggregate_remove,
+	.driver		= {
+		.name	= SND_AGGREGATE_DRIVER,
+		.owner	= THIS_MODULE,
+		.pm	= AGGREGATE_PM_OPS,
+	},
+};
+
+static void aggregate_unregister_all(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(devices); ++i)
+		platform_device_unregister(devices[i]);
+	platform_driver_unregister(&aggregate_driver);
+	snd_pcm_notify(&aggregate_notify, 1);
+}
+
+static int __init alsa_card_aggregate_init(void)
+{
+	int i, err, cards;
+
+	err = snd_pcm_notify(&aggregate_notify, 0);
+	if (err < 0)
+		return err;
+	err = platform_driver_register(&aggregate_driver);
+	if (err < 0) {
+		snd_pcm_notify(&aggregate_notify, 1);
+		return err;
+	}
+
+	cards = 0;
+	for (i = 0; i < SNDRV_CARDS; i++) {
+		struct platform_device *device;
+		if (!enable[i])
+			continue;
+		device = platform_device_register_simple(SND_AGGREGATE_DRIVER,
+							 i, NULL, 0);
+		if (IS_ERR(device))
+			continue;
+		if (!platform_get_drvdata(device)) {
+			platform_device_unregister(device);
+			continue;
+		}
+		devices[i] = device;
+		cards++;
+	}
+	if (!cards) {
+#ifdef MODULE
+		printk(KERN_ERR "aggregate: No aggregate card enabled\n");
+#endif
+		aggregate_unregister_all();
+		return -ENODEV;
+	}
+	return 0;
+}
+
+static void __exit alsa_card_aggregate_exit(void)
+{
+	aggregate_unregister_all();
+}
+
+module_init(alsa_card_aggregate_init)
+module_exit(alsa_card_aggregate_exit)
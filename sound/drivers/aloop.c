@@ -31,7 +31,9 @@
 
 #include <linux/init.h>
 #include <linux/jiffies.h>
+#include <linux/hrtimer.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/time.h>
 #include <linux/wait.h>
 #include <linux/module.h>
@@ -54,6 +56,8 @@ static char *id[SNDRV_CARDS] = SNDRV_DEFAULT_STR;	/* ID for this card */
 static bool enable[SNDRV_CARDS] = {1, [1 ... (SNDRV_CARDS - 1)] = 0};
 static int pcm_substreams[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 8};
 static int pcm_notify[SNDRV_CARDS];
+static bool hrtimer[SNDRV_CARDS];
+static bool shared_buffer[SNDRV_CARDS];
 
 module_param_array(index, int, NULL, 0444);
 MODULE_PARM_DESC(index, "Index value for loopback soundcard.");
@@ -65,6 +69,10 @@ module_param_array(pcm_substreams, int, NULL, 0444);
 MODULE_PARM_DESC(pcm_substreams, "PCM substreams # (1-8) for loopback driver.");
 module_param_array(pcm_notify, int, NULL, 0444);
 MODULE_PARM_DESC(pcm_notify, "Break capture when PCM format/rate/channels changes.");
+module_param_array(hrtimer, bool, NULL, 0444);
+MODULE_PARM_DESC(hrtimer, "Use hrtimer as the timer source for loopback cables.");
+module_param_array(shared_buffer, bool, NULL, 0444);
+MODULE_PARM_DESC(shared_buffer, "Share the buffer between playback and capture of a cable when possible.");
 
 #define NO_PITCH 100000
 
@@ -78,10 +86,23 @@ struct loopback_cable {
 	unsigned int valid;
 	unsigned int running;
 	unsigned int pause;
+	unsigned int hrtimer: 1;	/* ticks are ns instead of jiffies */
+	unsigned int share: 1;		/* try to share the buffer */
+	unsigned int share_resync: 1;	/* realign capture to playback */
+	/* shared buffer, protected by loopback->cable_lock */
+	void *share_area;
+	unsigned int share_bytes;
+	snd_pcm_format_t share_format;
+	unsigned int share_channels;
+	unsigned int share_users;
+	/* resampler state for cables following a clock */
+	unsigned int resample_valid: 1;
+	char resample_last[32 * 4];	/* last played frame */
 };
 
 struct loopback_setup {
 	unsigned int notify: 1;
+	unsigned int clock_follow: 1;
 	unsigned int rate_shift;
 	unsigned int format;
 	unsigned int rate;
@@ -98,6 +119,8 @@ struct loopback {
 	struct loopback_cable *cables[MAX_PCM_SUBSTREAMS][2];
 	struct snd_pcm *pcm[2];
 	struct loopback_setup setup[MAX_PCM_SUBSTREAMS][2];
+	unsigned int hrtimer: 1;
+	unsigned int shared_buffer: 1;
 };
 
 struct loopback_pcm {
@@ -114,36 +137,81 @@ struct loopback_pcm {
 	unsigned int pcm_rate_shift;	/* rate shift value */
 	/* flags */
 	unsigned int period_update_pending :1;
+	unsigned int shared :1;		/* dma_area is cable->share_area */
 	/* timer stuff */
-	unsigned int irq_pos;		/* fractional IRQ position */
-	unsigned int period_size_frac;
+	u64 irq_pos;			/* fractional IRQ position */
+	u64 period_size_frac;
 	unsigned int last_drift;
-	unsigned long last_jiffies;
+	u64 last_tick;			/* jiffies64 or ns, see cable->hrtimer */
 	struct timer_list timer;
+	struct hrtimer hrtimer;
+	/* clock following of a linked PCM substream */
+	unsigned int clock_follow: 1;	/* clock_rate_shift is valid */
+	unsigned int clock_rate;	/* nominal rate of the clock source */
+	unsigned int clock_rate_shift;	/* measured rate shift, 0 = none */
+	snd_pcm_uframes_t clock_hw_ptr;	/* last sampled hw_ptr */
+	u64 clock_frames;		/* frames since clock_base */
+	u64 clock_base;			/* ticks */
+};
+
+struct loopback_clock_sample {
+	snd_pcm_uframes_t hw_ptr;
+	snd_pcm_uframes_t boundary;
+	unsigned int rate;
 };
 
 static struct platform_device *devices[SNDRV_CARDS];
 
-static inline unsigned int byte_pos(struct loopback_pcm *dpcm, unsigned int x)
+/*
+ * The fractional positions are kept in bytes * ticks per second, where
+ * a tick is a jiffy for the system timer or a nanosecond for hrtimer.
+ * NSEC_PER_SEC is a multiple of NO_PITCH, which keeps the pitched
+ * conversions below within 64 bits.
+ */
+static inline unsigned int tick_hz(struct loopback_pcm *dpcm)
+{
+	return dpcm->cable->hrtimer ? NSEC_PER_SEC : HZ;
+}
+
+static inline unsigned int byte_pos(struct loopback_pcm *dpcm, u64 x)
 {
+	unsigned int pos;
+
 	if (dpcm->pcm_rate_shift == NO_PITCH) {
-		x /= HZ;
+		pos = div_u64(x, tick_hz(dpcm));
+	} else if (dpcm->cable->hrtimer) {
+		pos = div64_u64(x, (NSEC_PER_SEC / NO_PITCH) *
+				   (u64)dpcm->pcm_rate_shift);
 	} else {
-		x = div_u64(NO_PITCH * (unsigned long long)x,
-			    HZ * (unsigned long long)dpcm->pcm_rate_shift);
+		pos = div_u64(NO_PITCH * x,
+			      HZ * (unsigned long long)dpcm->pcm_rate_shift);
 	}
-	return x - (x % dpcm->pcm_salign);
+	return pos - (pos % dpcm->pcm_salign);
 }
 
-static inline unsigned int frac_pos(struct loopback_pcm *dpcm, unsigned int x)
+static inline u64 frac_pos(struct loopback_pcm *dpcm, unsigned int x)
 {
-	if (dpcm->pcm_rate_shift == NO_PITCH) {	/* no pitch */
-		return x * HZ;
-	} else {
-		x = div_u64(dpcm->pcm_rate_shift * (unsigned long long)x * HZ,
-			    NO_PITCH);
-	}
-	return x;
+	if (dpcm->pcm_rate_shift == NO_PITCH)	/* no pitch */
+		return (u64)x * tick_hz(dpcm);
+	if (dpcm->cable->hrtimer)
+		return (u64)x * (NSEC_PER_SEC / NO_PITCH) *
+			dpcm->pcm_rate_shift;
+	return div_u64(dpcm->pcm_rate_shift * (unsigned long long)x * HZ,
+		       NO_PITCH);
+}
+
+static inline u64 loopback_ticks(struct loopback_cable *cable)
+{
+	if (cable->hrtimer)
+		return ktime_to_ns(ktime_get());
+	return get_jiffies_64();
+}
+
+static inline void irq_pos_wrap(struct loopback_pcm *dpcm)
+{
+	dpcm->irq_pos -= div64_u64(dpcm->irq_pos, dpcm->period_size_frac) *
+			 dpcm->period_size_frac;
+	dpcm->period_update_pending = 1;
 }
 
 static inline struct loopback_setup *get_setup(struct loopback_pcm *dpcm)
@@ -162,25 +230,30 @@ static inline unsigned int get_notify(struct loopback_pcm *dpcm)
 
 static inline unsigned int get_rate_shift(struct loopback_pcm *dpcm)
 {
+	if (dpcm->clock_follow && dpcm->clock_rate_shift)
+		return dpcm->clock_rate_shift;
 	return get_setup(dpcm)->rate_shift;
 }
 
 /* call in cable->lock */
 static void loopback_timer_start(struct loopback_pcm *dpcm)
 {
-	unsigned long tick;
+	u64 tick;
 	unsigned int rate_shift = get_rate_shift(dpcm);
 
 	if (rate_shift != dpcm->pcm_rate_shift) {
 		dpcm->pcm_rate_shift = rate_shift;
 		dpcm->period_size_frac = frac_pos(dpcm, dpcm->pcm_period_size);
 	}
-	if (dpcm->period_size_frac <= dpcm->irq_pos) {
-		dpcm->irq_pos %= dpcm->period_size_frac;
-		dpcm->period_update_pending = 1;
-	}
+	if (dpcm->period_size_frac <= dpcm->irq_pos)
+		irq_pos_wrap(dpcm);
 	tick = dpcm->period_size_frac - dpcm->irq_pos;
-	tick = (tick + dpcm->pcm_bps - 1) / dpcm->pcm_bps;
+	tick = div_u64(tick + dpcm->pcm_bps - 1, dpcm->pcm_bps);
+	if (dpcm->cable->hrtimer) {
+		hrtimer_start(&dpcm->hrtimer, ns_to_ktime(tick),
+			      HRTIMER_MODE_REL);
+		return;
+	}
 	dpcm->timer.expires = jiffies + tick;
 	add_timer(&dpcm->timer);
 }
@@ -188,14 +261,40 @@ static void loopback_timer_start(struct loopback_pcm *dpcm)
 /* call in cable->lock */
 static inline void loopback_timer_stop(struct loopback_pcm *dpcm)
 {
+	if (dpcm->cable->hrtimer) {
+		hrtimer_try_to_cancel(&dpcm->hrtimer);
+		return;
+	}
 	del_timer(&dpcm->timer);
 	dpcm->timer.expires = 0;
 }
 
+/* call without cable->lock; the timer callback is finished on return */
+static inline void loopback_timer_stop_sync(struct loopback_pcm *dpcm)
+{
+	if (dpcm->cable->hrtimer)
+		hrtimer_cancel(&dpcm->hrtimer);
+	else
+		loopback_timer_stop(dpcm);
+}
+
 #define CABLE_VALID_PLAYBACK	(1 << SNDRV_PCM_STREAM_PLAYBACK)
 #define CABLE_VALID_CAPTURE	(1 << SNDRV_PCM_STREAM_CAPTURE)
 #define CABLE_VALID_BOTH	(CABLE_VALID_PLAYBACK|CABLE_VALID_CAPTURE)
 
+/*
+ * both directions map cable->share_area, so the played data is already
+ * in the capture buffer and only the positions have to be advanced;
+ * call in cable->lock
+ */
+static inline int loopback_zero_copy(struct loopback_cable *cable)
+{
+	struct loopback_pcm *play = cable->streams[SNDRV_PCM_STREAM_PLAYBACK];
+	struct loopback_pcm *capt = cable->streams[SNDRV_PCM_STREAM_CAPTURE];
+
+	return play && capt && play->shared && capt->shared;
+}
+
 static int loopback_check_format(struct loopback_cable *cable, int stream)
 {
 	struct snd_pcm_runtime *runtime, *cruntime;
@@ -265,12 +364,16 @@ static int loopback_trigger(struct snd_pcm_substream *substream, int cmd)
 		err = loopback_check_format(cable, substream->stream);
 		if (err < 0)
 			return err;
-		dpcm->last_jiffies = jiffies;
 		dpcm->pcm_rate_shift = 0;
 		dpcm->last_drift = 0;
+		dpcm->clock_follow = 0;
+		dpcm->clock_rate_shift = 0;
 		spin_lock(&cable->lock);	
+		dpcm->last_tick = loopback_ticks(cable);
+		cable->resample_valid = 0;
 		cable->running |= stream;
 		cable->pause &= ~stream;
+		cable->share_resync = 1;
 		loopback_timer_start(dpcm);
 		spin_unlock(&cable->lock);
 		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
@@ -295,8 +398,9 @@ static int loopback_trigger(struct snd_pcm_substream *substream, int cmd)
 	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
 	case SNDRV_PCM_TRIGGER_RESUME:
 		spin_lock(&cable->lock);
-		dpcm->last_jiffies = jiffies;
+		dpcm->last_tick = loopback_ticks(cable);
 		cable->pause &= ~stream;
+		cable->share_resync = 1;
 		loopback_timer_start(dpcm);
 		spin_unlock(&cable->lock);
 		break;
@@ -351,7 +455,7 @@ static int loopback_prepare(struct snd_pcm_substream *substream)
 
 	dpcm->buf_pos = 0;
 	dpcm->pcm_buffer_size = frames_to_bytes(runtime, runtime->buffer_size);
-	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE && !dpcm->shared) {
 		/* clear capture buffer */
 		dpcm->silent_size = dpcm->pcm_buffer_size;
 		snd_pcm_format_set_silence(runtime->format, runtime->dma_area,
@@ -383,6 +487,10 @@ static void clear_capture_buf(struct loopback_pcm *dpcm, unsigned int bytes)
 
 	if (dpcm->silent_size >= dpcm->pcm_buffer_size)
 		return;
+	/* don't wipe the data of a prepared playback in the shared buffer */
+	if (loopback_zero_copy(dpcm->cable) &&
+	    (dpcm->cable->valid & CABLE_VALID_PLAYBACK))
+		return;
 	if (dpcm->silent_size + bytes > dpcm->pcm_buffer_size)
 		bytes = dpcm->pcm_buffer_size - dpcm->silent_size;
 
@@ -429,6 +537,11 @@ static void copy_play_buf(struct loopback_pcm *play,
 		}
 	}
 
+	if (loopback_zero_copy(play->cable)) {
+		capt->silent_size = 0;
+		goto clear;
+	}
+
 	for (;;) {
 		unsigned int size = bytes;
 		if (src_off + size > play->pcm_buffer_size)
@@ -444,28 +557,136 @@ static void copy_play_buf(struct loopback_pcm *play,
 		dst_off = (dst_off + size) % capt->pcm_buffer_size;
 	}
 
+ clear:
 	if (clear_bytes > 0) {
 		clear_capture_buf(capt, clear_bytes);
 		capt->silent_size = 0;
 	}
 }
 
+static inline char *ring_frame(struct loopback_pcm *dpcm, unsigned int frame)
+{
+	return dpcm->substream->runtime->dma_area +
+		(dpcm->buf_pos + frame * dpcm->pcm_salign) %
+			dpcm->pcm_buffer_size;
+}
+
+static inline s32 get_sample(const void *p, snd_pcm_format_t format)
+{
+	switch (format) {
+	case SNDRV_PCM_FORMAT_S16_LE:
+		return (s32)(s16)le16_to_cpup(p) << 16;
+	case SNDRV_PCM_FORMAT_S16_BE:
+		return (s32)(s16)be16_to_cpup(p) << 16;
+	case SNDRV_PCM_FORMAT_S32_LE:
+		return (s32)le32_to_cpup(p);
+	default:
+		return (s32)be32_to_cpup(p);
+	}
+}
+
+static inline void put_sample(void *p, snd_pcm_format_t format, s32 val)
+{
+	switch (format) {
+	case SNDRV_PCM_FORMAT_S16_LE:
+		*(__le16 *)p = cpu_to_le16(val >> 16);
+		break;
+	case SNDRV_PCM_FORMAT_S16_BE:
+		*(__be16 *)p = cpu_to_be16(val >> 16);
+		break;
+	case SNDRV_PCM_FORMAT_S32_LE:
+		*(__le32 *)p = cpu_to_le32(val);
+		break;
+	default:
+		*(__be32 *)p = cpu_to_be32(val);
+		break;
+	}
+}
+
+/*
+ * Copy play_bytes of playback data into capt_bytes of capture data when
+ * the two directions run on different clocks.  Integer formats are
+ * linearly interpolated, float formats take the nearest frame.  The last
+ * played frame is kept for the interpolation across calls.
+ */
+static void resample_play_buf(struct loopback_pcm *play,
+			      struct loopback_pcm *capt,
+			      unsigned int play_bytes,
+			      unsigned int capt_bytes)
+{
+	struct loopback_cable *cable = play->cable;
+	struct snd_pcm_runtime *runtime = capt->substream->runtime;
+	snd_pcm_format_t format = runtime->format;
+	unsigned int salign = capt->pcm_salign;
+	unsigned int n_in = play_bytes / salign;
+	unsigned int n_out = capt_bytes / salign;
+	unsigned int width = snd_pcm_format_physical_width(format) / 8;
+	int linear = snd_pcm_format_linear(format);
+	u64 step, pos;
+	unsigned int j, ch;
+
+	if (salign > sizeof(cable->resample_last))
+		return;
+	if (!cable->resample_valid) {
+		if (n_in)
+			memcpy(cable->resample_last, ring_frame(play, 0),
+			       salign);
+		else
+			snd_pcm_format_set_silence(format,
+						   cable->resample_last,
+						   runtime->channels);
+		cable->resample_valid = 1;
+	}
+	/* output frame j is at input position (j + 1) * n_in / n_out - 1,
+	 * where position -1 is the last frame of the previous call
+	 */
+	step = n_out ? div_u64((u64)n_in << 16, n_out) : 0;
+	for (j = 0; j < n_out; j++) {
+		char *dst = ring_frame(capt, j);
+		const char *a, *b;
+		unsigned int frac;
+		int i;
+
+		pos = (j + 1 == n_out) ? (u64)n_in << 16 : (j + 1) * step;
+		i = (int)(pos >> 16) - 1;
+		frac = pos & 0xffff;
+		a = i < 0 ? cable->resample_last : ring_frame(play, i);
+		if (!frac || i + 1 >= n_in) {
+			memcpy(dst, a, salign);
+			continue;
+		}
+		b = ring_frame(play, i + 1);
+		if (!linear) {
+			memcpy(dst, frac < 0x8000 ? a : b, salign);
+			continue;
+		}
+		for (ch = 0; ch < runtime->channels; ch++) {
+			s32 va = get_sample(a + ch * width, format);
+			s32 vb = get_sample(b + ch * width, format);
+			put_sample(dst + ch * width, format,
+				   va + (s32)(((s64)vb - va) * frac >> 16));
+		}
+	}
+	if (n_in)
+		memcpy(cable->resample_last, ring_frame(play, n_in - 1),
+		       salign);
+	capt->silent_size = 0;
+}
+
 static inline unsigned int bytepos_delta(struct loopback_pcm *dpcm,
-					 unsigned int jiffies_delta)
+					 u64 ticks_delta)
 {
 	unsigned long last_pos;
 	unsigned int delta;
 
 	last_pos = byte_pos(dpcm, dpcm->irq_pos);
-	dpcm->irq_pos += jiffies_delta * dpcm->pcm_bps;
+	dpcm->irq_pos += ticks_delta * dpcm->pcm_bps;
 	delta = byte_pos(dpcm, dpcm->irq_pos) - last_pos;
 	if (delta >= dpcm->last_drift)
 		delta -= dpcm->last_drift;
 	dpcm->last_drift = 0;
-	if (dpcm->irq_pos >= dpcm->period_size_frac) {
-		dpcm->irq_pos %= dpcm->period_size_frac;
-		dpcm->period_update_pending = 1;
-	}
+	if (dpcm->irq_pos >= dpcm->period_size_frac)
+		irq_pos_wrap(dpcm);
 	return delta;
 }
 
@@ -483,18 +704,19 @@ static unsigned int loopback_pos_update(struct loopback_cable *cable)
 			cable->streams[SNDRV_PCM_STREAM_PLAYBACK];
 	struct loopback_pcm *dpcm_capt =
 			cable->streams[SNDRV_PCM_STREAM_CAPTURE];
-	unsigned long delta_play = 0, delta_capt = 0;
+	u64 now, delta_play = 0, delta_capt = 0;
 	unsigned int running, count1, count2;
 
 	running = cable->running ^ cable->pause;
+	now = loopback_ticks(cable);
 	if (running & (1 << SNDRV_PCM_STREAM_PLAYBACK)) {
-		delta_play = jiffies - dpcm_play->last_jiffies;
-		dpcm_play->last_jiffies += delta_play;
+		delta_play = now - dpcm_play->last_tick;
+		dpcm_play->last_tick += delta_play;
 	}
 
 	if (running & (1 << SNDRV_PCM_STREAM_CAPTURE)) {
-		delta_capt = jiffies - dpcm_capt->last_jiffies;
-		dpcm_capt->last_jiffies += delta_capt;
+		delta_capt = now - dpcm_capt->last_tick;
+		dpcm_capt->last_tick += delta_capt;
 	}
 
 	if (delta_play == 0 && delta_capt == 0)
@@ -514,9 +736,26 @@ static unsigned int loopback_pos_update(struct loopback_cable *cable)
 	if (delta_play == 0 && delta_capt == 0)
 		goto unlock;
 
+	/* in zero-copy mode the capture reads at the playback position */
+	if (cable->share_resync && loopback_zero_copy(cable) &&
+	    running == CABLE_VALID_BOTH) {
+		dpcm_capt->buf_pos = dpcm_play->buf_pos;
+		cable->share_resync = 0;
+	}
+
 	/* note delta_capt == delta_play at this moment */
 	count1 = bytepos_delta(dpcm_play, delta_play);
 	count2 = bytepos_delta(dpcm_capt, delta_capt);
+	if (count1 != count2 &&
+	    (dpcm_play->clock_follow || dpcm_capt->clock_follow) &&
+	    dpcm_play->substream->runtime->status->state !=
+						SNDRV_PCM_STATE_DRAINING) {
+		/* sample-lock the capture to its clock */
+		resample_play_buf(dpcm_play, dpcm_capt, count1, count2);
+		bytepos_finish(dpcm_play, count1);
+		bytepos_finish(dpcm_capt, count2);
+		goto unlock;
+	}
 	if (count1 < count2) {
 		dpcm_capt->last_drift = count2 - count1;
 		count1 = count2;
@@ -530,12 +769,84 @@ static unsigned int loopback_pos_update(struct loopback_cable *cable)
 	return running;
 }
 
+/*
+ * Sample the position of a running substream of another card which is
+ * linked to this one.  The link lock keeps the substream alive while it
+ * is in our group; called from the timer (interrupt) context only.
+ */
+static int loopback_clock_get(struct loopback_pcm *dpcm,
+			      struct loopback_clock_sample *sample)
+{
+	struct snd_pcm_substream *s;
+	int found = 0;
+
+	read_lock(&snd_pcm_link_rwlock);
+	snd_pcm_group_for_each_entry(s, dpcm->substream) {
+		if (s->pcm->card == dpcm->loopback->card || !s->runtime ||
+		    !snd_pcm_running(s))
+			continue;
+		sample->hw_ptr = s->runtime->status->hw_ptr;
+		sample->boundary = s->runtime->boundary;
+		sample->rate = s->runtime->rate;
+		found = 1;
+		break;
+	}
+	read_unlock(&snd_pcm_link_rwlock);
+	return found;
+}
+
+/*
+ * Estimate the rate shift which makes the stream advance like the clock
+ * source: the ratio of the nominal to the counted frames of the source
+ * since the stream start, so that the hw_ptr granularity of the source
+ * averages out over time.  Call in cable->lock.
+ */
+static void loopback_clock_update(struct loopback_pcm *dpcm,
+				  struct loopback_clock_sample *sample)
+{
+	u64 now, expected;
+	snd_pcm_uframes_t delta;
+	unsigned int shift;
+
+	if (!sample || loopback_zero_copy(dpcm->cable)) {
+		dpcm->clock_follow = 0;
+		return;
+	}
+	now = loopback_ticks(dpcm->cable);
+	if (!dpcm->clock_follow || dpcm->clock_rate != sample->rate ||
+	    dpcm->clock_frames > (u64)sample->rate * 3600) {
+		dpcm->clock_follow = 1;
+		dpcm->clock_rate = sample->rate;
+		dpcm->clock_hw_ptr = sample->hw_ptr;
+		dpcm->clock_frames = 0;
+		dpcm->clock_base = now;
+		return;
+	}
+	if (sample->hw_ptr >= dpcm->clock_hw_ptr)
+		delta = sample->hw_ptr - dpcm->clock_hw_ptr;
+	else
+		delta = sample->hw_ptr + sample->boundary - dpcm->clock_hw_ptr;
+	dpcm->clock_hw_ptr = sample->hw_ptr;
+	dpcm->clock_frames += delta;
+	if (dpcm->clock_frames < sample->rate)
+		return;	/* wait for one second of data */
+	expected = div_u64((now - dpcm->clock_base) * sample->rate,
+			   tick_hz(dpcm));
+	shift = div64_u64(NO_PITCH * expected, dpcm->clock_frames);
+	dpcm->clock_rate_shift = clamp(shift, 80000U, 120000U);
+}
+
 static void loopback_timer_function(unsigned long data)
 {
 	struct loopback_pcm *dpcm = (struct loopback_pcm *)data;
+	struct loopback_clock_sample sample;
+	int follow = 0;
 	unsigned long flags;
 
+	if (get_setup(dpcm)->clock_follow)
+		follow = loopback_clock_get(dpcm, &sample);
 	spin_lock_irqsave(&dpcm->cable->lock, flags);
+	loopback_clock_update(dpcm, follow ? &sample : NULL);
 	if (loopback_pos_update(dpcm->cable) & (1 << dpcm->substream->stream)) {
 		loopback_timer_start(dpcm);
 		if (dpcm->period_update_pending) {
@@ -549,6 +860,16 @@ static void loopback_timer_function(unsigned long data)
 	spin_unlock_irqrestore(&dpcm->cable->lock, flags);
 }
 
+static enum hrtimer_restart loopback_hrtimer_function(struct hrtimer *timer)
+{
+	struct loopback_pcm *dpcm =
+		container_of(timer, struct loopback_pcm, hrtimer);
+
+	/* re-armed by loopback_timer_start() while the stream runs */
+	loopback_timer_function((unsigned long)dpcm);
+	return HRTIMER_NORESTART;
+}
+
 static snd_pcm_uframes_t loopback_pointer(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
@@ -591,9 +912,77 @@ static void loopback_runtime_free(struct snd_pcm_runtime *runtime)
 	kfree(dpcm);
 }
 
+/* call in loopback->cable_lock */
+static void loopback_share_release(struct loopback_pcm *dpcm)
+{
+	struct snd_pcm_runtime *runtime = dpcm->substream->runtime;
+	struct loopback_cable *cable = dpcm->cable;
+
+	if (!dpcm->shared)
+		return;
+	spin_lock_irq(&cable->lock);
+	dpcm->shared = 0;
+	spin_unlock_irq(&cable->lock);
+	runtime->dma_area = NULL;
+	if (!--cable->share_users) {
+		vfree(cable->share_area);
+		cable->share_area = NULL;
+	}
+}
+
+/*
+ * Use the cable buffer when the other direction has the same format and
+ * buffer size (or doesn't use the cable buffer yet); returns zero if the
+ * caller has to allocate a private buffer; call in loopback->cable_lock
+ */
+static int loopback_share_acquire(struct loopback_pcm *dpcm,
+				  struct snd_pcm_hw_params *params)
+{
+	struct snd_pcm_substream *substream = dpcm->substream;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct loopback_cable *cable = dpcm->cable;
+	unsigned int bytes = params_buffer_bytes(params);
+
+	if (cable->share_users) {
+		if (cable->share_bytes != bytes ||
+		    cable->share_format != params_format(params) ||
+		    cable->share_channels != params_channels(params))
+			return 0;
+	} else {
+		cable->share_area = __vmalloc(bytes, GFP_KERNEL | __GFP_HIGHMEM |
+					      __GFP_ZERO, PAGE_KERNEL);
+		if (!cable->share_area)
+			return 0;
+		cable->share_bytes = bytes;
+		cable->share_format = params_format(params);
+		cable->share_channels = params_channels(params);
+	}
+	cable->share_users++;
+	/* drop a private buffer from a previous hw_params */
+	snd_pcm_lib_free_vmalloc_buffer(substream);
+	runtime->dma_area = cable->share_area;
+	runtime->dma_bytes = bytes;
+	spin_lock_irq(&cable->lock);
+	dpcm->shared = 1;
+	spin_unlock_irq(&cable->lock);
+	return 1;
+}
+
 static int loopback_hw_params(struct snd_pcm_substream *substream,
 			      struct snd_pcm_hw_params *params)
 {
+	struct loopback_pcm *dpcm = substream->runtime->private_data;
+	struct loopback_cable *cable = dpcm->cable;
+	int shared = 0;
+
+	if (cable->share) {
+		mutex_lock(&dpcm->loopback->cable_lock);
+		loopback_share_release(dpcm);
+		shared = loopback_share_acquire(dpcm, params);
+		mutex_unlock(&dpcm->loopback->cable_lock);
+	}
+	if (shared)
+		return 0;
 	return snd_pcm_lib_alloc_vmalloc_buffer(substream,
 						params_buffer_bytes(params));
 }
@@ -606,6 +995,7 @@ static int loopback_hw_free(struct snd_pcm_substream *substream)
 
 	mutex_lock(&dpcm->loopback->cable_lock);
 	cable->valid &= ~(1 << substream->stream);
+	loopback_share_release(dpcm);
 	mutex_unlock(&dpcm->loopback->cable_lock);
 	return snd_pcm_lib_free_vmalloc_buffer(substream);
 }
@@ -678,6 +1068,8 @@ static int loopback_open(struct snd_pcm_substream *substream)
 	dpcm->substream = substream;
 	setup_timer(&dpcm->timer, loopback_timer_function,
 		    (unsigned long)dpcm);
+	hrtimer_init(&dpcm->hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dpcm->hrtimer.function = loopback_hrtimer_function;
 
 	cable = loopback->cables[substream->number][dev];
 	if (!cable) {
@@ -689,6 +1081,8 @@ static int loopback_open(struct snd_pcm_substream *substream)
 		}
 		spin_lock_init(&cable->lock);
 		cable->hw = loopback_pcm_hardware;
+		cable->hrtimer = loopback->hrtimer;
+		cable->share = loopback->shared_buffer;
 		loopback->cables[substream->number][dev] = cable;
 	}
 	dpcm->cable = cable;
@@ -736,7 +1130,7 @@ static int loopback_close(struct snd_pcm_substream *substream)
 	struct loopback_cable *cable;
 	int dev = get_cable_index(substream);
 
-	loopback_timer_stop(dpcm);
+	loopback_timer_stop_sync(dpcm);
 	mutex_lock(&loopback->cable_lock);
 	cable = loopback->cables[substream->number][dev];
 	if (cable->streams[!substream->stream]) {
@@ -871,6 +1265,34 @@ static int loopback_notify_put(struct snd_kcontrol *kcontrol,
 	return change;
 }
 
+static int loopback_clock_follow_get(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_value *ucontrol)
+{
+	struct loopback *loopback = snd_kcontrol_chip(kcontrol);
+	
+	ucontrol->value.integer.value[0] =
+		loopback->setup[kcontrol->id.subdevice]
+			       [kcontrol->id.device].clock_follow;
+	return 0;
+}
+
+static int loopback_clock_follow_put(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_value *ucontrol)
+{
+	struct loopback *loopback = snd_kcontrol_chip(kcontrol);
+	unsigned int val;
+	int change = 0;
+
+	val = ucontrol->value.integer.value[0] ? 1 : 0;
+	if (val != loopback->setup[kcontrol->id.subdevice]
+				[kcontrol->id.device].clock_follow) {
+		loopback->setup[kcontrol->id.subdevice]
+			[kcontrol->id.device].clock_follow = val;
+		change = 1;
+	}
+	return change;
+}
+
 static int loopback_active_get(struct snd_kcontrol *kcontrol,
 			       struct snd_ctl_elem_value *ucontrol)
 {
@@ -998,6 +1420,13 @@ static struct snd_kcontrol_new loopback_controls[]  = {
 	.name =         "PCM Slave Channels",
 	.info =         loopback_channels_info,
 	.get =          loopback_channels_get
+},
+{
+	.iface =        SNDRV_CTL_ELEM_IFACE_PCM,
+	.name =         "PCM Clock Follow",
+	.info =         snd_ctl_boolean_mono_info,
+	.get =          loopback_clock_follow_get,
+	.put =          loopback_clock_follow_put,
 }
 };
 
@@ -1071,13 +1500,28 @@ static void print_dpcm_info(struct snd_info_buffer *buffer,
 	snd_iprintf(buffer, "    period_size:\t%u\n", dpcm->pcm_period_size);
 	snd_iprintf(buffer, "    bytes_per_sec:\t%u\n", dpcm->pcm_bps);
 	snd_iprintf(buffer, "    sample_align:\t%u\n", dpcm->pcm_salign);
+	snd_iprintf(buffer, "    shared_buffer:\t%u\n", dpcm->shared);
 	snd_iprintf(buffer, "    rate_shift:\t\t%u\n", dpcm->pcm_rate_shift);
+	snd_iprintf(buffer, "    clock_follow:\t%u\n", dpcm->clock_follow);
+	if (dpcm->clock_follow) {
+		snd_iprintf(buffer, "    clock_rate:\t\t%u\n",
+			    dpcm->clock_rate);
+		snd_iprintf(buffer, "    clock_frames:\t%llu\n",
+			    dpcm->clock_frames);
+	}
 	snd_iprintf(buffer, "    update_pending:\t%u\n",
 						dpcm->period_update_pending);
-	snd_iprintf(buffer, "    irq_pos:\t\t%u\n", dpcm->irq_pos);
-	snd_iprintf(buffer, "    period_frac:\t%u\n", dpcm->period_size_frac);
-	snd_iprintf(buffer, "    last_jiffies:\t%lu (%lu)\n",
-					dpcm->last_jiffies, jiffies);
+	snd_iprintf(buffer, "    irq_pos:\t\t%llu\n", dpcm->irq_pos);
+	snd_iprintf(buffer, "    period_frac:\t%llu\n", dpcm->period_size_frac);
+	if (dpcm->cable->hrtimer) {
+		snd_iprintf(buffer, "    last_ns:\t\t%llu (%llu)\n",
+			    dpcm->last_tick, loopback_ticks(dpcm->cable));
+		snd_iprintf(buffer, "    timer_expires:\t%lld\n",
+			    ktime_to_ns(hrtimer_get_expires(&dpcm->hrtimer)));
+		return;
+	}
+	snd_iprintf(buffer, "    last_jiffies:\t%llu (%llu)\n",
+		    dpcm->last_tick, get_jiffies_64());
 	snd_iprintf(buffer, "    timer_expires:\t%lu\n", dpcm->timer.expires);
 }
 
@@ -1096,6 +1540,8 @@ static void print_substream_info(struct snd_info_buffer *buffer,
 	snd_iprintf(buffer, "  valid: %u\n", cable->valid);
 	snd_iprintf(buffer, "  running: %u\n", cable->running);
 	snd_iprintf(buffer, "  pause: %u\n", cable->pause);
+	snd_iprintf(buffer, "  timer: %s\n", cable->hrtimer ? "hrtimer" : "system");
+	snd_iprintf(buffer, "  zero_copy: %u\n", loopback_zero_copy(cable));
 	print_dpcm_info(buffer, cable->streams[0], "Playback");
 	print_dpcm_info(buffer, cable->streams[1], "Capture");
 }
@@ -1154,6 +1600,8 @@ static int loopback_probe(struct platform_device *devptr)
 		pcm_substreams[dev] = MAX_PCM_SUBSTREAMS;
 	
 	loopback->card = card;
+	loopback->hrtimer = hrtimer[dev];
+	loopback->shared_buffer = shared_buffer[dev];
 	mutex_init(&loopback->cable_lock);
 
 	err = loopback_pcm_new(loopback, 0, pcm_substreams[dev]);
@@ -27,6 +27,8 @@
 #include <linux/wait.h>
 #include <linux/hrtimer.h>
 #include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/workqueue.h>
 #include <linux/module.h>
 #include <sound/core.h>
 #include <sound/control.h>
@@ -67,6 +69,12 @@ static int pcm_substreams[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 8};
 //static int midi_devs[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 2};
 #ifdef CONFIG_HIGH_RES_TIMERS
 static bool hrtimer = 1;
+static bool bench;
+static int bench_cpus;
+static int bench_jitter;
+static int bench_late;
+static int bench_late_interval;
+static int bench_ptr_jitter;
 #endif
 static bool fake_buffer = 1;
 
@@ -89,6 +97,18 @@ MODULE_PARM_DESC(fake_buffer, "Fake buffer allocations.");
 #ifdef CONFIG_HIGH_RES_TIMERS
 module_param(hrtimer, bool, 0644);
 MODULE_PARM_DESC(hrtimer, "Use hrtimer as the timer source.");
+module_param(bench, bool, 0444);
+MODULE_PARM_DESC(bench, "Benchmark mode: record per-substream timing statistics (hrtimer only).");
+module_param(bench_cpus, int, 0644);
+MODULE_PARM_DESC(bench_cpus, "Spread substream timers over this many CPUs in benchmark mode (0 = don't pin).");
+module_param(bench_jitter, int, 0644);
+MODULE_PARM_DESC(bench_jitter, "Random delay in usec (up to) added to each period timer in benchmark mode.");
+module_param(bench_late, int, 0644);
+MODULE_PARM_DESC(bench_late, "Delay in usec for late period interrupts in benchmark mode.");
+module_param(bench_late_interval, int, 0644);
+MODULE_PARM_DESC(bench_late_interval, "Make every Nth period interrupt late in benchmark mode (0 = never).");
+module_param(bench_ptr_jitter, int, 0644);
+MODULE_PARM_DESC(bench_ptr_jitter, "Random lag in frames (up to) of the reported position in benchmark mode.");
 #endif
 
 static struct platform_device *devices[SNDRV_CARDS];
@@ -138,6 +158,10 @@ struct snd_dummy {
 	struct snd_kcontrol *cd_volume_ctl;
 	struct snd_kcontrol *cd_switch_ctl;
 	const struct dummy_timer_ops *timer_ops;
+#ifdef CONFIG_HIGH_RES_TIMERS
+	struct dummy_bench_stats *bench_stats;	/* benchmark mode only */
+	int bench_substreams;
+#endif
 };
 
 /*
@@ -367,6 +391,24 @@ static struct dummy_timer_ops dummy_systimer_ops = {
  * hrtimer interface
  */
 
+/*
+ * Benchmark mode statistics, kept per substream across open/close.
+ * Latencies are in nsec: "timer" is the delay from the programmed
+ * expiry to the hrtimer callback, "wakeup" the delay from the nominal
+ * period boundary to snd_pcm_period_elapsed(), including any injected
+ * jitter.
+ */
+struct dummy_bench_stats {
+	int cpu;
+	unsigned long periods;
+	u64 timer_sum;
+	u64 timer_max;
+	u64 wakeup_sum;
+	u64 wakeup_max;
+	unsigned long xruns;
+	unsigned long hw_ptr_corrections;
+};
+
 struct dummy_hrtimer_pcm {
 	ktime_t base_time;
 	ktime_t period_time;
@@ -374,32 +416,117 @@ struct dummy_hrtimer_pcm {
 	struct hrtimer timer;
 	struct tasklet_struct tasklet;
 	struct snd_pcm_substream *substream;
+	/* benchmark mode */
+	struct dummy_bench_stats *stats;
+	ktime_t next;			/* next nominal period boundary */
+	ktime_t elapsed;		/* boundary handed to the tasklet */
+	unsigned int count;		/* periods since start */
+	struct work_struct start_work;	/* starts the timer on stats->cpu */
 };
 
+static void dummy_bench_update(u64 *sum, u64 *max, s64 lat)
+{
+	if (lat < 0)
+		lat = 0;
+	*sum += lat;
+	if (lat > *max)
+		*max = lat;
+}
+
+/* pick up the PCM core counters; the runtime goes away at close */
+static void dummy_bench_counters(struct dummy_hrtimer_pcm *dpcm)
+{
+	struct snd_pcm_runtime *runtime = dpcm->substream->runtime;
+
+	dpcm->stats->xruns = runtime->xrun_count;
+	dpcm->stats->hw_ptr_corrections = runtime->hw_ptr_corrections;
+}
+
+/* extra delay of the next period timer in nsec */
+static u64 dummy_bench_delay(struct dummy_hrtimer_pcm *dpcm)
+{
+	u64 delay = 0;
+
+	if (bench_jitter > 0)
+		delay = (u64)(prandom_u32() % (bench_jitter + 1)) * 1000;
+	if (bench_late > 0 && bench_late_interval > 0 &&
+	    !(++dpcm->count % bench_late_interval))
+		delay += (u64)bench_late * 1000;
+	return delay;
+}
+
 static void dummy_hrtimer_pcm_elapsed(unsigned long priv)
 {
 	struct dummy_hrtimer_pcm *dpcm = (struct dummy_hrtimer_pcm *)priv;
-	if (atomic_read(&dpcm->running))
-		snd_pcm_period_elapsed(dpcm->substream);
+	struct dummy_bench_stats *stats = dpcm->stats;
+
+	if (!atomic_read(&dpcm->running))
+		return;
+	if (stats) {
+		dummy_bench_update(&stats->wakeup_sum, &stats->wakeup_max,
+				   ktime_to_ns(ktime_sub(ktime_get(),
+							 dpcm->elapsed)));
+		stats->periods++;
+	}
+	snd_pcm_period_elapsed(dpcm->substream);
+	if (stats)
+		dummy_bench_counters(dpcm);
 }
 
 static enum hrtimer_restart dummy_hrtimer_callback(struct hrtimer *timer)
 {
 	struct dummy_hrtimer_pcm *dpcm;
+	ktime_t now;
 
 	dpcm = container_of(timer, struct dummy_hrtimer_pcm, timer);
 	if (!atomic_read(&dpcm->running))
 		return HRTIMER_NORESTART;
+	if (!dpcm->stats) {
+		tasklet_schedule(&dpcm->tasklet);
+		hrtimer_forward_now(timer, dpcm->period_time);
+		return HRTIMER_RESTART;
+	}
+
+	now = hrtimer_cb_get_time(timer);
+	dummy_bench_update(&dpcm->stats->timer_sum, &dpcm->stats->timer_max,
+			   ktime_to_ns(ktime_sub(now, hrtimer_get_expires(timer))));
+	dpcm->elapsed = dpcm->next;
 	tasklet_schedule(&dpcm->tasklet);
-	hrtimer_forward_now(timer, dpcm->period_time);
+	/* keep the nominal period grid, skipping periods we were late for */
+	do {
+		dpcm->next = ktime_add(dpcm->next, dpcm->period_time);
+	} while (ktime_to_ns(ktime_sub(dpcm->next, now)) <= 0);
+	hrtimer_set_expires(timer, ktime_add_ns(dpcm->next,
+						dummy_bench_delay(dpcm)));
 	return HRTIMER_RESTART;
 }
 
+static void dummy_hrtimer_start_work(struct work_struct *work)
+{
+	struct dummy_hrtimer_pcm *dpcm =
+		container_of(work, struct dummy_hrtimer_pcm, start_work);
+
+	if (atomic_read(&dpcm->running))
+		hrtimer_start(&dpcm->timer, dpcm->next, HRTIMER_MODE_ABS_PINNED);
+}
+
 static int dummy_hrtimer_start(struct snd_pcm_substream *substream)
 {
 	struct dummy_hrtimer_pcm *dpcm = substream->runtime->private_data;
 
 	dpcm->base_time = hrtimer_cb_get_time(&dpcm->timer);
+	if (dpcm->stats) {
+		dpcm->next = ktime_add(dpcm->base_time, dpcm->period_time);
+		dpcm->count = 0;
+		atomic_set(&dpcm->running, 1);
+		if (dpcm->stats->cpu >= 0)
+			queue_work_on(dpcm->stats->cpu, system_highpri_wq,
+				      &dpcm->start_work);
+		else
+			hrtimer_start(&dpcm->timer, dpcm->next,
+				      HRTIMER_MODE_ABS);
+		return 0;
+	}
 	hrtimer_start(&dpcm->timer, dpcm->period_time, HRTIMER_MODE_REL);
 	atomic_set(&dpcm->running, 1);
 	return 0;
@@ -416,6 +543,10 @@ static int dummy_hrtimer_stop(struct snd_pcm_substream *substream)
 
 static inline void dummy_hrtimer_sync(struct dummy_hrtimer_pcm *dpcm)
 {
+	if (dpcm->stats) {
+		cancel_work_sync(&dpcm->start_work);
+		hrtimer_cancel(&dpcm->timer);
+	}
 	tasklet_kill(&dpcm->tasklet);
 }
 
@@ -430,6 +561,10 @@ dummy_hrtimer_pointer(struct snd_pcm_substream *substream)
 	delta = ktime_us_delta(hrtimer_cb_get_time(&dpcm->timer),
 			       dpcm->base_time);
 	delta = div_u64(delta * runtime->rate + 999999, 1000000);
+	if (dpcm->stats && bench_ptr_jitter > 0) {
+		u64 lag = prandom_u32() % (bench_ptr_jitter + 1);
+		delta -= min(delta, lag);
+	}
 	div_u64_rem(delta, runtime->buffer_size, &pos);
 	return pos;
 }
@@ -455,6 +590,7 @@ static int dummy_hrtimer_prepare(struct snd_pcm_substream *substream)
 
 static int dummy_hrtimer_create(struct snd_pcm_substream *substream)
 {
+	struct snd_dummy *dummy = snd_pcm_substream_chip(substream);
 	struct dummy_hrtimer_pcm *dpcm;
 
 	dpcm = kzalloc(sizeof(*dpcm), GFP_KERNEL);
@@ -467,6 +603,27 @@ static int dummy_hrtimer_create(struct snd_pcm_substream *substream)
 	atomic_set(&dpcm->running, 0);
 	tasklet_init(&dpcm->tasklet, dummy_hrtimer_pcm_elapsed,
 		     (unsigned long)dpcm);
+	if (dummy->bench_stats) {
+		int slot = (substream->pcm->device * 2 + substream->stream) *
+			dummy->bench_substreams + substream->number;
+		int cpus = min_t(int, bench_cpus, num_online_cpus());
+		int cpu = -1;
+
+		/* pin the timer of each substream to the next online CPU */
+		if (cpus > 0) {
+			int n = slot % cpus;
+
+			for_each_online_cpu(cpu)
+				if (!n--)
+					break;
+			if (cpu >= nr_cpu_ids)
+				cpu = -1;
+		}
+		dpcm->stats = &dummy->bench_stats[slot];
+		memset(dpcm->stats, 0, sizeof(*dpcm->stats));
+		dpcm->stats->cpu = cpu;
+		INIT_WORK(&dpcm->start_work, dummy_hrtimer_start_work);
+	}
 	return 0;
 }
 
@@ -474,6 +631,8 @@ static void dummy_hrtimer_free(struct snd_pcm_substream *substream)
 {
 	struct dummy_hrtimer_pcm *dpcm = substream->runtime->private_data;
 	dummy_hrtimer_sync(dpcm);
+	if (dpcm->stats)
+		dummy_bench_counters(dpcm);
 	kfree(dpcm);
 }
 
@@ -1046,6 +1205,78 @@ static void dummy_proc_init(struct snd_dummy *chip)
 #define dummy_proc_init(x)
 #endif /* CONFIG_SND_DEBUG && CONFIG_PROC_FS */
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+#ifdef CONFIG_PROC_FS
+static void dummy_bench_proc_read(struct snd_info_entry *entry,
+				  struct snd_info_buffer *buffer)
+{
+	struct snd_dummy *dummy = entry->private_data;
+	struct dummy_bench_stats *stats;
+	int dev, stream, sub, slot;
+
+	snd_iprintf(buffer, "# latencies in nsec: avg/max\n");
+	for (dev = 0; dev < MAX_PCM_DEVICES; dev++) {
+		for (stream = 0; stream < 2; stream++) {
+			for (sub = 0; sub < dummy->bench_substreams; sub++) {
+				slot = (dev * 2 + stream) *
+					dummy->bench_substreams + sub;
+				stats = &dummy->bench_stats[slot];
+				if (!stats->periods)
+					continue;
+				snd_iprintf(buffer,
+					    "pcm%d%c sub%d: cpu %d periods %lu "
+					    "timer %llu/%llu wakeup %llu/%llu "
+					    "xruns %lu hw_ptr_corrections %lu\n",
+					    dev, stream ? 'c' : 'p', sub,
+					    stats->cpu, stats->periods,
+					    div64_u64(stats->timer_sum,
+						      stats->periods),
+					    stats->timer_max,
+					    div64_u64(stats->wakeup_sum,
+						      stats->periods),
+					    stats->wakeup_max,
+					    stats->xruns,
+					    stats->hw_ptr_corrections);
+			}
+		}
+	}
+}
+
+static void dummy_bench_proc_init(struct snd_dummy *chip)
+{
+	struct snd_info_entry *entry;
+
+	if (!snd_card_proc_new(chip->card, "dummy_bench", &entry))
+		snd_info_set_text_ops(entry, chip, dummy_bench_proc_read);
+}
+#else
+#define dummy_bench_proc_init(x)
+#endif /* CONFIG_PROC_FS */
+
+static void snd_dummy_bench_free(struct snd_card *card)
+{
+	struct snd_dummy *dummy = card->private_data;
+
+	kfree(dummy->bench_stats);
+}
+
+static int snd_dummy_bench_init(struct snd_dummy *dummy, int substreams)
+{
+	if (!bench || !hrtimer || substreams < 1)
+		return 0;
+	dummy->bench_substreams = substreams;
+	dummy->bench_stats = kcalloc(MAX_PCM_DEVICES * 2 * substreams,
+				     sizeof(*dummy->bench_stats), GFP_KERNEL);
+	if (!dummy->bench_stats)
+		return -ENOMEM;
+	dummy->card->private_free = snd_dummy_bench_free;
+	dummy_bench_proc_init(dummy);
+	return 0;
+}
+#else
+#define snd_dummy_bench_init(dummy, substreams)	0
+#endif /* CONFIG_HIGH_RES_TIMERS */
+
 static int snd_dummy_probe(struct platform_device *devptr)
 {
 	struct snd_card *card;
@@ -1113,6 +1344,9 @@ static int snd_dummy_probe(struct platform_device *devptr)
 	sprintf(card->longname, "Dummy %i", dev + 1);
 
 	dummy_proc_init(dummy);
+	err = snd_dummy_bench_init(dummy, pcm_substreams[dev]);
+	if (err < 0)
+		goto __nodev;
 
 	snd_card_set_dev(card, &devptr->dev);
 
@@ -851,7 +851,7 @@ void snd_hda_pick_fixup(struct hda_codec *codec,
 		}
 	}
 	if (id < 0 && quirk) {
-		q = snd_pci_quirk_lookup(codec->bus->pci, quirk);
+		q = snd_hda_quirk_lookup(codec, quirk);
 		if (q) {
 			id = q->value;
 #ifdef CONFIG_SND_DEBUG_VERBOSE
@@ -26,6 +26,7 @@
 #include <linux/pci.h>
 #include <linux/mutex.h>
 #include <linux/module.h>
+#include <linux/ktime.h>
 #include <sound/core.h>
 #include "hda_codec.h"
 #include <sound/asoundef.h>
@@ -253,6 +254,62 @@ static int codec_exec_verb(struct hda_codec *codec, unsigned int cmd,
 	return err;
 }
 
+/* max number of verbs collected on the stack for a batch */
+#define HDA_VERB_BATCH		64
+
+/*
+ * Send a batch of verbs to the codec
+ *
+ * The controller queues as many verbs as its command ring can take and
+ * waits once for all responses.  Whatever the batch op couldn't finish
+ * is sent one by one via codec_exec_verb(), which also takes care of
+ * the error recovery.  res may be NULL when no responses are needed.
+ */
+static int codec_exec_verbs(struct hda_codec *codec, const unsigned int *cmds,
+			    unsigned int *res, int count)
+{
+	struct hda_bus *bus = codec->bus;
+	int i, n, err, done = 0;
+
+	if (bus->ops.command_batch && count > 1) {
+		snd_hda_power_up(codec);
+		mutex_lock(&bus->cmd_mutex);
+		while (done < count) {
+			n = bus->ops.command_batch(bus, cmds + done,
+						   res ? res + done : NULL,
+						   count - done);
+			if (n <= 0)
+				break;
+			for (i = done; i < done + n; i++) {
+				trace_hda_send_cmd(codec, cmds[i]);
+				if (res)
+					trace_hda_get_response(codec, res[i]);
+			}
+			done += n;
+		}
+		mutex_unlock(&bus->cmd_mutex);
+		snd_hda_power_down(codec);
+		if (done < count && !codec_in_pm(codec) &&
+		    bus->rirb_error && bus->response_reset) {
+			snd_printd("hda_codec: resetting BUS due to "
+				   "fatal communication error\n");
+			trace_hda_bus_reset(bus);
+			bus->ops.bus_reset(bus);
+		}
+	}
+
+	for (; done < count; done++) {
+		unsigned int tmp;
+
+		err = codec_exec_verb(codec, cmds[done], 0,
+				      res ? res + done :
+				      (bus->sync_write ? &tmp : NULL));
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
 /**
  * snd_hda_codec_read - send a command and get the response
  * @codec: the HDA codec
@@ -305,12 +362,27 @@ EXPORT_SYMBOL_HDA(snd_hda_codec_write);
  * @seq: VERB array to send
  *
  * Send the commands sequentially from the given array.
+ * The commands are queued in batches when the controller supports it.
  * The array must be terminated with NID=0.
  */
 void snd_hda_sequence_write(struct hda_codec *codec, const struct hda_verb *seq)
 {
-	for (; seq->nid; seq++)
-		snd_hda_codec_write(codec, seq->nid, 0, seq->verb, seq->param);
+	unsigned int cmds[HDA_VERB_BATCH];
+	unsigned int cmd;
+	int n = 0;
+
+	for (; seq->nid; seq++) {
+		cmd = make_codec_cmd(codec, seq->nid, 0, seq->verb, seq->param);
+		if (cmd == ~0)
+			continue;
+		cmds[n++] = cmd;
+		if (n == ARRAY_SIZE(cmds)) {
+			codec_exec_verbs(codec, cmds, NULL, n);
+			n = 0;
+		}
+	}
+	if (n)
+		codec_exec_verbs(codec, cmds, NULL, n);
 }
 EXPORT_SYMBOL_HDA(snd_hda_sequence_write);
 
@@ -338,9 +410,7 @@ EXPORT_SYMBOL_HDA(snd_hda_get_sub_nodes);
 
 /* connection list element */
 struct hda_conn_list {
-	struct list_head list;
 	int len;
-	hda_nid_t nid;
 	hda_nid_t conns[0];
 };
 
@@ -348,36 +418,36 @@ struct hda_conn_list {
 static struct hda_conn_list *
 lookup_conn_list(struct hda_codec *codec, hda_nid_t nid)
 {
-	struct hda_conn_list *p;
-	list_for_each_entry(p, &codec->conn_list, list) {
-		if (p->nid == nid)
-			return p;
-	}
-	return NULL;
+	if (nid >= HDA_MAX_NODES)
+		return NULL;
+	return codec->conn_lists[nid];
 }
 
+/* store the list to the table, replacing the existing one */
 static int add_conn_list(struct hda_codec *codec, hda_nid_t nid, int len,
 			 const hda_nid_t *list)
 {
 	struct hda_conn_list *p;
 
+	if (nid >= HDA_MAX_NODES)
+		return -EINVAL;
 	p = kmalloc(sizeof(*p) + len * sizeof(hda_nid_t), GFP_KERNEL);
 	if (!p)
 		return -ENOMEM;
 	p->len = len;
-	p->nid = nid;
 	memcpy(p->conns, list, len * sizeof(hda_nid_t));
-	list_add(&p->list, &codec->conn_list);
+	kfree(codec->conn_lists[nid]);
+	codec->conn_lists[nid] = p;
 	return 0;
 }
 
 static void remove_conn_list(struct hda_codec *codec)
 {
-	while (!list_empty(&codec->conn_list)) {
-		struct hda_conn_list *p;
-		p = list_first_entry(&codec->conn_list, typeof(*p), list);
-		list_del(&p->list);
-		kfree(p);
+	int i;
+
+	for (i = 0; i < HDA_MAX_NODES; i++) {
+		kfree(codec->conn_lists[i]);
+		codec->conn_lists[i] = NULL;
 	}
 }
 
@@ -403,6 +473,20 @@ static int read_and_add_raw_conns(struct hda_codec *codec, hda_nid_t nid)
 	return len;
 }
 
+/* read all connection lists of the function group in advance */
+static void read_all_conn_lists(struct hda_codec *codec)
+{
+	hda_nid_t nid = codec->start_nid;
+	int i;
+
+	for (i = 0; i < codec->num_nodes; i++, nid++) {
+		if (!(get_wcaps(codec, nid) & AC_WCAP_CONN_LIST))
+			continue;
+		if (!lookup_conn_list(codec, nid))
+			read_and_add_raw_conns(codec, nid);
+	}
+}
+
 /**
  * snd_hda_get_conn_list - get connection list
  * @codec: the HDA codec
@@ -608,21 +692,13 @@ int snd_hda_get_raw_connections(struct hda_codec *codec, hda_nid_t nid,
  * @list: the list of connection entries
  *
  * Add or modify the given connection-list to the cache.  If the corresponding
- * cache already exists, invalidate it and append a new one.
+ * cache already exists, it's replaced with the new one.
  *
  * Returns zero or a negative error code.
  */
 int snd_hda_override_conn_list(struct hda_codec *codec, hda_nid_t nid, int len,
 			       const hda_nid_t *list)
 {
-	struct hda_conn_list *p;
-
-	p = lookup_conn_list(codec, nid);
-	if (p) {
-		list_del(&p->list);
-		kfree(p);
-	}
-
 	return add_conn_list(codec, nid, len, list);
 }
 EXPORT_SYMBOL_HDA(snd_hda_override_conn_list);
@@ -769,6 +845,7 @@ static int snd_hda_bus_free(struct hda_bus *bus)
 	list_for_each_entry_safe(codec, n, &bus->codec_list, list) {
 		snd_hda_codec_free(codec);
 	}
+	snd_hda_free_topologies(bus);
 	if (bus->ops.private_free)
 		bus->ops.private_free(bus);
 	if (bus->workq)
@@ -842,6 +919,7 @@ int snd_hda_bus_new(struct snd_card *card,
 	mutex_init(&bus->cmd_mutex);
 	mutex_init(&bus->prepare_mutex);
 	INIT_LIST_HEAD(&bus->codec_list);
+	INIT_LIST_HEAD(&bus->topologies);
 
 	snprintf(bus->workq_name, sizeof(bus->workq_name),
 		 "hd-audio%d", card->number);
@@ -858,6 +936,10 @@ int snd_hda_bus_new(struct snd_card *card,
 		snd_hda_bus_free(bus);
 		return err;
 	}
+	/* codecs create many controls; look them up via hash.
+	 * a failure is harmless, the linear search is used as fallback
+	 */
+	snd_ctl_enable_hash(card);
 	if (busp)
 		*busp = bus;
 	return 0;
@@ -1048,6 +1130,111 @@ static int read_pin_defaults(struct hda_codec *codec)
 	return 0;
 }
 
+#ifdef CONFIG_SND_HDA_PATCH_LOADER
+/* look for the topology snapshot matching with the codec IDs */
+static struct hda_topology *find_topology(struct hda_codec *codec)
+{
+	struct hda_topology *topo;
+
+	list_for_each_entry(topo, &codec->bus->topologies, list) {
+		if (topo->vendor_id == codec->vendor_id &&
+		    topo->subsystem_id == codec->subsystem_id &&
+		    topo->revision_id == codec->revision_id &&
+		    topo->nodes && topo->num_wcaps == topo->num_nodes)
+			return topo;
+	}
+	return NULL;
+}
+
+/* set up the function groups, widget caps, pin defaults, amp/pin caps
+ * and connection lists from the topology snapshot instead of reading
+ * them from the codec; only the node range of the function group is
+ * read for validation.
+ * returns -ENOENT if no valid snapshot is found.
+ */
+static int setup_from_topology(struct hda_codec *codec)
+{
+	struct hda_topology *topo = find_topology(codec);
+	struct hda_topology_node *node;
+	struct hda_pincfg *pin;
+	hda_nid_t fg, nid, start_nid;
+	int i, num_nodes, err;
+
+	if (!topo)
+		return -ENOENT;
+	fg = topo->afg ? topo->afg : topo->mfg;
+	if (!fg)
+		return -ENOENT;
+	num_nodes = snd_hda_get_sub_nodes(codec, fg, &start_nid);
+	if (num_nodes != topo->num_nodes || start_nid != topo->start_nid) {
+		snd_printk(KERN_WARNING "hda_codec: topology mismatch "
+			   "for codec %08x, ignored\n", codec->vendor_id);
+		return -ENOENT;
+	}
+
+	codec->wcaps = kmalloc(num_nodes * 4, GFP_KERNEL);
+	if (!codec->wcaps)
+		return -ENOMEM;
+	codec->afg = topo->afg;
+	codec->afg_function_id = topo->afg_function & 0xff;
+	codec->afg_unsol = (topo->afg_function >> 8) & 1;
+	codec->mfg = topo->mfg;
+	codec->mfg_function_id = topo->mfg_function & 0xff;
+	codec->mfg_unsol = (topo->mfg_function >> 8) & 1;
+	codec->start_nid = start_nid;
+	codec->num_nodes = num_nodes;
+	for (i = 0; i < num_nodes; i++)
+		codec->wcaps[i] = topo->nodes[i].wcaps;
+
+	nid = start_nid;
+	for (i = 0; i < num_nodes; i++, nid++) {
+		node = &topo->nodes[i];
+		if (node->flags & HDA_TOPO_AMP_CAPS) {
+			err = snd_hda_override_amp_caps(codec, nid, HDA_OUTPUT,
+						node->amp_caps[HDA_OUTPUT]);
+			if (!err)
+				err = snd_hda_override_amp_caps(codec, nid,
+						HDA_INPUT, node->amp_caps[HDA_INPUT]);
+			if (err < 0)
+				return err;
+		}
+		if (node->num_conns >= 0) {
+			err = add_conn_list(codec, nid, node->num_conns,
+					    node->conns);
+			if (err < 0)
+				return err;
+		}
+		if (get_wcaps_type(node->wcaps) != AC_WID_PIN)
+			continue;
+		if (node->flags & HDA_TOPO_PIN_CAPS) {
+			err = snd_hda_override_pin_caps(codec, nid,
+							node->pin_caps);
+			if (err < 0)
+				return err;
+		}
+		pin = snd_array_new(&codec->init_pins);
+		if (!pin)
+			return -ENOMEM;
+		pin->nid = nid;
+		if (node->flags & HDA_TOPO_PIN_CFG) {
+			pin->cfg = node->pin_cfg;
+			pin->ctrl = node->pin_ctl;
+		} else {
+			pin->cfg = snd_hda_codec_read(codec, nid, 0,
+						AC_VERB_GET_CONFIG_DEFAULT, 0);
+			pin->ctrl = snd_hda_codec_read(codec, nid, 0,
+						AC_VERB_GET_PIN_WIDGET_CONTROL, 0);
+		}
+	}
+	return 0;
+}
+#else
+static inline int setup_from_topology(struct hda_codec *codec)
+{
+	return -ENOENT;
+}
+#endif /* CONFIG_SND_HDA_PATCH_LOADER */
+
 /* look up the given pin config list and return the item matching with NID */
 static struct hda_pincfg *look_up_pincfg(struct hda_codec *codec,
 					 struct snd_array *array,
@@ -1225,9 +1412,10 @@ static void hda_jackpoll_work(struct work_struct *work)
 			   codec->jackpoll_interval);
 }
 
-static void init_hda_cache(struct hda_cache_rec *cache,
-			   unsigned int record_size);
+static void init_hda_cache(struct hda_cache_rec *cache);
 static void free_hda_cache(struct hda_cache_rec *cache);
+static void init_amp_cache(struct hda_amp_cache *cache);
+static void free_amp_cache(struct hda_amp_cache *cache);
 
 /* release all pincfg lists */
 static void free_init_pincfgs(struct hda_codec *codec)
@@ -1269,6 +1457,22 @@ get_hda_cvt_setup(struct hda_codec *codec, hda_nid_t nid)
 	return p;
 }
 
+/* release the lazy controls; remove the instantiated ones if @remove */
+static void free_lazy_ctls(struct hda_codec *codec, bool remove)
+{
+	struct hda_lazy_ctl **lctls = codec->lazy_ctls.list;
+	int i;
+
+	for (i = 0; i < codec->lazy_ctls.used; i++) {
+		/* no instantiation can happen after this */
+		snd_ctl_remove_lazy(codec->bus->card, &lctls[i]->lazy);
+		if (remove && lctls[i]->kctl)
+			snd_ctl_remove(codec->bus->card, lctls[i]->kctl);
+		kfree(lctls[i]);
+	}
+	snd_array_free(&codec->lazy_ctls);
+}
+
 /*
  * codec destructor
  */
@@ -1286,6 +1490,7 @@ static void snd_hda_codec_free(struct hda_codec *codec)
 	list_del(&codec->list);
 	snd_array_free(&codec->mixers);
 	snd_array_free(&codec->nids);
+	free_lazy_ctls(codec, false);
 	snd_array_free(&codec->cvt_setups);
 	snd_array_free(&codec->spdif_out);
 	remove_conn_list(codec);
@@ -1297,7 +1502,7 @@ static void snd_hda_codec_free(struct hda_codec *codec)
 		hda_call_pm_notify(codec->bus, false);
 #endif
 	module_put(codec->owner);
-	free_hda_cache(&codec->amp_cache);
+	free_amp_cache(&codec->amp_cache);
 	free_hda_cache(&codec->cmd_cache);
 	kfree(codec->vendor_name);
 	kfree(codec->chip_name);
@@ -1351,17 +1556,17 @@ int snd_hda_codec_new(struct hda_bus *bus,
 	mutex_init(&codec->spdif_mutex);
 	mutex_init(&codec->control_mutex);
 	mutex_init(&codec->hash_mutex);
-	init_hda_cache(&codec->amp_cache, sizeof(struct hda_amp_info));
-	init_hda_cache(&codec->cmd_cache, sizeof(struct hda_cache_head));
+	init_amp_cache(&codec->amp_cache);
+	init_hda_cache(&codec->cmd_cache);
 	snd_array_init(&codec->mixers, sizeof(struct hda_nid_item), 32);
 	snd_array_init(&codec->nids, sizeof(struct hda_nid_item), 32);
+	snd_array_init(&codec->lazy_ctls, sizeof(struct hda_lazy_ctl *), 16);
 	snd_array_init(&codec->init_pins, sizeof(struct hda_pincfg), 16);
 	snd_array_init(&codec->driver_pins, sizeof(struct hda_pincfg), 16);
 	snd_array_init(&codec->cvt_setups, sizeof(struct hda_cvt_setup), 8);
 	snd_array_init(&codec->spdif_out, sizeof(struct hda_spdif_out), 16);
 	snd_array_init(&codec->jacktbl, sizeof(struct hda_jack_tbl), 16);
 	snd_array_init(&codec->verbs, sizeof(struct hda_verb *), 8);
-	INIT_LIST_HEAD(&codec->conn_list);
 
 	INIT_DELAYED_WORK(&codec->jackpoll_work, hda_jackpoll_work);
 
@@ -1400,28 +1605,41 @@ int snd_hda_codec_new(struct hda_bus *bus,
 	codec->revision_id = snd_hda_param_read(codec, AC_NODE_ROOT,
 						AC_PAR_REV_ID);
 
-	setup_fg_nodes(codec);
-	if (!codec->afg && !codec->mfg) {
-		snd_printdd("hda_codec: no AFG or MFG node found\n");
-		err = -ENODEV;
-		goto error;
-	}
+	if (!codec->subsystem_id) {
+		/* read it from the function group before the topology
+		 * lookup, which matches with the subsystem id, too
+		 */
+		setup_fg_nodes(codec);
+		fg = codec->afg ? codec->afg : codec->mfg;
+		if (fg)
+			codec->subsystem_id =
+				snd_hda_codec_read(codec, fg, 0,
+						   AC_VERB_GET_SUBSYSTEM_ID, 0);
+	}
+
+	/* reuse the topology snapshot from the patch if available */
+	err = setup_from_topology(codec);
+	if (err == -ENOENT) {
+		if (!codec->afg && !codec->mfg)
+			setup_fg_nodes(codec);
+		if (!codec->afg && !codec->mfg) {
+			snd_printdd("hda_codec: no AFG or MFG node found\n");
+			err = -ENODEV;
+			goto error;
+		}
 
-	fg = codec->afg ? codec->afg : codec->mfg;
-	err = read_widget_caps(codec, fg);
-	if (err < 0) {
-		snd_printk(KERN_ERR "hda_codec: cannot malloc\n");
-		goto error;
+		fg = codec->afg ? codec->afg : codec->mfg;
+		err = read_widget_caps(codec, fg);
+		if (err < 0) {
+			snd_printk(KERN_ERR "hda_codec: cannot malloc\n");
+			goto error;
+		}
+		err = read_pin_defaults(codec);
 	}
-	err = read_pin_defaults(codec);
 	if (err < 0)
 		goto error;
-
-	if (!codec->subsystem_id) {
-		codec->subsystem_id =
-			snd_hda_codec_read(codec, fg, 0,
-					   AC_VERB_GET_SUBSYSTEM_ID, 0);
-	}
+	fg = codec->afg ? codec->afg : codec->mfg;
+	read_all_conn_lists(codec);
 
 #ifdef CONFIG_PM
 	codec->d3_stop_clk = snd_hda_codec_get_supported_ps(codec, fg,
@@ -1471,8 +1689,13 @@ int snd_hda_codec_update_widgets(struct hda_codec *codec)
 
 	snd_array_free(&codec->init_pins);
 	err = read_pin_defaults(codec);
+	if (err < 0)
+		return err;
 
-	return err;
+	/* the connections may change together with the widgets */
+	remove_conn_list(codec);
+	read_all_conn_lists(codec);
+	return 0;
 }
 EXPORT_SYMBOL_HDA(snd_hda_codec_update_widgets);
 
@@ -1692,21 +1915,23 @@ static void hda_cleanup_all_streams(struct hda_codec *codec)
  * amp access functions
  */
 
-/* FIXME: more better hash key? */
-#define HDA_HASH_KEY(nid, dir, idx) (u32)((nid) + ((idx) << 16) + ((dir) << 24))
-#define HDA_HASH_PINCAP_KEY(nid) (u32)((nid) + (0x02 << 24))
-#define HDA_HASH_PARPCM_KEY(nid) (u32)((nid) + (0x03 << 24))
-#define HDA_HASH_PARSTR_KEY(nid) (u32)((nid) + (0x04 << 24))
+/* amp cache types; HDA_OUTPUT and HDA_INPUT are for amps */
+#define HDA_CACHE_PINCAP	2
+#define HDA_CACHE_PARPCM	3
+#define HDA_CACHE_PARSTR	4
 #define INFO_AMP_CAPS	(1<<0)
 #define INFO_AMP_VOL(ch)	(1 << (1 + (ch)))
+#define INFO_AMP_DEF(ch)	(1 << (3 + (ch)))
 
-/* initialize the hash table */
-static void init_hda_cache(struct hda_cache_rec *cache,
-				     unsigned int record_size)
+/* the amp index in verbs is 4 bits wide */
+#define HDA_MAX_AMP_INDEX	16
+
+/* initialize the command cache */
+static void init_hda_cache(struct hda_cache_rec *cache)
 {
 	memset(cache, 0, sizeof(*cache));
-	memset(cache->hash, 0xff, sizeof(cache->hash));
-	snd_array_init(&cache->buf, record_size, 64);
+	memset(cache->head, 0xff, sizeof(cache->head));
+	snd_array_init(&cache->buf, sizeof(struct hda_cache_head), 64);
 }
 
 static void free_hda_cache(struct hda_cache_rec *cache)
@@ -1714,64 +1939,133 @@ static void free_hda_cache(struct hda_cache_rec *cache)
 	snd_array_free(&cache->buf);
 }
 
-/* query the hash.  allocate an entry if not found. */
-static struct hda_cache_head  *get_hash(struct hda_cache_rec *cache, u32 key)
+/* look up the entry in the chain of the NID given by the key */
+static struct hda_cache_head *get_cmd_cache(struct hda_cache_rec *cache,
+					    u32 key)
 {
-	u16 idx = key % (u16)ARRAY_SIZE(cache->hash);
-	u16 cur = cache->hash[idx];
+	unsigned int nid = key & 0xff;
 	struct hda_cache_head *info;
+	u16 cur;
 
-	while (cur != 0xffff) {
+	if (nid >= HDA_MAX_NODES)
+		return NULL;
+	for (cur = cache->head[nid]; cur != 0xffff; cur = info->next) {
 		info = snd_array_elem(&cache->buf, cur);
 		if (info->key == key)
 			return info;
-		cur = info->next;
 	}
 	return NULL;
 }
 
-/* query the hash.  allocate an entry if not found. */
-static struct hda_cache_head  *get_alloc_hash(struct hda_cache_rec *cache,
-					      u32 key)
+/* look up the entry.  allocate an entry if not found. */
+static struct hda_cache_head *get_alloc_cmd_cache(struct hda_cache_rec *cache,
+						  u32 key)
 {
-	struct hda_cache_head *info = get_hash(cache, key);
-	if (!info) {
-		u16 idx, cur;
-		/* add a new hash entry */
+	struct hda_cache_head *info = get_cmd_cache(cache, key);
+	unsigned int nid = key & 0xff;
+
+	if (!info && nid < HDA_MAX_NODES) {
+		/* add a new entry at the head of the NID chain */
 		info = snd_array_new(&cache->buf);
 		if (!info)
 			return NULL;
-		cur = snd_array_index(&cache->buf, info);
 		info->key = key;
 		info->val = 0;
 		info->dirty = 0;
-		idx = key % (u16)ARRAY_SIZE(cache->hash);
-		info->next = cache->hash[idx];
-		cache->hash[idx] = cur;
+		info->def_known = 0;
+		info->def = 0;
+		info->next = cache->head[nid];
+		cache->head[nid] = snd_array_index(&cache->buf, info);
 	}
 	return info;
 }
 
-/* query and allocate an amp hash entry */
-static inline struct hda_amp_info *
-get_alloc_amp_hash(struct hda_codec *codec, u32 key)
+static void init_amp_cache(struct hda_amp_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+}
+
+static void free_amp_cache(struct hda_amp_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->num_nodes; i++) {
+		kfree(cache->nodes[i].amp[HDA_OUTPUT]);
+		kfree(cache->nodes[i].amp[HDA_INPUT]);
+	}
+	kfree(cache->nodes);
+	init_amp_cache(cache);
+}
+
+/* get the amp cache node of the given NID; the table is sized to cover
+ * all widgets of the function group at once
+ */
+static struct hda_amp_node *get_amp_node(struct hda_codec *codec,
+					 hda_nid_t nid)
+{
+	struct hda_amp_cache *cache = &codec->amp_cache;
+	struct hda_amp_node *nodes;
+	unsigned int num;
+
+	if (nid < cache->num_nodes)
+		return &cache->nodes[nid];
+	if (nid >= HDA_MAX_NODES)
+		return NULL;
+	num = max_t(unsigned int, nid + 1, codec->start_nid + codec->num_nodes);
+	num = min_t(unsigned int, num, HDA_MAX_NODES);
+	nodes = krealloc(cache->nodes, num * sizeof(*nodes), GFP_KERNEL);
+	if (!nodes)
+		return NULL;
+	memset(nodes + cache->num_nodes, 0,
+	       (num - cache->num_nodes) * sizeof(*nodes));
+	cache->nodes = nodes;
+	cache->num_nodes = num;
+	return &nodes[nid];
+}
+
+/* query and allocate an amp cache entry;
+ * type is either HDA_OUTPUT, HDA_INPUT or HDA_CACHE_*
+ */
+static struct hda_amp_info *
+get_alloc_amp_hash(struct hda_codec *codec, hda_nid_t nid, int type, int idx)
 {
-	return (struct hda_amp_info *)get_alloc_hash(&codec->amp_cache, key);
+	struct hda_amp_node *node = get_amp_node(codec, nid);
+	struct hda_amp_info *amp;
+	unsigned int num;
+
+	if (!node)
+		return NULL;
+	if (type >= HDA_CACHE_PINCAP)
+		return &node->caps[type - HDA_CACHE_PINCAP];
+	if (idx < node->num_amps[type])
+		return &node->amp[type][idx];
+	if (idx >= HDA_MAX_AMP_INDEX)
+		return NULL;
+	num = idx + 1;
+	amp = krealloc(node->amp[type], num * sizeof(*amp), GFP_KERNEL);
+	if (!amp)
+		return NULL;
+	memset(amp + node->num_amps[type], 0,
+	       (num - node->num_amps[type]) * sizeof(*amp));
+	node->amp[type] = amp;
+	node->num_amps[type] = num;
+	return &amp[idx];
 }
 
-/* overwrite the value with the key in the caps hash */
-static int write_caps_hash(struct hda_codec *codec, u32 key, unsigned int val)
+/* overwrite the value of the given type in the caps hash */
+static int write_caps_hash(struct hda_codec *codec, hda_nid_t nid, int type,
+			   unsigned int val)
 {
 	struct hda_amp_info *info;
 
 	mutex_lock(&codec->hash_mutex);
-	info = get_alloc_amp_hash(codec, key);
+	info = get_alloc_amp_hash(codec, nid, type, 0);
 	if (!info) {
 		mutex_unlock(&codec->hash_mutex);
 		return -EINVAL;
 	}
 	info->amp_caps = val;
-	info->head.val |= INFO_AMP_CAPS;
+	info->status |= INFO_AMP_CAPS;
 	mutex_unlock(&codec->hash_mutex);
 	return 0;
 }
@@ -1780,22 +2074,22 @@ static int write_caps_hash(struct hda_codec *codec, u32 key, unsigned int val)
  * value from the given function and store in the hash
  */
 static unsigned int
-query_caps_hash(struct hda_codec *codec, hda_nid_t nid, int dir, u32 key,
+query_caps_hash(struct hda_codec *codec, hda_nid_t nid, int type,
 		unsigned int (*func)(struct hda_codec *, hda_nid_t, int))
 {
 	struct hda_amp_info *info;
 	unsigned int val;
 
 	mutex_lock(&codec->hash_mutex);
-	info = get_alloc_amp_hash(codec, key);
+	info = get_alloc_amp_hash(codec, nid, type, 0);
 	if (!info) {
 		mutex_unlock(&codec->hash_mutex);
 		return 0;
 	}
-	if (!(info->head.val & INFO_AMP_CAPS)) {
+	if (!(info->status & INFO_AMP_CAPS)) {
 		mutex_unlock(&codec->hash_mutex); /* for reentrance */
-		val = func(codec, nid, dir);
-		write_caps_hash(codec, key, val);
+		val = func(codec, nid, type);
+		write_caps_hash(codec, nid, type, val);
 	} else {
 		val = info->amp_caps;
 		mutex_unlock(&codec->hash_mutex);
@@ -1827,9 +2121,7 @@ static unsigned int read_amp_cap(struct hda_codec *codec, hda_nid_t nid,
  */
 u32 query_amp_caps(struct hda_codec *codec, hda_nid_t nid, int direction)
 {
-	return query_caps_hash(codec, nid, direction,
-			       HDA_HASH_KEY(nid, direction, 0),
-			       read_amp_cap);
+	return query_caps_hash(codec, nid, direction, read_amp_cap);
 }
 EXPORT_SYMBOL_HDA(query_amp_caps);
 
@@ -1849,7 +2141,7 @@ EXPORT_SYMBOL_HDA(query_amp_caps);
 int snd_hda_override_amp_caps(struct hda_codec *codec, hda_nid_t nid, int dir,
 			      unsigned int caps)
 {
-	return write_caps_hash(codec, HDA_HASH_KEY(nid, dir, 0), caps);
+	return write_caps_hash(codec, nid, dir, caps);
 }
 EXPORT_SYMBOL_HDA(snd_hda_override_amp_caps);
 
@@ -1872,8 +2164,7 @@ static unsigned int read_pin_cap(struct hda_codec *codec, hda_nid_t nid,
  */
 u32 snd_hda_query_pin_caps(struct hda_codec *codec, hda_nid_t nid)
 {
-	return query_caps_hash(codec, nid, 0, HDA_HASH_PINCAP_KEY(nid),
-			       read_pin_cap);
+	return query_caps_hash(codec, nid, HDA_CACHE_PINCAP, read_pin_cap);
 }
 EXPORT_SYMBOL_HDA(snd_hda_query_pin_caps);
 
@@ -1890,7 +2181,7 @@ EXPORT_SYMBOL_HDA(snd_hda_query_pin_caps);
 int snd_hda_override_pin_caps(struct hda_codec *codec, hda_nid_t nid,
 			      unsigned int caps)
 {
-	return write_caps_hash(codec, HDA_HASH_PINCAP_KEY(nid), caps);
+	return write_caps_hash(codec, nid, HDA_CACHE_PINCAP, caps);
 }
 EXPORT_SYMBOL_HDA(snd_hda_override_pin_caps);
 
@@ -1906,10 +2197,10 @@ update_amp_hash(struct hda_codec *codec, hda_nid_t nid, int ch,
 	bool val_read = false;
 
  retry:
-	info = get_alloc_amp_hash(codec, HDA_HASH_KEY(nid, direction, index));
+	info = get_alloc_amp_hash(codec, nid, direction, index);
 	if (!info)
 		return NULL;
-	if (!(info->head.val & INFO_AMP_VOL(ch))) {
+	if (!(info->status & INFO_AMP_VOL(ch))) {
 		if (!val_read) {
 			mutex_unlock(&codec->hash_mutex);
 			parm = ch ? AC_AMP_GET_RIGHT : AC_AMP_GET_LEFT;
@@ -1924,18 +2215,15 @@ update_amp_hash(struct hda_codec *codec, hda_nid_t nid, int ch,
 			goto retry;
 		}
 		info->vol[ch] = val;
-		info->head.val |= INFO_AMP_VOL(ch);
+		info->status |= INFO_AMP_VOL(ch);
 	} else if (init_only)
 		return NULL;
 	return info;
 }
 
-/*
- * write the current volume in info to the h/w
- */
-static void put_vol_mute(struct hda_codec *codec, unsigned int amp_caps,
-			 hda_nid_t nid, int ch, int direction, int index,
-			 int val)
+/* build the parameter of AC_VERB_SET_AMP_GAIN_MUTE for the given volume */
+static u32 get_vol_mute_parm(unsigned int amp_caps, int ch, int direction,
+			     int index, int val)
 {
 	u32 parm;
 
@@ -1947,7 +2235,19 @@ static void put_vol_mute(struct hda_codec *codec, unsigned int amp_caps,
 		; /* set the zero value as a fake mute */
 	else
 		parm |= val;
-	snd_hda_codec_write(codec, nid, 0, AC_VERB_SET_AMP_GAIN_MUTE, parm);
+	return parm;
+}
+
+/*
+ * write the current volume in info to the h/w
+ */
+static void put_vol_mute(struct hda_codec *codec, unsigned int amp_caps,
+			 hda_nid_t nid, int ch, int direction, int index,
+			 int val)
+{
+	snd_hda_codec_write(codec, nid, 0, AC_VERB_SET_AMP_GAIN_MUTE,
+			    get_vol_mute_parm(amp_caps, ch, direction, index,
+					      val));
 }
 
 /**
@@ -1999,7 +2299,9 @@ static int codec_amp_update(struct hda_codec *codec, hda_nid_t nid, int ch,
 		return 0;
 	}
 	info->vol[ch] = val;
-	cache_only = info->head.dirty = codec->cached_write;
+	cache_only = info->dirty = codec->cached_write;
+	if (cache_only)
+		set_bit(nid, codec->amp_cache.dirty);
 	caps = info->amp_caps;
 	mutex_unlock(&codec->hash_mutex);
 	if (!cache_only)
@@ -2078,46 +2380,73 @@ int snd_hda_codec_amp_init_stereo(struct hda_codec *codec, hda_nid_t nid,
 }
 EXPORT_SYMBOL_HDA(snd_hda_codec_amp_init_stereo);
 
+/* count the verbs replayed during resume for the proc output */
+#ifdef CONFIG_PM
+#define count_resume_verbs(codec, n) \
+	do { if ((codec)->in_pm) (codec)->resume_verbs += (n); } while (0)
+#else
+#define count_resume_verbs(codec, n)	do { } while (0)
+#endif
+
 /**
  * snd_hda_codec_resume_amp - Resume all AMP commands from the cache
  * @codec: HD-audio codec
  *
  * Resume the all amp commands from the cache.
+ * The dirty amps are written in batches.
  */
 void snd_hda_codec_resume_amp(struct hda_codec *codec)
 {
-	int i;
+	struct hda_amp_cache *cache = &codec->amp_cache;
+	unsigned int cmds[HDA_VERB_BATCH];
+	unsigned int nid, idx, dir, ch, cmd;
+	u32 parm;
+	int n = 0;
 
 	mutex_lock(&codec->hash_mutex);
 	codec->cached_write = 0;
-	for (i = 0; i < codec->amp_cache.buf.used; i++) {
-		struct hda_amp_info *buffer;
-		u32 key;
-		hda_nid_t nid;
-		unsigned int idx, dir, ch;
-		struct hda_amp_info info;
-
-		buffer = snd_array_elem(&codec->amp_cache.buf, i);
-		if (!buffer->head.dirty)
-			continue;
-		buffer->head.dirty = 0;
-		info = *buffer;
-		key = info.head.key;
-		if (!key)
-			continue;
-		nid = key & 0xff;
-		idx = (key >> 16) & 0xff;
-		dir = (key >> 24) & 0xff;
-		for (ch = 0; ch < 2; ch++) {
-			if (!(info.head.val & INFO_AMP_VOL(ch)))
-				continue;
-			mutex_unlock(&codec->hash_mutex);
-			put_vol_mute(codec, info.amp_caps, nid, ch, dir, idx,
-				     info.vol[ch]);
-			mutex_lock(&codec->hash_mutex);
+	for_each_set_bit(nid, cache->dirty, HDA_MAX_NODES) {
+		clear_bit(nid, cache->dirty);
+		for (dir = 0; dir < 2; dir++) {
+			/* the node may be reallocated while unlocked */
+			for (idx = 0; idx < cache->nodes[nid].num_amps[dir];
+			     idx++) {
+				struct hda_amp_info *buffer;
+				struct hda_amp_info info;
+
+				buffer = &cache->nodes[nid].amp[dir][idx];
+				if (!buffer->dirty)
+					continue;
+				buffer->dirty = 0;
+				info = *buffer;
+				for (ch = 0; ch < 2; ch++) {
+					if (!(info.status & INFO_AMP_VOL(ch)))
+						continue;
+					parm = get_vol_mute_parm(info.amp_caps,
+								 ch, dir, idx,
+								 info.vol[ch]);
+					cmd = make_codec_cmd(codec, nid, 0,
+						AC_VERB_SET_AMP_GAIN_MUTE,
+						parm);
+					if (cmd == ~0)
+						continue;
+					cmds[n++] = cmd;
+					if (n < ARRAY_SIZE(cmds))
+						continue;
+					mutex_unlock(&codec->hash_mutex);
+					codec_exec_verbs(codec, cmds, NULL, n);
+					count_resume_verbs(codec, n);
+					n = 0;
+					mutex_lock(&codec->hash_mutex);
+				}
+			}
 		}
 	}
 	mutex_unlock(&codec->hash_mutex);
+	if (n) {
+		codec_exec_verbs(codec, cmds, NULL, n);
+		count_resume_verbs(codec, n);
+	}
 }
 EXPORT_SYMBOL_HDA(snd_hda_codec_resume_amp);
 
@@ -2314,21 +2643,44 @@ void snd_hda_set_vmaster_tlv(struct hda_codec *codec, hda_nid_t nid, int dir,
 }
 EXPORT_SYMBOL_HDA(snd_hda_set_vmaster_tlv);
 
+static int set_mixer_ctl_id(struct snd_ctl_elem_id *id, const char *name,
+			    int dev, int idx)
+{
+	memset(id, 0, sizeof(*id));
+	id->iface = SNDRV_CTL_ELEM_IFACE_MIXER;
+	id->device = dev;
+	id->index = idx;
+	if (snd_BUG_ON(strlen(name) >= sizeof(id->name)))
+		return -EINVAL;
+	strcpy(id->name, name);
+	return 0;
+}
+
 /* find a mixer control element with the given name */
 static struct snd_kcontrol *
 find_mixer_ctl(struct hda_codec *codec, const char *name, int dev, int idx)
 {
 	struct snd_ctl_elem_id id;
-	memset(&id, 0, sizeof(id));
-	id.iface = SNDRV_CTL_ELEM_IFACE_MIXER;
-	id.device = dev;
-	id.index = idx;
-	if (snd_BUG_ON(strlen(name) >= sizeof(id.name)))
+
+	if (set_mixer_ctl_id(&id, name, dev, idx) < 0)
 		return NULL;
-	strcpy(id.name, name);
 	return snd_ctl_find_id(codec->bus->card, &id);
 }
 
+/* check whether a mixer control element with the given name is
+ * added, either as an instance or as a lazy control
+ */
+static bool mixer_ctl_exists(struct hda_codec *codec, const char *name,
+			     int dev, int idx)
+{
+	struct snd_ctl_elem_id id;
+
+	if (set_mixer_ctl_id(&id, name, dev, idx) < 0)
+		return false;
+	return snd_ctl_find_id(codec->bus->card, &id) ||
+		snd_ctl_find_lazy(codec->bus->card, &id);
+}
+
 /**
  * snd_hda_find_mixer_ctl - Find a mixer control element with the given name
  * @codec: HD-audio codec
@@ -2349,7 +2701,7 @@ static int find_empty_mixer_ctl_idx(struct hda_codec *codec, const char *name,
 	int i, idx;
 	/* 16 ctlrs should be large enough */
 	for (i = 0, idx = start_idx; i < 16; i++, idx++) {
-		if (!find_mixer_ctl(codec, name, 0, idx))
+		if (!mixer_ctl_exists(codec, name, 0, idx))
 			return idx;
 	}
 	return -EBUSY;
@@ -2403,6 +2755,60 @@ int snd_hda_ctl_add(struct hda_codec *codec, hda_nid_t nid,
 }
 EXPORT_SYMBOL_HDA(snd_hda_ctl_add);
 
+/*
+ * remember the instantiated control in the descriptor; codec->mixers
+ * isn't touched here since it's read without lock by the proc file
+ */
+static int hda_lazy_ctl_instantiate(struct snd_kcontrol_lazy *lazy,
+				    struct snd_kcontrol *kctl)
+{
+	struct hda_lazy_ctl *lctl = container_of(lazy, struct hda_lazy_ctl,
+						 lazy);
+
+	lctl->kctl = kctl;
+	return 0;
+}
+
+/**
+ * snd_hda_ctl_add_lazy - Add a control element created on demand
+ * @codec: HD-audio codec
+ * @nid: corresponding NID (optional)
+ * @knew: the control template
+ * @index: the control index
+ * @private_value: the private value of the control
+ *
+ * Like snd_hda_ctl_add(), but the control instance is created only when
+ * user-space accesses the controls of the card, see snd_ctl_add_lazy().
+ * Until then, the control isn't found via snd_hda_find_mixer_ctl(), so
+ * this is only for controls which the driver never looks up, such as
+ * the SPDIF controls of HDMI codecs.  The template must be kept as long
+ * as the codec exists.
+ */
+int snd_hda_ctl_add_lazy(struct hda_codec *codec, hda_nid_t nid,
+			 const struct snd_kcontrol_new *knew,
+			 unsigned int index, unsigned long private_value)
+{
+	struct hda_lazy_ctl *lctl, **p;
+
+	lctl = kzalloc(sizeof(*lctl), GFP_KERNEL);
+	if (!lctl)
+		return -ENOMEM;
+	p = snd_array_new(&codec->lazy_ctls);
+	if (!p) {
+		kfree(lctl);
+		return -ENOMEM;
+	}
+	*p = lctl;
+	snd_ctl_lazy_init(&lctl->lazy, knew, codec);
+	lctl->lazy.id.index = index;
+	lctl->lazy.private_value = private_value;
+	lctl->lazy.instantiate = hda_lazy_ctl_instantiate;
+	lctl->codec = codec;
+	lctl->nid = nid;
+	return snd_ctl_add_lazy(codec->bus->card, &lctl->lazy);
+}
+EXPORT_SYMBOL_HDA(snd_hda_ctl_add_lazy);
+
 /**
  * snd_hda_add_nid - Assign a NID to a control element
  * @codec: HD-audio codec
@@ -2446,6 +2852,7 @@ void snd_hda_ctls_clear(struct hda_codec *codec)
 		snd_ctl_remove(codec->bus->card, items[i].kctl);
 	snd_array_free(&codec->mixers);
 	snd_array_free(&codec->nids);
+	free_lazy_ctls(codec, true);
 }
 
 /* pseudo device locking
@@ -2539,10 +2946,10 @@ int snd_hda_codec_reset(struct hda_codec *codec)
 	snd_hda_jack_tbl_clear(codec);
 	codec->proc_widget_hook = NULL;
 	codec->spec = NULL;
-	free_hda_cache(&codec->amp_cache);
+	free_amp_cache(&codec->amp_cache);
 	free_hda_cache(&codec->cmd_cache);
-	init_hda_cache(&codec->amp_cache, sizeof(struct hda_amp_info));
-	init_hda_cache(&codec->cmd_cache, sizeof(struct hda_cache_head));
+	init_amp_cache(&codec->amp_cache);
+	init_hda_cache(&codec->cmd_cache);
 	/* free only driver_pins so that init_pins + user_pins are restored */
 	snd_array_free(&codec->driver_pins);
 	snd_array_free(&codec->cvt_setups);
@@ -3354,6 +3761,15 @@ int snd_hda_create_dig_out_ctls(struct hda_codec *codec,
 	if (!spdif)
 		return -ENOMEM;
 	for (dig_mix = dig_mixes; dig_mix->name; dig_mix++) {
+		if (type == HDA_PCM_TYPE_HDMI) {
+			/* not looked up by anyone, create them on demand */
+			err = snd_hda_ctl_add_lazy(codec, associated_nid,
+						   dig_mix, idx,
+						   codec->spdif_out.used - 1);
+			if (err < 0)
+				return err;
+			continue;
+		}
 		kctl = snd_ctl_new1(dig_mix, codec);
 		if (!kctl)
 			return -ENOMEM;
@@ -3612,10 +4028,12 @@ int snd_hda_codec_write_cache(struct hda_codec *codec, hda_nid_t nid,
 	parm &= 0xff;
 	key = build_cmd_cache_key(nid, verb);
 	mutex_lock(&codec->bus->cmd_mutex);
-	c = get_alloc_hash(&codec->cmd_cache, key);
+	c = get_alloc_cmd_cache(&codec->cmd_cache, key);
 	if (c) {
 		c->val = parm;
 		c->dirty = cache_only;
+		if (cache_only)
+			set_bit(nid, codec->cmd_cache.dirty);
 	}
 	mutex_unlock(&codec->bus->cmd_mutex);
 	return 0;
@@ -3647,7 +4065,7 @@ int snd_hda_codec_update_cache(struct hda_codec *codec, hda_nid_t nid,
 	parm &= 0xff;
 	key = build_cmd_cache_key(nid, verb);
 	mutex_lock(&codec->bus->cmd_mutex);
-	c = get_hash(&codec->cmd_cache, key);
+	c = get_cmd_cache(&codec->cmd_cache, key);
 	if (c && c->val == parm) {
 		mutex_unlock(&codec->bus->cmd_mutex);
 		return 0;
@@ -3662,30 +4080,49 @@ EXPORT_SYMBOL_HDA(snd_hda_codec_update_cache);
  * @codec: HD-audio codec
  *
  * Execute all verbs recorded in the command caches to resume.
+ * The verbs are sent in batches.
  */
 void snd_hda_codec_resume_cache(struct hda_codec *codec)
 {
-	int i;
+	struct hda_cache_rec *cache = &codec->cmd_cache;
+	struct hda_cache_head *buffer;
+	unsigned int cmds[HDA_VERB_BATCH];
+	unsigned int nid, cmd;
+	int n = 0;
+	u16 cur;
 
 	mutex_lock(&codec->hash_mutex);
 	codec->cached_write = 0;
-	for (i = 0; i < codec->cmd_cache.buf.used; i++) {
-		struct hda_cache_head *buffer;
-		u32 key;
-
-		buffer = snd_array_elem(&codec->cmd_cache.buf, i);
-		key = buffer->key;
-		if (!key)
-			continue;
-		if (!buffer->dirty)
-			continue;
-		buffer->dirty = 0;
-		mutex_unlock(&codec->hash_mutex);
-		snd_hda_codec_write(codec, get_cmd_cache_nid(key), 0,
-				    get_cmd_cache_cmd(key), buffer->val);
-		mutex_lock(&codec->hash_mutex);
+	for_each_set_bit(nid, cache->dirty, HDA_MAX_NODES) {
+		clear_bit(nid, cache->dirty);
+		for (cur = cache->head[nid]; cur != 0xffff;
+		     cur = buffer->next) {
+			buffer = snd_array_elem(&cache->buf, cur);
+			if (!buffer->dirty)
+				continue;
+			buffer->dirty = 0;
+			cmd = make_codec_cmd(codec, nid, 0,
+					     get_cmd_cache_cmd(buffer->key),
+					     buffer->val);
+			if (cmd == ~0)
+				continue;
+			cmds[n++] = cmd;
+			if (n == ARRAY_SIZE(cmds)) {
+				mutex_unlock(&codec->hash_mutex);
+				codec_exec_verbs(codec, cmds, NULL, n);
+				count_resume_verbs(codec, n);
+				n = 0;
+				mutex_lock(&codec->hash_mutex);
+				/* the array may be reallocated meanwhile */
+				buffer = snd_array_elem(&cache->buf, cur);
+			}
+		}
 	}
 	mutex_unlock(&codec->hash_mutex);
+	if (n) {
+		codec_exec_verbs(codec, cmds, NULL, n);
+		count_resume_verbs(codec, n);
+	}
 }
 EXPORT_SYMBOL_HDA(snd_hda_codec_resume_cache);
 
@@ -3902,19 +4339,183 @@ static unsigned int hda_call_codec_suspend(struct hda_codec *codec, bool in_wq)
 	return state;
 }
 
-/* mark all entries of cmd and amp caches dirty */
-static void hda_mark_cmd_cache_dirty(struct hda_codec *codec)
+/* return the verb to read back the h/w value of the given cached verb,
+ * or zero if the value can't be compared with the cached one
+ */
+static unsigned int get_cmd_cache_def_verb(unsigned int verb)
+{
+	switch (verb) {
+	case AC_VERB_SET_CONNECT_SEL:
+	case AC_VERB_SET_PIN_WIDGET_CONTROL:
+	case AC_VERB_SET_UNSOLICITED_ENABLE:
+	case AC_VERB_SET_EAPD_BTLENABLE:
+	case AC_VERB_SET_DIGI_CONVERT_1:
+	case AC_VERB_SET_GPIO_DATA:
+	case AC_VERB_SET_GPIO_MASK:
+	case AC_VERB_SET_GPIO_DIRECTION:
+		return verb | 0x800; /* corresponding GET verb */
+	}
+	return 0;
+}
+
+/* tag of a default read: cmd cache index, or amp position with DEF_TAG_AMP */
+#define DEF_TAG_AMP		(1U << 31)
+#define def_tag_amp(nid, dir, idx, ch) \
+	(DEF_TAG_AMP | ((nid) << 8) | ((dir) << 5) | ((ch) << 4) | (idx))
+
+/* send the reads of the defaults and store the results;
+ * call without hash_mutex
+ */
+static void exec_def_reads(struct hda_codec *codec, const unsigned int *cmds,
+			   const unsigned int *tags, int n)
 {
+	struct hda_amp_cache *amps = &codec->amp_cache;
+	unsigned int res[HDA_VERB_BATCH];
+	unsigned int tag, nid, dir, idx, ch;
+	struct hda_cache_head *c;
 	int i;
+
+	memset(res, 0xff, n * sizeof(*res)); /* unset at errors */
+	codec_exec_verbs(codec, cmds, res, n);
+	mutex_lock(&codec->hash_mutex);
+	for (i = 0; i < n; i++) {
+		if (res[i] == -1)
+			continue;
+		tag = tags[i];
+		if (!(tag & DEF_TAG_AMP)) {
+			c = snd_array_elem(&codec->cmd_cache.buf, tag);
+			c->def = res[i] & 0xff;
+			c->def_known = 1;
+			continue;
+		}
+		nid = (tag >> 8) & 0xff;
+		dir = (tag >> 5) & 1;
+		ch = (tag >> 4) & 1;
+		idx = tag & 0xf;
+		/* the amp table may be reallocated meanwhile */
+		if (nid >= amps->num_nodes ||
+		    idx >= amps->nodes[nid].num_amps[dir])
+			continue;
+		amps->nodes[nid].amp[dir][idx].def[ch] = res[i] & 0xff;
+		amps->nodes[nid].amp[dir][idx].status |= INFO_AMP_DEF(ch);
+	}
+	mutex_unlock(&codec->hash_mutex);
+}
+
+/*
+ * Read the power-on defaults of the cache entries which don't have one yet.
+ * Called at resume when the codec reports that its settings were reset,
+ * and before any verb touches the widgets.  Until the default of an entry
+ * is known, the entry is always rewritten at resume.
+ */
+static void hda_read_cache_defaults(struct hda_codec *codec)
+{
+	struct hda_amp_cache *amps = &codec->amp_cache;
+	unsigned int cmds[HDA_VERB_BATCH], tags[HDA_VERB_BATCH];
+	unsigned int nid, dir, idx, ch, verb, cmd;
+	struct hda_cache_head *c;
+	int i, n = 0;
+
+	mutex_lock(&codec->hash_mutex);
+	for (i = 0; i < codec->cmd_cache.buf.used; i++) {
+		c = snd_array_elem(&codec->cmd_cache.buf, i);
+		if (c->def_known)
+			continue;
+		verb = get_cmd_cache_def_verb(get_cmd_cache_cmd(c->key));
+		if (!verb)
+			continue;
+		cmd = make_codec_cmd(codec, get_cmd_cache_nid(c->key), 0,
+				     verb, 0);
+		if (cmd == ~0)
+			continue;
+		tags[n] = i;
+		cmds[n++] = cmd;
+		if (n == ARRAY_SIZE(cmds)) {
+			mutex_unlock(&codec->hash_mutex);
+			exec_def_reads(codec, cmds, tags, n);
+			n = 0;
+			mutex_lock(&codec->hash_mutex);
+		}
+	}
+	for (nid = 0; nid < amps->num_nodes; nid++) {
+		for (dir = 0; dir < 2; dir++) {
+			/* the node may be reallocated while unlocked */
+			for (idx = 0; idx < amps->nodes[nid].num_amps[dir];
+			     idx++) {
+				struct hda_amp_info *info;
+
+				info = &amps->nodes[nid].amp[dir][idx];
+				for (ch = 0; ch < 2; ch++) {
+					if (!(info->status & INFO_AMP_VOL(ch)) ||
+					    (info->status & INFO_AMP_DEF(ch)))
+						continue;
+					cmd = make_codec_cmd(codec, nid, 0,
+						AC_VERB_GET_AMP_GAIN_MUTE,
+						(ch ? AC_AMP_GET_RIGHT :
+						 AC_AMP_GET_LEFT) |
+						(dir == HDA_OUTPUT ?
+						 AC_AMP_GET_OUTPUT :
+						 AC_AMP_GET_INPUT) | idx);
+					if (cmd == ~0)
+						continue;
+					tags[n] = def_tag_amp(nid, dir, idx, ch);
+					cmds[n++] = cmd;
+					if (n < ARRAY_SIZE(cmds))
+						continue;
+					mutex_unlock(&codec->hash_mutex);
+					exec_def_reads(codec, cmds, tags, n);
+					n = 0;
+					mutex_lock(&codec->hash_mutex);
+					info = &amps->nodes[nid].amp[dir][idx];
+				}
+			}
+		}
+	}
+	mutex_unlock(&codec->hash_mutex);
+	if (n)
+		exec_def_reads(codec, cmds, tags, n);
+}
+
+/* check whether the amp value differs from the power-on default */
+static bool amp_differs_from_def(struct hda_amp_info *info)
+{
+	int ch;
+
+	for (ch = 0; ch < 2; ch++) {
+		if (!(info->status & INFO_AMP_VOL(ch)))
+			continue;
+		if (!(info->status & INFO_AMP_DEF(ch)) ||
+		    info->vol[ch] != info->def[ch])
+			return true;
+	}
+	return false;
+}
+
+/* mark the entries of cmd and amp caches dirty for resume;
+ * the entries keeping the power-on default values are skipped
+ */
+static void hda_mark_cmd_cache_dirty(struct hda_codec *codec)
+{
+	int i, dir, idx;
 	for (i = 0; i < codec->cmd_cache.buf.used; i++) {
 		struct hda_cache_head *cmd;
 		cmd = snd_array_elem(&codec->cmd_cache.buf, i);
+		if (cmd->def_known && cmd->val == cmd->def)
+			continue;
 		cmd->dirty = 1;
-	}
-	for (i = 0; i < codec->amp_cache.buf.used; i++) {
-		struct hda_amp_info *amp;
-		amp = snd_array_elem(&codec->amp_cache.buf, i);
-		amp->head.dirty = 1;
+		set_bit(get_cmd_cache_nid(cmd->key), codec->cmd_cache.dirty);
+	}
+	for (i = 0; i < codec->amp_cache.num_nodes; i++) {
+		struct hda_amp_node *node = &codec->amp_cache.nodes[i];
+		for (dir = 0; dir < 2; dir++) {
+			for (idx = 0; idx < node->num_amps[dir]; idx++) {
+				struct hda_amp_info *info = &node->amp[dir][idx];
+				if (!amp_differs_from_def(info))
+					continue;
+				info->dirty = 1;
+				set_bit(i, codec->amp_cache.dirty);
+			}
+		}
 	}
 }
 
@@ -3923,15 +4524,21 @@ static void hda_mark_cmd_cache_dirty(struct hda_codec *codec)
  */
 static void hda_call_codec_resume(struct hda_codec *codec)
 {
-	codec->in_pm = 1;
+	ktime_t start = ktime_get();
+	unsigned int state;
 
-	hda_mark_cmd_cache_dirty(codec);
+	codec->in_pm = 1;
+	codec->resume_verbs = 0;
 
 	/* set as if powered on for avoiding re-entering the resume
 	 * in the resume / power-save sequence
 	 */
 	hda_keep_power_on(codec);
-	hda_set_power_state(codec, AC_PWRST_D0);
+	state = hda_set_power_state(codec, AC_PWRST_D0);
+	/* the widgets hold the power-on defaults only after a reset */
+	if (!(state & AC_PWRST_ERROR) && (state & AC_PWRST_SETTING_RESET))
+		hda_read_cache_defaults(codec);
+	hda_mark_cmd_cache_dirty(codec);
 	restore_shutup_pins(codec);
 	hda_exec_init_verbs(codec);
 	snd_hda_jack_set_dirty_all(codec);
@@ -3949,6 +4556,8 @@ static void hda_call_codec_resume(struct hda_codec *codec)
 	else
 		snd_hda_jack_report_sync(codec);
 
+	codec->resume_count++;
+	codec->resume_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 	codec->in_pm = 0;
 	snd_hda_power_down(codec); /* flag down before returning */
 }
@@ -4173,8 +4782,7 @@ static unsigned int get_pcm_param(struct hda_codec *codec, hda_nid_t nid,
 
 static unsigned int query_pcm_param(struct hda_codec *codec, hda_nid_t nid)
 {
-	return query_caps_hash(codec, nid, 0, HDA_HASH_PARPCM_KEY(nid),
-			       get_pcm_param);
+	return query_caps_hash(codec, nid, HDA_CACHE_PARPCM, get_pcm_param);
 }
 
 static unsigned int get_stream_param(struct hda_codec *codec, hda_nid_t nid,
@@ -4190,7 +4798,7 @@ static unsigned int get_stream_param(struct hda_codec *codec, hda_nid_t nid,
 
 static unsigned int query_stream_param(struct hda_codec *codec, hda_nid_t nid)
 {
-	return query_caps_hash(codec, nid, 0, HDA_HASH_PARSTR_KEY(nid),
+	return query_caps_hash(codec, nid, HDA_CACHE_PARSTR,
 			       get_stream_param);
 }
 
@@ -4616,6 +5224,25 @@ int snd_hda_build_pcms(struct hda_bus *bus)
 }
 EXPORT_SYMBOL_HDA(snd_hda_build_pcms);
 
+/**
+ * snd_hda_quirk_lookup - look up the board quirk list
+ * @codec: the HDA codec
+ * @list: quirk list, terminated by a null entry
+ *
+ * Like snd_pci_quirk_lookup(), but on a bus without PCI device, the
+ * subsystem id of the codec is taken as the board SSID.
+ *
+ * Returns the matched entry pointer, or NULL if nothing matched.
+ */
+const struct snd_pci_quirk *
+snd_hda_quirk_lookup(struct hda_codec *codec,
+		     const struct snd_pci_quirk *list)
+{
+	return snd_pci_quirk_lookup_id(snd_hda_board_vendor(codec),
+				       snd_hda_board_device(codec), list);
+}
+EXPORT_SYMBOL_HDA(snd_hda_quirk_lookup);
+
 /**
  * snd_hda_check_board_config - compare the current codec with the config table
  * @codec: the HDA codec
@@ -4645,10 +5272,10 @@ int snd_hda_check_board_config(struct hda_codec *codec,
 		}
 	}
 
-	if (!codec->bus->pci || !tbl)
+	if (!tbl)
 		return -1;
 
-	tbl = snd_pci_quirk_lookup(codec->bus->pci, tbl);
+	tbl = snd_hda_quirk_lookup(codec, tbl);
 	if (!tbl)
 		return -1;
 	if (tbl->value >= 0 && tbl->value < num_configs) {
@@ -594,6 +594,7 @@ struct hda_codec;
 struct hda_pcm;
 struct hda_pcm_stream;
 struct hda_bus_unsolicited;
+struct hda_conn_list;
 
 /* NID type */
 typedef u16 hda_nid_t;
@@ -604,6 +605,13 @@ struct hda_bus_ops {
 	int (*command)(struct hda_bus *bus, unsigned int cmd);
 	/* get a response from the last command */
 	unsigned int (*get_response)(struct hda_bus *bus, unsigned int addr);
+	/* send several commands to the same codec at once and wait for
+	 * all responses; returns the number of commands completed (which
+	 * may be less than count), 0 when the caller should fall back to
+	 * single commands, or a negative error code.  optional.
+	 */
+	int (*command_batch)(struct hda_bus *bus, const unsigned int *cmds,
+			     unsigned int *res, int count);
 	/* free the private data */
 	void (*private_free)(struct hda_bus *);
 	/* attach a PCM stream */
@@ -655,6 +663,8 @@ struct hda_bus {
 
 	/* codec linked list */
 	struct list_head codec_list;
+	/* topology snapshots given by the patch loader */
+	struct list_head topologies;
 	/* link caddr -> codec */
 	struct hda_codec *caddr_tbl[HDA_MAX_CODEC_ADDRESS + 1];
 
@@ -728,23 +738,45 @@ struct hda_codec_ops {
 	void (*reboot_notify)(struct hda_codec *codec);
 };
 
-/* record for amp information cache */
+/* NIDs addressable by a verb */
+#define HDA_MAX_NODES		0x80
+
+/* record for command cache */
 struct hda_cache_head {
-	u32 key:31;		/* hash key */
+	u32 key:30;		/* cache key */
 	u32 dirty:1;
+	u32 def_known:1;	/* def holds the power-on default */
 	u16 val;		/* assigned value */
-	u16 next;
+	u16 next;		/* next entry of the same NID */
+	u16 def;		/* power-on default read at resume */
+};
+
+struct hda_cache_rec {
+	u16 head[HDA_MAX_NODES];	/* first entry of each NID */
+	struct snd_array buf;		/* record entries */
+	DECLARE_BITMAP(dirty, HDA_MAX_NODES);	/* NIDs with dirty entries */
 };
 
+/* record for amp information cache */
 struct hda_amp_info {
-	struct hda_cache_head head;
 	u32 amp_caps;		/* amp capabilities */
 	u16 vol[2];		/* current volume & mute */
+	u16 def[2];		/* power-on defaults read at resume */
+	u8 status;		/* INFO_AMP_* bits */
+	u8 dirty;
 };
 
-struct hda_cache_rec {
-	u16 hash[64];			/* hash table for index */
-	struct snd_array buf;		/* record entries */
+/* amp information of a widget, indexed directly by direction and index */
+struct hda_amp_node {
+	struct hda_amp_info *amp[2];	/* HDA_OUTPUT and HDA_INPUT */
+	unsigned char num_amps[2];
+	struct hda_amp_info caps[3];	/* pin caps, PCM and stream params */
+};
+
+struct hda_amp_cache {
+	struct hda_amp_node *nodes;	/* indexed by NID */
+	unsigned int num_nodes;
+	DECLARE_BITMAP(dirty, HDA_MAX_NODES);	/* NIDs with dirty amps */
 };
 
 /* PCM callbacks */
@@ -841,11 +873,13 @@ struct hda_codec {
 
 	struct snd_array mixers;	/* list of assigned mixer elements */
 	struct snd_array nids;		/* list of mapped mixer elements */
+	struct snd_array lazy_ctls;	/* controls created on demand */
 
-	struct hda_cache_rec amp_cache;	/* cache for amp access */
+	struct hda_amp_cache amp_cache;	/* cache for amp access */
 	struct hda_cache_rec cmd_cache;	/* cache for other commands */
 
-	struct list_head conn_list;	/* linked-list of connection-list */
+	/* cached connection lists, indexed by NID */
+	struct hda_conn_list *conn_lists[HDA_MAX_NODES];
 
 	struct mutex spdif_mutex;
 	struct mutex control_mutex;
@@ -897,6 +931,9 @@ struct hda_codec {
 	unsigned long power_off_acct;
 	unsigned long power_jiffies;
 	spinlock_t power_lock;
+	unsigned int resume_count;	/* number of resumes */
+	unsigned int resume_verbs;	/* cached verbs replayed at last resume */
+	u64 resume_ns;			/* duration of last resume */
 #endif
 
 	/* filter the requested power state per nid */
@@ -1165,6 +1202,7 @@ static inline void snd_hda_power_sync(struct hda_codec *codec)
  * patch firmware
  */
 int snd_hda_load_patch(struct hda_bus *bus, size_t size, const void *buf);
+int snd_hda_load_topology(struct hda_bus *bus, size_t size, const void *buf);
 #endif
 
 #ifdef CONFIG_SND_HDA_DSP_LOADER
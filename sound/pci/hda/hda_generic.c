@@ -233,24 +233,86 @@ static bool is_nid_contained(struct nid_path *path, hda_nid_t nid)
 	return find_idx_in_nid_list(nid, path->path, path->depth) >= 0;
 }
 
+static bool match_nid_path(struct nid_path *path,
+			   hda_nid_t from_nid, hda_nid_t to_nid,
+			   int anchor_nid)
+{
+	if (path->depth <= 0)
+		return false;
+	if ((!from_nid || path->path[0] == from_nid) &&
+	    (!to_nid || path->path[path->depth - 1] == to_nid)) {
+		if (!anchor_nid ||
+		    (anchor_nid > 0 && is_nid_contained(path, anchor_nid)) ||
+		    (anchor_nid < 0 && !is_nid_contained(path, anchor_nid)))
+			return true;
+	}
+	return false;
+}
+
+static unsigned int path_hash_key(hda_nid_t from_nid, hda_nid_t to_nid)
+{
+	return (from_nid * 31 + to_nid) % NID_PATH_HASH_SIZE;
+}
+
+/* forget the hashed paths; called when the path list is truncated */
+static void invalidate_path_hash(struct hda_gen_spec *spec)
+{
+	memset(spec->path_hash, 0, sizeof(spec->path_hash));
+	spec->path_hash_used = 0;
+}
+
+/* bring the path hash up to date with the path list; paths are only
+ * appended, but the list may also be truncated, then rebuild it
+ */
+static void update_path_hash(struct hda_gen_spec *spec)
+{
+	struct nid_path *path, *p;
+	unsigned short *next;
+
+	if (spec->path_hash_used > spec->paths.used)
+		invalidate_path_hash(spec);
+	for (; spec->path_hash_used < spec->paths.used;
+	     spec->path_hash_used++) {
+		path = snd_array_elem(&spec->paths, spec->path_hash_used);
+		path->hash_next = 0;
+		if (path->depth <= 0)
+			continue;
+		/* append to the chain tail for keeping the list order */
+		next = &spec->path_hash[path_hash_key(path->path[0],
+					path->path[path->depth - 1])];
+		while (*next) {
+			p = snd_array_elem(&spec->paths, *next - 1);
+			next = &p->hash_next;
+		}
+		*next = spec->path_hash_used + 1;
+	}
+}
+
 static struct nid_path *get_nid_path(struct hda_codec *codec,
 				     hda_nid_t from_nid, hda_nid_t to_nid,
 				     int anchor_nid)
 {
 	struct hda_gen_spec *spec = codec->spec;
+	struct nid_path *path;
+	unsigned int cur;
 	int i;
 
-	for (i = 0; i < spec->paths.used; i++) {
-		struct nid_path *path = snd_array_elem(&spec->paths, i);
-		if (path->depth <= 0)
-			continue;
-		if ((!from_nid || path->path[0] == from_nid) &&
-		    (!to_nid || path->path[path->depth - 1] == to_nid)) {
-			if (!anchor_nid ||
-			    (anchor_nid > 0 && is_nid_contained(path, anchor_nid)) ||
-			    (anchor_nid < 0 && !is_nid_contained(path, anchor_nid)))
+	if (from_nid && to_nid) {
+		update_path_hash(spec);
+		cur = spec->path_hash[path_hash_key(from_nid, to_nid)];
+		for (; cur; cur = path->hash_next) {
+			path = snd_array_elem(&spec->paths, cur - 1);
+			if (match_nid_path(path, from_nid, to_nid, anchor_nid))
 				return path;
 		}
+		return NULL;
+	}
+
+	/* wildcard; look through the whole list */
+	for (i = 0; i < spec->paths.used; i++) {
+		path = snd_array_elem(&spec->paths, i);
+		if (match_nid_path(path, from_nid, to_nid, anchor_nid))
+			return path;
 	}
 	return NULL;
 }
@@ -308,13 +370,56 @@ static bool is_dac_already_used(struct hda_codec *codec, hda_nid_t nid)
 	return false;
 }
 
+/* same as the recursion limit in snd_hda_get_conn_index() */
+#define MAX_REACH_DEPTH		11
+
+/* collect all widgets that can reach the given widget, i.e. all for which
+ * snd_hda_get_conn_index() with recursion would succeed, by a BFS over
+ * the connection lists
+ */
+static void fill_reachable(struct hda_codec *codec, hda_nid_t nid)
+{
+	struct hda_gen_spec *spec = codec->spec;
+	unsigned long *reach = spec->reach[nid];
+	hda_nid_t queue[HDA_MAX_NODES + 1];
+	int head = 0, tail = 0, level_end, depth;
+	const hda_nid_t *conn;
+	int i, nums;
+	unsigned int type;
+
+	bitmap_zero(reach, HDA_MAX_NODES);
+	queue[tail++] = nid;
+	for (depth = 1; depth <= MAX_REACH_DEPTH && head < tail; depth++) {
+		level_end = tail;
+		for (; head < level_end; head++) {
+			nums = snd_hda_get_conn_list(codec, queue[head], &conn);
+			for (i = 0; i < nums; i++) {
+				if (conn[i] >= HDA_MAX_NODES ||
+				    test_and_set_bit(conn[i], reach))
+					continue;
+				type = get_wcaps_type(get_wcaps(codec, conn[i]));
+				if (type == AC_WID_PIN || type == AC_WID_AUD_OUT)
+					continue;
+				queue[tail++] = conn[i];
+			}
+		}
+	}
+	set_bit(nid, spec->reach_valid);
+}
+
 /* check whether the given two widgets can be connected */
 static bool is_reachable_path(struct hda_codec *codec,
 			      hda_nid_t from_nid, hda_nid_t to_nid)
 {
+	struct hda_gen_spec *spec = codec->spec;
+
 	if (!from_nid || !to_nid)
 		return false;
-	return snd_hda_get_conn_index(codec, to_nid, from_nid, true) >= 0;
+	if (from_nid >= HDA_MAX_NODES || to_nid >= HDA_MAX_NODES)
+		return snd_hda_get_conn_index(codec, to_nid, from_nid, true) >= 0;
+	if (!test_bit(to_nid, spec->reach_valid))
+		fill_reachable(codec, to_nid);
+	return test_bit(from_nid, spec->reach[to_nid]);
 }
 
 /* nid, dir and idx */
@@ -395,6 +500,9 @@ static bool __parse_nid_path(struct hda_codec *codec,
 		if (type == AC_WID_AUD_OUT || type == AC_WID_AUD_IN ||
 		    type == AC_WID_PIN)
 			continue;
+		/* skip the branch that can't lead to the source at all */
+		if (from_nid && !is_reachable_path(codec, from_nid, conn[i]))
+			continue;
 		if (__parse_nid_path(codec, from_nid, conn[i],
 				     anchor_nid, path, depth + 1))
 			goto found;
@@ -466,9 +574,14 @@ EXPORT_SYMBOL_HDA(snd_hda_add_new_path);
 static void invalidate_nid_path(struct hda_codec *codec, int idx)
 {
 	struct nid_path *path = snd_hda_get_path_from_idx(codec, idx);
+	unsigned short hash_next;
+
 	if (!path)
 		return;
+	/* keep the hash chain running through this entry intact */
+	hash_next = path->hash_next;
 	memset(path, 0, sizeof(*path));
+	path->hash_next = hash_next;
 }
 
 /* look for an empty DAC slot */
@@ -1361,6 +1474,7 @@ static int fill_multi_ios(struct hda_codec *codec,
 	if (!hardwired && spec->multi_ios < 2) {
 		/* cancel newly assigned paths */
 		spec->paths.used -= spec->multi_ios - old_pins;
+		invalidate_path_hash(spec);
 		spec->multi_ios = old_pins;
 		return badness;
 	}
@@ -1512,6 +1626,7 @@ static int fill_and_eval_dacs(struct hda_codec *codec,
 	memset(spec->multiout.extra_out_nid, 0, sizeof(spec->multiout.extra_out_nid));
 	spec->multi_ios = 0;
 	snd_array_free(&spec->paths);
+	invalidate_path_hash(spec);
 
 	/* clear path indices */
 	memset(spec->out_paths, 0, sizeof(spec->out_paths));
@@ -4234,6 +4349,8 @@ int snd_hda_gen_parse_auto_config(struct hda_codec *codec,
 	int err;
 
 	parse_user_hints(codec);
+	/* the connections may have been overridden in the meantime */
+	bitmap_zero(spec->reach_valid, HDA_MAX_NODES);
 
 	if (spec->mixer_nid && !spec->mixer_merge_nid)
 		spec->mixer_merge_nid = spec->mixer_nid;
@@ -53,8 +53,11 @@ struct nid_path {
 	unsigned char multi[MAX_NID_PATH_DEPTH];
 	unsigned int ctls[NID_PATH_NUM_CTLS]; /* NID_PATH_XXX_CTL */
 	bool active;
+	unsigned short hash_next;	/* next path index in the hash chain */
 };
 
+#define NID_PATH_HASH_SIZE	64
+
 /* mic/line-in auto switching entry */
 
 #define MAX_AUTO_MIC_PINS	3
@@ -171,6 +174,13 @@ struct hda_gen_spec {
 
 	/* path list */
 	struct snd_array paths;
+	/* path indices hashed by the end points */
+	unsigned short path_hash[NID_PATH_HASH_SIZE];
+	int path_hash_used;		/* number of paths in the hash */
+
+	/* widgets that can reach each NID */
+	DECLARE_BITMAP(reach_valid, HDA_MAX_NODES);
+	unsigned long reach[HDA_MAX_NODES][BITS_TO_LONGS(HDA_MAX_NODES)];
 
 	/* path indices */
 	int out_paths[AUTO_CFG_MAX_OUTS];
@@ -105,6 +105,104 @@ static int hda_hwdep_open(struct snd_hwdep *hw, struct file *file)
 	return 0;
 }
 
+#ifdef CONFIG_SND_HDA_PATCH_LOADER
+/*
+ * dump the codec topology in the format of [topology] patch section;
+ * all values are read from the hardware, not from the caches
+ */
+static int dump_topology(struct hda_codec *codec, char *buf, size_t size)
+{
+	hda_nid_t conns[32];
+	hda_nid_t nid, start_nid;
+	unsigned int wcaps, amp_nid;
+	size_t len;
+	int i, j, nodes, nums;
+
+	nodes = snd_hda_get_sub_nodes(codec, codec->afg ? codec->afg :
+				      codec->mfg, &start_nid);
+	len = scnprintf(buf, size, "[topology]\n"
+			"codec 0x%08x 0x%08x 0x%x\n"
+			"fg 0x%02x 0x%x 0x%02x 0x%x\n"
+			"nodes 0x%02x %d\n",
+			codec->vendor_id, codec->subsystem_id,
+			codec->revision_id,
+			codec->afg,
+			codec->afg_function_id | (codec->afg_unsol << 8),
+			codec->mfg,
+			codec->mfg_function_id | (codec->mfg_unsol << 8),
+			start_nid, nodes);
+	nid = start_nid;
+	for (i = 0; i < nodes; i++, nid++) {
+		wcaps = snd_hda_param_read(codec, nid, AC_PAR_AUDIO_WIDGET_CAP);
+		len += scnprintf(buf + len, size - len,
+				 "wcaps 0x%02x 0x%08x\n", nid, wcaps);
+		if (wcaps & (AC_WCAP_IN_AMP | AC_WCAP_OUT_AMP)) {
+			amp_nid = (wcaps & AC_WCAP_AMP_OVRD) ? nid : codec->afg;
+			len += scnprintf(buf + len, size - len,
+				"ampcaps 0x%02x 0x%08x 0x%08x\n", nid,
+				snd_hda_param_read(codec, amp_nid,
+						   AC_PAR_AMP_OUT_CAP),
+				snd_hda_param_read(codec, amp_nid,
+						   AC_PAR_AMP_IN_CAP));
+		}
+		if (get_wcaps_type(wcaps) == AC_WID_PIN) {
+			len += scnprintf(buf + len, size - len,
+				"pincaps 0x%02x 0x%08x\n", nid,
+				snd_hda_param_read(codec, nid, AC_PAR_PIN_CAP));
+			for (j = 0; j < codec->init_pins.used; j++) {
+				struct hda_pincfg *pin;
+				pin = snd_array_elem(&codec->init_pins, j);
+				if (pin->nid != nid)
+					continue;
+				len += scnprintf(buf + len, size - len,
+						 "pincfg 0x%02x 0x%08x 0x%02x\n",
+						 nid, pin->cfg, pin->ctrl);
+				break;
+			}
+		}
+		if (!(wcaps & AC_WCAP_CONN_LIST))
+			continue;
+		nums = snd_hda_get_raw_connections(codec, nid, conns,
+						   ARRAY_SIZE(conns));
+		if (nums < 0)
+			continue; /* read at probe time */
+		len += scnprintf(buf + len, size - len, "conn 0x%02x", nid);
+		for (j = 0; j < nums; j++)
+			len += scnprintf(buf + len, size - len, " 0x%02x",
+					 conns[j]);
+		len += scnprintf(buf + len, size - len, "\n");
+	}
+	return len;
+}
+
+/* export the topology snapshot; it can be appended to a patch file */
+static long hda_hwdep_read(struct snd_hwdep *hw, char __user *ubuf,
+			   long count, loff_t *offset)
+{
+	struct hda_codec *codec = hw->private_data;
+	size_t size = 256 + codec->num_nodes * 320;
+	char *buf;
+	long len;
+
+	buf = kmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	snd_hda_power_up(codec);
+	len = dump_topology(codec, buf, size);
+	snd_hda_power_down(codec);
+	if (*offset >= len)
+		count = 0;
+	else if (count > len - *offset)
+		count = len - *offset;
+	if (count && copy_to_user(ubuf, buf + *offset, count))
+		count = -EFAULT;
+	else
+		*offset += count;
+	kfree(buf);
+	return count;
+}
+#endif /* CONFIG_SND_HDA_PATCH_LOADER */
+
 static void clear_hwdep_elements(struct hda_codec *codec)
 {
 	int i;
@@ -144,6 +242,9 @@ int snd_hda_create_hwdep(struct hda_codec *codec)
 
 	hwdep->ops.open = hda_hwdep_open;
 	hwdep->ops.ioctl = hda_hwdep_ioctl;
+#ifdef CONFIG_SND_HDA_PATCH_LOADER
+	hwdep->ops.read = hda_hwdep_read;
+#endif
 #ifdef CONFIG_COMPAT
 	hwdep->ops.ioctl_compat = hda_hwdep_ioctl_compat;
 #endif
@@ -680,6 +781,7 @@ enum {
 	LINE_MODE_SUBSYSTEM_ID,
 	LINE_MODE_REVISION_ID,
 	LINE_MODE_CHIP_NAME,
+	LINE_MODE_TOPOLOGY,
 	NUM_LINE_MODES,
 };
 
@@ -776,6 +878,8 @@ static struct hda_patch_item patch_items[NUM_LINE_MODES] = {
 	[LINE_MODE_SUBSYSTEM_ID] = { "[subsystem_id]", parse_subsystem_id_mode, 1 },
 	[LINE_MODE_REVISION_ID] = { "[revision_id]", parse_revision_id_mode, 1 },
 	[LINE_MODE_CHIP_NAME] = { "[chip_name]", parse_chip_name_mode, 1 },
+	/* parsed separately by snd_hda_load_topology() */
+	[LINE_MODE_TOPOLOGY] = { "[topology]", NULL, 0 },
 };
 
 /* check the line starting with '[' -- change the parser mode accodingly */
@@ -852,4 +956,170 @@ int snd_hda_load_patch(struct hda_bus *bus, size_t fw_size, const void *fw_buf)
 	return 0;
 }
 EXPORT_SYMBOL_HDA(snd_hda_load_patch);
+
+/*
+ * codec topology snapshot
+ *
+ * The [topology] section contains the widget information of a codec in
+ * the format below, as generated by reading the hwdep device:
+ *
+ *   codec <vendor_id> <subsystem_id> <revision_id>
+ *   fg <afg> <afg_function> <mfg> <mfg_function>
+ *   nodes <start_nid> <num_nodes>
+ *   wcaps <nid> <caps>
+ *   ampcaps <nid> <out_caps> <in_caps>
+ *   pincaps <nid> <caps>
+ *   pincfg <nid> <default_config> <pin_ctl>
+ *   conn <nid> [<nid>...]
+ *
+ * The snapshot is used by snd_hda_codec_new() for the codec with the
+ * same IDs instead of reading all widgets.
+ */
+#define TOPO_LINE_SIZE	256
+
+static struct hda_topology_node *
+get_topology_node(struct hda_topology *topo, int nid)
+{
+	if (!topo || !topo->nodes || nid < topo->start_nid ||
+	    nid >= topo->start_nid + topo->num_nodes)
+		return NULL;
+	return &topo->nodes[nid - topo->start_nid];
+}
+
+static int parse_topology_conns(struct hda_topology_node *node, char *buf)
+{
+	hda_nid_t list[32];
+	unsigned long val;
+	char *p;
+	int nums = 0;
+
+	while ((p = strsep(&buf, " \t")) != NULL) {
+		if (!*p)
+			continue;
+		if (nums >= ARRAY_SIZE(list) || strict_strtoul(p, 0, &val))
+			return -EINVAL;
+		list[nums++] = val;
+	}
+	kfree(node->conns);
+	node->conns = kmemdup(list, nums * sizeof(hda_nid_t), GFP_KERNEL);
+	if (nums && !node->conns) {
+		node->num_conns = -1;
+		return -ENOMEM;
+	}
+	node->num_conns = nums;
+	return 0;
+}
+
+/* parse a line in [topology] section; returns the current snapshot */
+static struct hda_topology *
+parse_topology_line(char *buf, struct hda_bus *bus, struct hda_topology *topo)
+{
+	struct hda_topology_node *node;
+	int v[4], i, n;
+
+	if (sscanf(buf, "codec %i %i %i", &v[0], &v[1], &v[2]) == 3) {
+		topo = kzalloc(sizeof(*topo), GFP_KERNEL);
+		if (!topo)
+			return NULL;
+		topo->vendor_id = v[0];
+		topo->subsystem_id = v[1];
+		topo->revision_id = v[2];
+		list_add_tail(&topo->list, &bus->topologies);
+		return topo;
+	}
+	if (!topo)
+		return NULL;
+
+	if (sscanf(buf, "fg %i %i %i %i", &v[0], &v[1], &v[2], &v[3]) == 4) {
+		topo->afg = v[0];
+		topo->afg_function = v[1];
+		topo->mfg = v[2];
+		topo->mfg_function = v[3];
+	} else if (sscanf(buf, "nodes %i %i", &v[0], &v[1]) == 2) {
+		if (topo->nodes || v[0] <= 0 || v[1] <= 0 ||
+		    v[0] + v[1] > HDA_MAX_NODES)
+			return topo;
+		topo->nodes = kcalloc(v[1], sizeof(*node), GFP_KERNEL);
+		if (!topo->nodes)
+			return topo;
+		topo->start_nid = v[0];
+		topo->num_nodes = v[1];
+		for (i = 0; i < v[1]; i++)
+			topo->nodes[i].num_conns = -1;
+	} else if (sscanf(buf, "wcaps %i %i", &v[0], &v[1]) == 2) {
+		node = get_topology_node(topo, v[0]);
+		if (node) {
+			node->wcaps = v[1];
+			topo->num_wcaps++;
+		}
+	} else if (sscanf(buf, "ampcaps %i %i %i", &v[0], &v[1], &v[2]) == 3) {
+		node = get_topology_node(topo, v[0]);
+		if (node) {
+			node->amp_caps[HDA_OUTPUT] = v[1];
+			node->amp_caps[HDA_INPUT] = v[2];
+			node->flags |= HDA_TOPO_AMP_CAPS;
+		}
+	} else if (sscanf(buf, "pincaps %i %i", &v[0], &v[1]) == 2) {
+		node = get_topology_node(topo, v[0]);
+		if (node) {
+			node->pin_caps = v[1];
+			node->flags |= HDA_TOPO_PIN_CAPS;
+		}
+	} else if (sscanf(buf, "pincfg %i %i %i", &v[0], &v[1], &v[2]) == 3) {
+		node = get_topology_node(topo, v[0]);
+		if (node) {
+			node->pin_cfg = v[1];
+			node->pin_ctl = v[2];
+			node->flags |= HDA_TOPO_PIN_CFG;
+		}
+	} else if (sscanf(buf, "conn %i%n", &v[0], &n) == 1) {
+		node = get_topology_node(topo, v[0]);
+		if (node)
+			parse_topology_conns(node, buf + n);
+	}
+	return topo;
+}
+
+/*
+ * load the [topology] sections in a "patch" firmware file;
+ * this must be called before creating the codecs
+ */
+int snd_hda_load_topology(struct hda_bus *bus, size_t fw_size,
+			  const void *fw_buf)
+{
+	struct hda_topology *topo = NULL;
+	bool in_topology = false;
+	char *buf;
+
+	buf = kmalloc(TOPO_LINE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	while (get_line_from_fw(buf, TOPO_LINE_SIZE - 1, &fw_size, &fw_buf)) {
+		if (!*buf || *buf == '#' || *buf == '\n')
+			continue;
+		if (*buf == '[') {
+			in_topology = parse_line_mode(buf, bus) ==
+				LINE_MODE_TOPOLOGY;
+			topo = NULL;
+		} else if (in_topology)
+			topo = parse_topology_line(buf, bus, topo);
+	}
+	kfree(buf);
+	return 0;
+}
+EXPORT_SYMBOL_HDA(snd_hda_load_topology);
+
+void snd_hda_free_topologies(struct hda_bus *bus)
+{
+	struct hda_topology *topo, *n;
+	int i;
+
+	list_for_each_entry_safe(topo, n, &bus->topologies, list) {
+		for (i = 0; i < topo->num_nodes; i++)
+			kfree(topo->nodes[i].conns);
+		kfree(topo->nodes);
+		list_del(&topo->list);
+		kfree(topo);
+	}
+}
 #endif /* CONFIG_SND_HDA_PATCH_LOADER */
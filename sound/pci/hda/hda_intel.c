@@ -93,7 +93,7 @@ module_param_array(model, charp, NULL, 0444);
 MODULE_PARM_DESC(model, "Use the given board model.");
 module_param_array(position_fix, int, NULL, 0444);
 MODULE_PARM_DESC(position_fix, "DMA pointer read method."
-		 "(-1 = system default, 0 = auto, 1 = LPIB, 2 = POSBUF, 3 = VIACOMBO, 4 = COMBO).");
+		 "(-1 = system default, 0 = auto, 1 = LPIB, 2 = POSBUF, 3 = VIACOMBO, 4 = COMBO, 5 = INTERP).");
 module_param_array(bdl_pos_adj, int, NULL, 0644);
 MODULE_PARM_DESC(bdl_pos_adj, "BDL position adjustment offset.");
 module_param_array(probe_mask, int, NULL, 0444);
@@ -358,6 +358,7 @@ enum {
 	POS_FIX_POSBUF,
 	POS_FIX_VIACOMBO,
 	POS_FIX_COMBO,
+	POS_FIX_INTERP,
 };
 
 /* Defines for ATI HD Audio support in SB450 south bridge */
@@ -396,6 +397,9 @@ struct azx_dev {
 	unsigned int fifo_size;	/* FIFO size */
 	unsigned long start_wallclk;	/* start + minimum wallclk */
 	unsigned long period_wallclk;	/* wallclk for period */
+	unsigned int interp_base;	/* POS_FIX_INTERP: position at
+					 * the timecounter origin
+					 */
 
 	void __iomem *sd_addr;	/* stream descriptor pointer */
 
@@ -457,6 +461,10 @@ struct azx_rb {
 	unsigned short rp, wp;	/* read/write pointers */
 	int cmds[AZX_MAX_CODECS];	/* number of pending requests */
 	u32 res[AZX_MAX_CODECS];	/* last read value */
+	wait_queue_head_t wait[AZX_MAX_CODECS];	/* response waiters */
+	/* for batched commands */
+	unsigned int *batch[AZX_MAX_CODECS];	/* response array, or NULL */
+	unsigned int batch_pos[AZX_MAX_CODECS];	/* next response index */
 };
 
 struct azx_pcm {
@@ -895,8 +903,14 @@ static void azx_update_rirb(struct azx *chip)
 			snd_hda_queue_unsol_event(chip->bus, res, res_ex);
 		else if (chip->rirb.cmds[addr]) {
 			chip->rirb.res[addr] = res;
+			/* responses of a codec come back in order */
+			if (chip->rirb.batch[addr]) {
+				rp = chip->rirb.batch_pos[addr]++;
+				chip->rirb.batch[addr][rp] = res;
+			}
 			smp_wmb();
-			chip->rirb.cmds[addr]--;
+			if (!--chip->rirb.cmds[addr])
+				wake_up(&chip->rirb.wait[addr]);
 		} else
 			snd_printk(KERN_ERR SFX "%s: spurious response %#x:%#x, "
 				   "last cmd=%#08x\n",
@@ -906,34 +920,33 @@ static void azx_update_rirb(struct azx *chip)
 	}
 }
 
-/* receive a response */
-static unsigned int azx_rirb_get_response(struct hda_bus *bus,
-					  unsigned int addr)
+/* wait until all pending responses of the codec arrive;
+ * returns false at timeout
+ */
+static bool azx_rirb_wait(struct hda_bus *bus, unsigned int addr, int do_poll)
 {
 	struct azx *chip = bus->private_data;
 	unsigned long timeout;
 	unsigned long loopcounter;
-	int do_poll = 0;
 
- again:
-	timeout = jiffies + msecs_to_jiffies(1000);
+	timeout = msecs_to_jiffies(1000);
+	if (!chip->polling_mode && !do_poll && chip->irq >= 0) {
+		/* azx_update_rirb() wakes us up from the interrupt handler */
+		return wait_event_timeout(chip->rirb.wait[addr],
+					  !chip->rirb.cmds[addr],
+					  timeout) > 0;
+	}
 
+	/* the controller is known to miss RIRB interrupts; poll it */
+	timeout += jiffies;
 	for (loopcounter = 0;; loopcounter++) {
-		if (chip->polling_mode || do_poll) {
-			spin_lock_irq(&chip->reg_lock);
-			azx_update_rirb(chip);
-			spin_unlock_irq(&chip->reg_lock);
-		}
-		if (!chip->rirb.cmds[addr]) {
-			smp_rmb();
-			bus->rirb_error = 0;
-
-			if (!do_poll)
-				chip->poll_count = 0;
-			return chip->rirb.res[addr]; /* the last value */
-		}
+		spin_lock_irq(&chip->reg_lock);
+		azx_update_rirb(chip);
+		spin_unlock_irq(&chip->reg_lock);
+		if (!chip->rirb.cmds[addr])
+			return true;
 		if (time_after(jiffies, timeout))
-			break;
+			return false;
 		if (bus->needs_damn_long_delay || loopcounter > 3000)
 			msleep(2); /* temporary workaround */
 		else {
@@ -941,6 +954,24 @@ static unsigned int azx_rirb_get_response(struct hda_bus *bus,
 			cond_resched();
 		}
 	}
+}
+
+/* receive a response */
+static unsigned int azx_rirb_get_response(struct hda_bus *bus,
+					  unsigned int addr)
+{
+	struct azx *chip = bus->private_data;
+	int do_poll = 0;
+
+ again:
+	if (azx_rirb_wait(bus, addr, do_poll)) {
+		smp_rmb();
+		bus->rirb_error = 0;
+
+		if (!do_poll)
+			chip->poll_count = 0;
+		return chip->rirb.res[addr]; /* the last value */
+	}
 
 	if (!bus->no_response_fallback)
 		return -1;
@@ -1007,6 +1038,62 @@ static unsigned int azx_rirb_get_response(struct hda_bus *bus,
 	return -1;
 }
 
+/* queue as many commands as the CORB can take and wait for them at once */
+static int azx_corb_send_batch(struct hda_bus *bus, const unsigned int *cmds,
+			       unsigned int *res, int count)
+{
+	struct azx *chip = bus->private_data;
+	unsigned int addr = azx_command_addr(cmds[0]);
+	unsigned int wp, rp, space;
+	int i, pending;
+
+	spin_lock_irq(&chip->reg_lock);
+	wp = azx_readw(chip, CORBWP);
+	if (wp == 0xffff) {
+		/* something wrong, controller likely turned to D3 */
+		spin_unlock_irq(&chip->reg_lock);
+		return -EIO;
+	}
+	/* responses can't be matched up while older ones are outstanding */
+	if (chip->rirb.cmds[addr]) {
+		spin_unlock_irq(&chip->reg_lock);
+		return 0;
+	}
+	rp = azx_readw(chip, CORBRP);
+	space = (rp + ICH6_MAX_CORB_ENTRIES - wp - 1) % ICH6_MAX_CORB_ENTRIES;
+	if (count > space)
+		count = space;
+	for (i = 0; i < count; i++) {
+		/* the batch must not spill over to another codec */
+		if (azx_command_addr(cmds[i]) != addr)
+			break;
+		wp++;
+		wp %= ICH6_MAX_CORB_ENTRIES;
+		chip->corb.buf[wp] = cpu_to_le32(cmds[i]);
+	}
+	count = i;
+	if (!count) {
+		spin_unlock_irq(&chip->reg_lock);
+		return 0;
+	}
+	chip->rirb.batch[addr] = res;
+	chip->rirb.batch_pos[addr] = 0;
+	chip->rirb.cmds[addr] += count;
+	chip->last_cmd[addr] = cmds[count - 1];
+	azx_writel(chip, CORBWP, wp);
+	spin_unlock_irq(&chip->reg_lock);
+
+	azx_rirb_get_response(bus, addr);
+
+	spin_lock_irq(&chip->reg_lock);
+	chip->rirb.batch[addr] = NULL;
+	pending = chip->rirb.cmds[addr];
+	spin_unlock_irq(&chip->reg_lock);
+	if (pending >= count)
+		return -EIO;
+	return count - pending;
+}
+
 /*
  * Use the single immediate command instead of CORB/RIRB for simplicity
  *
@@ -1107,6 +1194,22 @@ static unsigned int azx_get_response(struct hda_bus *bus,
 		return azx_rirb_get_response(bus, addr);
 }
 
+/* send a batch of commands */
+static int azx_send_batch(struct hda_bus *bus, const unsigned int *cmds,
+			  unsigned int *res, int count)
+{
+	struct azx *chip = bus->private_data;
+
+	if (chip->disabled) {
+		if (res)
+			memset(res, 0, count * sizeof(*res));
+		return count;
+	}
+	if (chip->single_cmd)
+		return 0; /* no queue; let the caller send them one by one */
+	return azx_corb_send_batch(bus, cmds, res, count);
+}
+
 #ifdef CONFIG_PM
 static void azx_power_notify(struct hda_bus *bus, bool power_up);
 #endif
@@ -1722,6 +1825,7 @@ static int azx_codec_create(struct azx *chip, const char *model)
 	bus_temp.pci = chip->pci;
 	bus_temp.ops.command = azx_send_cmd;
 	bus_temp.ops.get_response = azx_get_response;
+	bus_temp.ops.command_batch = azx_send_batch;
 	bus_temp.ops.attach_pcm = azx_attach_pcm_stream;
 	bus_temp.ops.bus_reset = azx_bus_reset;
 #ifdef CONFIG_PM
@@ -1743,6 +1847,13 @@ static int azx_codec_create(struct azx *chip, const char *model)
 		chip->bus->needs_damn_long_delay = 1;
 	}
 
+#ifdef CONFIG_SND_HDA_PATCH_LOADER
+	/* pick up the codec topology snapshots before probing codecs */
+	if (chip->fw)
+		snd_hda_load_topology(chip->bus, chip->fw->size,
+				      chip->fw->data);
+#endif
+
 	codecs = 0;
 	max_slots = azx_max_codecs[chip->driver_type];
 	if (!max_slots)
@@ -2257,6 +2368,10 @@ static int azx_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 			continue;
 		azx_dev = get_azx_dev(s);
 		if (start) {
+			/* the stream (re)starts from the current position */
+			azx_dev->interp_base = le32_to_cpu(*azx_dev->posbuf);
+			if (azx_dev->interp_base >= azx_dev->bufsize)
+				azx_dev->interp_base = 0;
 			azx_dev->start_wallclk = azx_readl(chip, WALLCLK);
 			if (!rstart)
 				azx_dev->start_wallclk -=
@@ -2384,6 +2499,74 @@ static unsigned int azx_via_get_position(struct azx *chip,
 	return bound_pos + mod_dma_pos;
 }
 
+/*
+ * Interpolate the DMA position with the wall clock.
+ * The position buffer advances only per DMA burst, while the stream runs
+ * in sync with the link clock counted by the timecounter since the start.
+ * The position buffer value is returned as is, so that the pointer stays
+ * in line with the IRQ acceptance check and never goes backward; the
+ * distance to the estimated (i.e. really transferred) position is stored
+ * in *delay instead.  The estimation is validated against the position
+ * buffer and re-synced when it drifts off, e.g. after an xrun.
+ */
+static unsigned int azx_interp_get_position(struct azx *chip,
+					    struct azx_dev *azx_dev,
+					    int *delay)
+{
+	struct snd_pcm_substream *substream = azx_dev->substream;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	unsigned int pos, est, ofs, window;
+	int diff;
+	u64 nsec, frames;
+	u32 rem;
+
+	pos = le32_to_cpu(*azx_dev->posbuf);
+	if (!runtime || !azx_dev->running || pos >= azx_dev->bufsize)
+		return pos;
+
+	/* elapsed frames since the start, modulo the buffer size */
+	nsec = div_u64(timecounter_read(&azx_dev->azx_tc), 3);
+	frames = div_u64_rem(nsec, NSEC_PER_SEC, &rem);
+	frames = frames * runtime->rate +
+		div_u64((u64)rem * runtime->rate, NSEC_PER_SEC);
+	div_u64_rem(frames, runtime->buffer_size, &rem);
+	ofs = frames_to_bytes(runtime, rem);
+
+	est = azx_dev->interp_base + ofs;
+	if (est >= azx_dev->bufsize)
+		est -= azx_dev->bufsize;
+
+	/* the estimation lags behind the DMA (playback) or goes ahead of
+	 * it (capture) by the FIFO at most; take the signed distance
+	 * within the ring and allow a burst of jitter in both directions
+	 */
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		diff = pos - est;
+	else
+		diff = est - pos;
+	if (diff > (int)azx_dev->bufsize / 2)
+		diff -= azx_dev->bufsize;
+	else if (diff <= -(int)azx_dev->bufsize / 2)
+		diff += azx_dev->bufsize;
+	window = frames_to_bytes(runtime, runtime->rate / 1000);
+	if (diff < -(int)window ||
+	    diff > (int)(azx_dev->fifo_size + window)) {
+		/* out of sync; restart from the current DMA position,
+		 * for playback the FIFO contents are yet to be played
+		 */
+		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+			diff = azx_dev->fifo_size;
+		else
+			diff = 0;
+		azx_dev->interp_base = (pos + 2 * azx_dev->bufsize - diff - ofs) %
+			azx_dev->bufsize;
+	}
+
+	if (diff > 0)
+		*delay = bytes_to_frames(runtime, diff);
+	return pos;
+}
+
 static unsigned int azx_get_position(struct azx *chip,
 				     struct azx_dev *azx_dev,
 				     bool with_check)
@@ -2403,6 +2586,9 @@ static unsigned int azx_get_position(struct azx *chip,
 	case POS_FIX_VIACOMBO:
 		pos = azx_via_get_position(chip, azx_dev);
 		break;
+	case POS_FIX_INTERP:
+		pos = azx_interp_get_position(chip, azx_dev, &delay);
+		break;
 	default:
 		/* use the position buffer */
 		pos = le32_to_cpu(*azx_dev->posbuf);
@@ -3275,6 +3461,7 @@ static int check_position_fix(struct azx *chip, int fix)
 	case POS_FIX_POSBUF:
 	case POS_FIX_VIACOMBO:
 	case POS_FIX_COMBO:
+	case POS_FIX_INTERP:
 		return fix;
 	}
 
@@ -3429,7 +3616,7 @@ static int azx_create(struct snd_card *card, struct pci_dev *pci,
 		.dev_free = azx_dev_free,
 	};
 	struct azx *chip;
-	int err;
+	int i, err;
 
 	*rchip = NULL;
 
@@ -3446,6 +3633,8 @@ static int azx_create(struct snd_card *card, struct pci_dev *pci,
 
 	spin_lock_init(&chip->reg_lock);
 	mutex_init(&chip->open_mutex);
+	for (i = 0; i < AZX_MAX_CODECS; i++)
+		init_waitqueue_head(&chip->rirb.wait[i]);
 	chip->card = card;
 	chip->pci = pci;
 	chip->irq = -1;
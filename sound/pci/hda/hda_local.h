@@ -376,6 +376,18 @@ void snd_print_pcm_bits(int pcm, char *buf, int buflen);
 /*
  * Misc
  */
+
+/* PCI SSID of the board; taken from the codec on a bus without PCI device */
+#define snd_hda_board_vendor(codec) \
+	((codec)->bus->pci ? (codec)->bus->pci->subsystem_vendor : \
+	 (codec)->subsystem_id >> 16)
+#define snd_hda_board_device(codec) \
+	((codec)->bus->pci ? (codec)->bus->pci->subsystem_device : \
+	 (codec)->subsystem_id & 0xffff)
+
+const struct snd_pci_quirk *
+snd_hda_quirk_lookup(struct hda_codec *codec,
+		     const struct snd_pci_quirk *list);
 int snd_hda_check_board_config(struct hda_codec *codec, int num_configs,
 			       const char * const *modelnames,
 			       const struct snd_pci_quirk *pci_list);
@@ -587,8 +599,19 @@ struct hda_nid_item {
 	unsigned short flags;
 };
 
+/* descriptor of a control created on demand, see snd_hda_ctl_add_lazy() */
+struct hda_lazy_ctl {
+	struct snd_kcontrol_lazy lazy;
+	struct hda_codec *codec;
+	hda_nid_t nid;
+	struct snd_kcontrol *kctl;	/* set once instantiated */
+};
+
 int snd_hda_ctl_add(struct hda_codec *codec, hda_nid_t nid,
 		    struct snd_kcontrol *kctl);
+int snd_hda_ctl_add_lazy(struct hda_codec *codec, hda_nid_t nid,
+			 const struct snd_kcontrol_new *knew,
+			 unsigned int index, unsigned long private_value);
 int snd_hda_add_nid(struct hda_codec *codec, struct snd_kcontrol *kctl,
 		    unsigned int index, hda_nid_t nid);
 void snd_hda_ctls_clear(struct hda_codec *codec);
@@ -620,6 +643,44 @@ static inline int snd_hda_hwdep_add_sysfs(struct hda_codec *codec)
 }
 #endif
 
+/*
+ * codec topology snapshot, given via [topology] section in the patch
+ */
+#define HDA_TOPO_AMP_CAPS	(1 << 0)	/* amp_caps[] are valid */
+#define HDA_TOPO_PIN_CAPS	(1 << 1)	/* pin_caps is valid */
+#define HDA_TOPO_PIN_CFG	(1 << 2)	/* pin_cfg and pin_ctl are valid */
+
+struct hda_topology_node {
+	u32 wcaps;
+	u32 amp_caps[2];	/* HDA_OUTPUT, HDA_INPUT */
+	u32 pin_caps;
+	u32 pin_cfg;
+	u8 pin_ctl;
+	u8 flags;		/* HDA_TOPO_* */
+	short num_conns;	/* -1 = not recorded */
+	hda_nid_t *conns;
+};
+
+struct hda_topology {
+	struct list_head list;
+	u32 vendor_id;
+	u32 subsystem_id;
+	u32 revision_id;
+	hda_nid_t afg, mfg;
+	unsigned int afg_function;	/* AC_PAR_FUNCTION_TYPE value */
+	unsigned int mfg_function;
+	hda_nid_t start_nid;
+	int num_nodes;
+	int num_wcaps;		/* number of nodes with wcaps given */
+	struct hda_topology_node *nodes;
+};
+
+#ifdef CONFIG_SND_HDA_PATCH_LOADER
+void snd_hda_free_topologies(struct hda_bus *bus);
+#else
+static inline void snd_hda_free_topologies(struct hda_bus *bus) {}
+#endif
+
 #ifdef CONFIG_SND_HDA_RECONFIG
 const char *snd_hda_get_hint(struct hda_codec *codec, const char *key);
 int snd_hda_get_bool_hint(struct hda_codec *codec, const char *key);
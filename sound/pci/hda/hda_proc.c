@@ -91,6 +91,22 @@ static void print_nid_array(struct snd_info_buffer *buffer,
 	}
 }
 
+/* the ids of lazy controls are fixed once added, instantiated or not */
+static void print_nid_lazy_ctls(struct snd_info_buffer *buffer,
+				struct hda_codec *codec, hda_nid_t nid)
+{
+	struct hda_lazy_ctl **lctls = codec->lazy_ctls.list;
+	int i;
+
+	for (i = 0; i < codec->lazy_ctls.used; i++) {
+		if (lctls[i]->nid == nid)
+			snd_iprintf(buffer,
+			  "  Control: name=\"%s\", index=%i, device=%i\n",
+			  lctls[i]->lazy.id.name, lctls[i]->lazy.id.index,
+			  lctls[i]->lazy.id.device);
+	}
+}
+
 static void print_nid_pcms(struct snd_info_buffer *buffer,
 			   struct hda_codec *codec, hda_nid_t nid)
 {
@@ -579,6 +595,7 @@ static void print_gpio(struct snd_info_buffer *buffer,
 			    (unsol & (1<<i)) ? 1 : 0);
 	/* FIXME: add GPO and GPI pin information */
 	print_nid_array(buffer, codec, nid, &codec->mixers);
+	print_nid_lazy_ctls(buffer, codec, nid);
 	print_nid_array(buffer, codec, nid, &codec->nids);
 }
 
@@ -610,6 +627,13 @@ static void print_codec_info(struct snd_info_entry *entry,
 		snd_iprintf(buffer, "Modem Function Group: 0x%x\n", codec->mfg);
 	else
 		snd_iprintf(buffer, "No Modem Function Group found\n");
+#ifdef CONFIG_PM
+	if (codec->resume_count)
+		snd_iprintf(buffer, "Last Resume: %llu ns, %u verbs "
+			    "(%u resumes)\n",
+			    (unsigned long long)codec->resume_ns,
+			    codec->resume_verbs, codec->resume_count);
+#endif
 
 	if (! codec->afg)
 		return;
@@ -667,6 +691,7 @@ static void print_codec_info(struct snd_info_entry *entry,
 		snd_iprintf(buffer, "\n");
 
 		print_nid_array(buffer, codec, nid, &codec->mixers);
+		print_nid_lazy_ctls(buffer, codec, nid);
 		print_nid_array(buffer, codec, nid, &codec->nids);
 		print_nid_pcms(buffer, codec, nid);
 
@@ -0,0 +1,1321 @@
+/*
+ * Virtual HD-audio bus
+ *
+ * Emulates the codecs described by /proc/asound/cardX/codec#Y dump files
+ * on a software bus, so that the codec parsers and the verb traffic can
+ * be exercised and measured without the real hardware.
+ *
+ *  This driver is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This driver is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/delay.h>
+#include <linux/firmware.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/timer.h>
+#include <linux/module.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include <sound/info.h>
+#include <sound/initval.h>
+#include "hda_codec.h"
+#include "hda_local.h"
+
+MODULE_DESCRIPTION("Virtual HD-audio bus replaying codec dumps");
+MODULE_LICENSE("GPL");
+
+#define SND_HDA_VIRT_DRIVER	"snd_hda_virtual"
+
+static int index[SNDRV_CARDS] = SNDRV_DEFAULT_IDX;
+static char *id[SNDRV_CARDS] = SNDRV_DEFAULT_STR;
+static bool enable[SNDRV_CARDS] = {1, [1 ... (SNDRV_CARDS - 1)] = 0};
+static char *dump[SNDRV_CARDS];
+static char *model[SNDRV_CARDS];
+static int verb_delay;
+#ifdef CONFIG_PM
+static int power_save;
+#endif
+
+module_param_array(index, int, NULL, 0444);
+MODULE_PARM_DESC(index, "Index value for virtual HD-audio bus.");
+module_param_array(id, charp, NULL, 0444);
+MODULE_PARM_DESC(id, "ID string for virtual HD-audio bus.");
+module_param_array(enable, bool, NULL, 0444);
+MODULE_PARM_DESC(enable, "Enable virtual HD-audio bus.");
+module_param_array(dump, charp, NULL, 0444);
+MODULE_PARM_DESC(dump, "Firmware file with the codec proc dumps to emulate.");
+module_param_array(model, charp, NULL, 0444);
+MODULE_PARM_DESC(model, "Use the given board model.");
+module_param(verb_delay, int, 0644);
+MODULE_PARM_DESC(verb_delay, "Delay in usec added to each verb "
+		 "(0 = no delay).");
+#ifdef CONFIG_PM
+module_param(power_save, int, 0644);
+MODULE_PARM_DESC(power_save, "Automatic power-saving timeout "
+		 "(in second, 0 = disable).");
+#endif
+
+static struct platform_device *devices[SNDRV_CARDS];
+
+#define VIRT_MAX_CODECS		(HDA_MAX_CODEC_ADDRESS + 1)
+#define VIRT_MAX_CONNS		32
+#define VIRT_MAX_AMPS		16
+#define VIRT_NUM_PARAMS		(AC_PAR_VOL_KNB_CAP + 1)
+#define VIRT_NUM_REGS		0x40	/* 12bit verbs 0x700-0x73f */
+
+/* state of a widget */
+struct virt_node {
+	u32 params[VIRT_NUM_PARAMS];
+	u32 regs[VIRT_NUM_REGS];	/* values of 12bit get/set verbs */
+	u16 format;
+	u16 coef_index;
+	u8 amp[2][VIRT_MAX_AMPS][2];	/* [HDA_OUTPUT/INPUT][index][l/r] */
+	int num_conns;
+	hda_nid_t conns[VIRT_MAX_CONNS];
+	unsigned int writes;		/* number of set verbs */
+};
+
+struct virt_codec {
+	unsigned int addr;
+	hda_nid_t afg, mfg;
+	u32 mfg_function;
+	struct virt_node *nodes[HDA_MAX_NODES];
+	struct virt_node *fg;		/* AFG, until the NID is known */
+
+	/* dump parser state */
+	struct virt_node *cur;
+	int conn_state;
+
+	/* statistics */
+	unsigned long verbs;
+	unsigned long params;
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long unknown;
+	u64 time_ns;
+};
+
+struct hda_virt {
+	struct snd_card *card;
+	struct hda_bus *bus;
+	spinlock_t lock;
+	struct virt_codec *codecs[VIRT_MAX_CODECS];
+	unsigned int res[VIRT_MAX_CODECS];
+
+	/* statistics */
+	unsigned long resets;
+	u64 cmd_ns;
+	u64 create_ns;
+	u64 configure_ns;
+	u64 build_pcms_ns;
+	u64 build_controls_ns;
+};
+
+static inline u64 virt_elapsed_ns(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/*
+ * verb emulation
+ */
+
+static unsigned int virt_get_amp(struct virt_node *node, unsigned int parm)
+{
+	int dir = (parm & AC_AMP_GET_OUTPUT) ? HDA_OUTPUT : HDA_INPUT;
+	int ch = (parm & AC_AMP_GET_LEFT) ? 0 : 1;
+
+	return node->amp[dir][parm & AC_AMP_GET_INDEX][ch];
+}
+
+static void virt_set_amp(struct virt_node *node, unsigned int parm)
+{
+	int idx = (parm & AC_AMP_SET_INDEX) >> AC_AMP_SET_INDEX_SHIFT;
+	int dir;
+
+	for (dir = 0; dir < 2; dir++) {
+		if (!(parm & (dir == HDA_OUTPUT ?
+			      AC_AMP_SET_OUTPUT : AC_AMP_SET_INPUT)))
+			continue;
+		if (parm & AC_AMP_SET_LEFT)
+			node->amp[dir][idx][0] = parm & 0xff;
+		if (parm & AC_AMP_SET_RIGHT)
+			node->amp[dir][idx][1] = parm & 0xff;
+	}
+}
+
+/* short form connection list entries starting from the given index */
+static unsigned int virt_get_conns(struct virt_node *node, unsigned int idx)
+{
+	unsigned int val = 0;
+	int i;
+
+	for (i = 0; i < 4 && idx + i < node->num_conns; i++)
+		val |= node->conns[idx + i] << (i * 8);
+	return val;
+}
+
+/* 12bit set verbs */
+static void virt_set_verb(struct virt_node *node, unsigned int verb,
+			  unsigned int parm)
+{
+	unsigned int reg = verb & 0xff;
+	int shift;
+
+	switch (verb) {
+	case AC_VERB_SET_POWER_STATE:
+		parm &= AC_PWRST_SETTING;
+		node->regs[reg] = parm | (parm << AC_PWRST_ACTUAL_SHIFT);
+		break;
+	case AC_VERB_SET_PIN_SENSE:
+	case AC_VERB_SET_EAPD:
+	case AC_VERB_SET_CODEC_RESET:
+		break;
+	case AC_VERB_SET_DIGI_CONVERT_1:
+	case AC_VERB_SET_DIGI_CONVERT_2:
+		shift = (verb - AC_VERB_SET_DIGI_CONVERT_1) * 8;
+		reg = AC_VERB_GET_DIGI_CONVERT_1 & 0xff;
+		node->regs[reg] &= ~(0xff << shift);
+		node->regs[reg] |= parm << shift;
+		break;
+	case AC_VERB_SET_CONFIG_DEFAULT_BYTES_0 ...
+	     AC_VERB_SET_CONFIG_DEFAULT_BYTES_3:
+		shift = (verb - AC_VERB_SET_CONFIG_DEFAULT_BYTES_0) * 8;
+		reg = AC_VERB_GET_CONFIG_DEFAULT & 0xff;
+		node->regs[reg] &= ~(0xff << shift);
+		node->regs[reg] |= parm << shift;
+		break;
+	case 0x720 ... 0x723:	/* subsystem id bytes */
+		shift = (verb - 0x720) * 8;
+		reg = AC_VERB_GET_SUBSYSTEM_ID & 0xff;
+		node->regs[reg] &= ~(0xff << shift);
+		node->regs[reg] |= parm << shift;
+		break;
+	default:
+		if (reg < VIRT_NUM_REGS)
+			node->regs[reg] = parm;
+		break;
+	}
+}
+
+static unsigned int virt_exec_verb(struct virt_codec *vc, unsigned int cmd)
+{
+	hda_nid_t nid = (cmd >> 20) & 0x7f;
+	unsigned int verb = (cmd >> 8) & 0xfff;
+	unsigned int parm = cmd & 0xff;
+	struct virt_node *node = vc->nodes[nid];
+
+	vc->verbs++;
+	if (!node) {
+		vc->unknown++;
+		return 0;
+	}
+
+	/* 4bit verbs with 16bit payload */
+	switch (verb >> 8) {
+	case AC_VERB_SET_STREAM_FORMAT >> 8:
+		node->format = cmd & 0xffff;
+		goto write;
+	case AC_VERB_SET_AMP_GAIN_MUTE >> 8:
+		virt_set_amp(node, cmd & 0xffff);
+		goto write;
+	case AC_VERB_SET_PROC_COEF >> 8:
+		/* coefficients aren't in the dump */
+		goto write;
+	case AC_VERB_SET_COEF_INDEX >> 8:
+		node->coef_index = cmd & 0xffff;
+		goto write;
+	case AC_VERB_GET_STREAM_FORMAT >> 8:
+		vc->reads++;
+		return node->format;
+	case AC_VERB_GET_AMP_GAIN_MUTE >> 8:
+		vc->reads++;
+		return virt_get_amp(node, cmd & 0xffff);
+	case AC_VERB_GET_PROC_COEF >> 8:
+		vc->reads++;
+		return 0;
+	case AC_VERB_GET_COEF_INDEX >> 8:
+		vc->reads++;
+		return node->coef_index;
+	case 0x7:
+		virt_set_verb(node, verb, parm);
+		goto write;
+	case 0xf:
+		break;
+	default:
+		vc->unknown++;
+		return 0;
+	}
+
+	switch (verb) {
+	case AC_VERB_PARAMETERS:
+		vc->params++;
+		return parm < VIRT_NUM_PARAMS ? node->params[parm] : 0;
+	case AC_VERB_GET_CONNECT_LIST:
+		vc->reads++;
+		return virt_get_conns(node, parm);
+	}
+	if ((verb & 0xff) >= VIRT_NUM_REGS) {
+		vc->unknown++;
+		return 0;
+	}
+	vc->reads++;
+	return node->regs[verb & 0xff];
+
+ write:
+	vc->writes++;
+	node->writes++;
+	return 0;
+}
+
+/*
+ * bus ops
+ */
+
+static int virt_send_cmd(struct hda_bus *bus, unsigned int val)
+{
+	struct hda_virt *chip = bus->private_data;
+	unsigned int addr = val >> 28;
+	struct virt_codec *vc = chip->codecs[addr];
+	ktime_t start;
+
+	if (verb_delay > 0)
+		udelay(verb_delay);
+	spin_lock_irq(&chip->lock);
+	start = ktime_get();
+	if (vc) {
+		chip->res[addr] = virt_exec_verb(vc, val);
+		vc->time_ns += virt_elapsed_ns(start);
+	} else
+		chip->res[addr] = -1;
+	chip->cmd_ns += virt_elapsed_ns(start);
+	spin_unlock_irq(&chip->lock);
+	return 0;
+}
+
+static unsigned int virt_get_response(struct hda_bus *bus, unsigned int addr)
+{
+	struct hda_virt *chip = bus->private_data;
+
+	return chip->res[addr];
+}
+
+static int virt_send_batch(struct hda_bus *bus, const unsigned int *cmds,
+			   unsigned int *res, int count)
+{
+	unsigned int val;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		virt_send_cmd(bus, cmds[i]);
+		val = virt_get_response(bus, cmds[i] >> 28);
+		if (res)
+			res[i] = val;
+	}
+	return count;
+}
+
+static void virt_bus_reset(struct hda_bus *bus)
+{
+	struct hda_virt *chip = bus->private_data;
+
+	spin_lock_irq(&chip->lock);
+	chip->resets++;
+	spin_unlock_irq(&chip->lock);
+}
+
+/*
+ * PCM streams; the position advances with jiffies and a timer
+ * notifies the period boundaries
+ */
+
+struct virt_pcm {
+	struct hda_virt *chip;
+	struct hda_codec *codec;
+	struct hda_pcm_stream *hinfo[2];
+};
+
+struct virt_stream {
+	struct snd_pcm_substream *substream;
+	struct timer_list timer;
+	unsigned long base;		/* jiffies at trigger start */
+	unsigned long period_jiffies;
+	int running;
+};
+
+static struct snd_pcm_hardware virt_pcm_hw = {
+	.info =			(SNDRV_PCM_INFO_MMAP |
+				 SNDRV_PCM_INFO_INTERLEAVED |
+				 SNDRV_PCM_INFO_BLOCK_TRANSFER |
+				 SNDRV_PCM_INFO_MMAP_VALID),
+	.buffer_bytes_max =	64 * 1024,
+	.period_bytes_min =	64,
+	.period_bytes_max =	32 * 1024,
+	.periods_min =		2,
+	.periods_max =		32,
+	.fifo_size =		0,
+};
+
+static void virt_pcm_timer(unsigned long data)
+{
+	struct virt_stream *vs = (struct virt_stream *)data;
+
+	if (!vs->running)
+		return;
+	mod_timer(&vs->timer, jiffies + vs->period_jiffies);
+	snd_pcm_period_elapsed(vs->substream);
+}
+
+static int virt_pcm_open(struct snd_pcm_substream *substream)
+{
+	struct virt_pcm *vpcm = snd_pcm_substream_chip(substream);
+	struct hda_pcm_stream *hinfo = vpcm->hinfo[substream->stream];
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct virt_stream *vs;
+	int err;
+
+	vs = kzalloc(sizeof(*vs), GFP_KERNEL);
+	if (!vs)
+		return -ENOMEM;
+	vs->substream = substream;
+	setup_timer(&vs->timer, virt_pcm_timer, (unsigned long)vs);
+
+	runtime->hw = virt_pcm_hw;
+	runtime->hw.channels_min = hinfo->channels_min;
+	runtime->hw.channels_max = hinfo->channels_max;
+	runtime->hw.formats = hinfo->formats;
+	runtime->hw.rates = hinfo->rates;
+	snd_pcm_limit_hw_rates(runtime);
+	snd_pcm_hw_constraint_integer(runtime, SNDRV_PCM_HW_PARAM_PERIODS);
+
+	snd_hda_power_up_d3wait(vpcm->codec);
+	err = hinfo->ops.open(hinfo, vpcm->codec, substream);
+	if (err < 0) {
+		snd_hda_power_down(vpcm->codec);
+		kfree(vs);
+		return err;
+	}
+	snd_pcm_limit_hw_rates(runtime);
+	runtime->private_data = vs;
+	return 0;
+}
+
+static int virt_pcm_close(struct snd_pcm_substream *substream)
+{
+	struct virt_pcm *vpcm = snd_pcm_substream_chip(substream);
+	struct hda_pcm_stream *hinfo = vpcm->hinfo[substream->stream];
+	struct virt_stream *vs = substream->runtime->private_data;
+
+	del_timer_sync(&vs->timer);
+	hinfo->ops.close(hinfo, vpcm->codec, substream);
+	snd_hda_power_down(vpcm->codec);
+	kfree(vs);
+	return 0;
+}
+
+static int virt_pcm_hw_params(struct snd_pcm_substream *substream,
+			      struct snd_pcm_hw_params *hw_params)
+{
+	return snd_pcm_lib_malloc_pages(substream,
+					params_buffer_bytes(hw_params));
+}
+
+static int virt_pcm_hw_free(struct snd_pcm_substream *substream)
+{
+	struct virt_pcm *vpcm = snd_pcm_substream_chip(substream);
+	struct hda_pcm_stream *hinfo = vpcm->hinfo[substream->stream];
+
+	snd_hda_codec_cleanup(vpcm->codec, hinfo, substream);
+	return snd_pcm_lib_free_pages(substream);
+}
+
+static int virt_pcm_prepare(struct snd_pcm_substream *substream)
+{
+	struct virt_pcm *vpcm = snd_pcm_substream_chip(substream);
+	struct hda_pcm_stream *hinfo = vpcm->hinfo[substream->stream];
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct virt_stream *vs = runtime->private_data;
+	struct hda_spdif_out *spdif =
+		snd_hda_spdif_out_of_nid(vpcm->codec, hinfo->nid);
+	unsigned int format_val, stream_tag;
+
+	format_val = snd_hda_calc_stream_format(runtime->rate,
+						runtime->channels,
+						runtime->format,
+						hinfo->maxbps,
+						spdif ? spdif->ctls : 0);
+	if (!format_val)
+		return -EINVAL;
+	vs->period_jiffies = max_t(unsigned long, 1,
+				   DIV_ROUND_UP(runtime->period_size * HZ,
+						runtime->rate));
+	stream_tag = (substream->pcm->device * 2 + substream->stream) % 15 + 1;
+	return snd_hda_codec_prepare(vpcm->codec, hinfo, stream_tag,
+				     format_val, substream);
+}
+
+static int virt_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
+{
+	struct virt_stream *vs = substream->runtime->private_data;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+		vs->base = jiffies;
+		vs->running = 1;
+		mod_timer(&vs->timer, jiffies + vs->period_jiffies);
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		vs->running = 0;
+		del_timer(&vs->timer);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static snd_pcm_uframes_t virt_pcm_pointer(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct virt_stream *vs = runtime->private_data;
+	u64 frames;
+
+	if (!vs->running)
+		return 0;
+	frames = (u64)(jiffies - vs->base) * runtime->rate;
+	do_div(frames, HZ);
+	return do_div(frames, (u32)runtime->buffer_size);
+}
+
+static struct snd_pcm_ops virt_pcm_ops = {
+	.open = virt_pcm_open,
+	.close = virt_pcm_close,
+	.ioctl = snd_pcm_lib_ioctl,
+	.hw_params = virt_pcm_hw_params,
+	.hw_free = virt_pcm_hw_free,
+	.prepare = virt_pcm_prepare,
+	.trigger = virt_pcm_trigger,
+	.pointer = virt_pcm_pointer,
+};
+
+static void virt_pcm_free(struct snd_pcm *pcm)
+{
+	kfree(pcm->private_data);
+}
+
+static int virt_attach_pcm(struct hda_bus *bus, struct hda_codec *codec,
+			   struct hda_pcm *cpcm)
+{
+	struct hda_virt *chip = bus->private_data;
+	struct snd_pcm *pcm;
+	struct virt_pcm *vpcm;
+	int s, err;
+
+	err = snd_pcm_new(chip->card, cpcm->name, cpcm->device,
+			  cpcm->stream[SNDRV_PCM_STREAM_PLAYBACK].substreams,
+			  cpcm->stream[SNDRV_PCM_STREAM_CAPTURE].substreams,
+			  &pcm);
+	if (err < 0)
+		return err;
+	strlcpy(pcm->name, cpcm->name, sizeof(pcm->name));
+	vpcm = kzalloc(sizeof(*vpcm), GFP_KERNEL);
+	if (!vpcm)
+		return -ENOMEM;
+	vpcm->chip = chip;
+	vpcm->codec = codec;
+	pcm->private_data = vpcm;
+	pcm->private_free = virt_pcm_free;
+	if (cpcm->pcm_type == HDA_PCM_TYPE_MODEM)
+		pcm->dev_class = SNDRV_PCM_CLASS_MODEM;
+	cpcm->pcm = pcm;
+	for (s = 0; s < 2; s++) {
+		vpcm->hinfo[s] = &cpcm->stream[s];
+		if (cpcm->stream[s].substreams)
+			snd_pcm_set_ops(pcm, s, &virt_pcm_ops);
+	}
+	snd_pcm_lib_preallocate_pages_for_all(pcm, SNDRV_DMA_TYPE_CONTINUOUS,
+					      snd_dma_continuous_data(GFP_KERNEL),
+					      virt_pcm_hw.buffer_bytes_max,
+					      virt_pcm_hw.buffer_bytes_max);
+	return 0;
+}
+
+/*
+ * codec dump parser
+ *
+ * The dump is the output of /proc/asound/cardX/codec#Y; several dumps
+ * can be concatenated into one file, each starting with "Codec:" line.
+ */
+
+static const char * const virt_pwr_caps[32] = {
+	[ilog2(AC_PWRST_D0SUP)]		= "D0",
+	[ilog2(AC_PWRST_D1SUP)]		= "D1",
+	[ilog2(AC_PWRST_D2SUP)]		= "D2",
+	[ilog2(AC_PWRST_D3SUP)]		= "D3",
+	[ilog2(AC_PWRST_D3COLDSUP)]	= "D3cold",
+	[ilog2(AC_PWRST_S3D3COLDSUP)]	= "S3D3cold",
+	[ilog2(AC_PWRST_CLKSTOP)]	= "CLKSTOP",
+	[ilog2(AC_PWRST_EPSS)]		= "EPSS",
+};
+
+static const char * const virt_dig_bits[8] = {
+	"Enabled", "Validity", "ValidityCfg", "Preemphasis",
+	"Non-Copyright", "Non-Audio", "Pro", "GenLevel",
+};
+
+/* return the bits of the names found in the given space-separated list */
+static unsigned int parse_bit_names(char *s, const char * const *names,
+				    int num_names)
+{
+	unsigned int bits = 0;
+	char *tok;
+	int i;
+
+	while ((tok = strsep(&s, " ")) != NULL) {
+		for (i = 0; i < num_names; i++) {
+			if (names[i] && !strcmp(tok, names[i]))
+				bits |= 1U << i;
+		}
+	}
+	return bits;
+}
+
+/* "D0" .. "D3cold" to the power state value */
+static unsigned int parse_pwr_state(const char *s)
+{
+	unsigned int i;
+
+	for (i = 0; i <= ilog2(AC_PWRST_D3COLDSUP); i++) {
+		if (!strcmp(s, virt_pwr_caps[i]))
+			return i;
+	}
+	return AC_PWRST_D0;
+}
+
+static u32 parse_amp_caps(const char *s)
+{
+	unsigned int ofs, nsteps, stepsize, mute;
+
+	if (sscanf(s, "ofs=%x, nsteps=%x, stepsize=%x, mute=%x",
+		   &ofs, &nsteps, &stepsize, &mute) != 4)
+		return 0;
+	return (ofs << AC_AMPCAP_OFFSET_SHIFT) |
+		(nsteps << AC_AMPCAP_NUM_STEPS_SHIFT) |
+		(stepsize << AC_AMPCAP_STEP_SIZE_SHIFT) |
+		(mute << AC_AMPCAP_MUTE_SHIFT);
+}
+
+static void parse_amp_vals(struct virt_node *node, int dir, char *s)
+{
+	unsigned int l, r;
+	int idx;
+
+	for (idx = 0; idx < VIRT_MAX_AMPS; idx++) {
+		s = strchr(s, '[');
+		if (!s)
+			break;
+		s++;
+		switch (sscanf(s, "%x %x", &l, &r)) {
+		case 1:
+			r = l;
+			/* fallthrough */
+		case 2:
+			node->amp[dir][idx][0] = l;
+			node->amp[dir][idx][1] = r;
+			break;
+		default:
+			return;
+		}
+	}
+}
+
+static void parse_conn_list(struct virt_node *node, char *s)
+{
+	unsigned long val;
+	char *tok, *sel;
+
+	node->num_conns = 0;
+	while ((tok = strsep(&s, " ")) != NULL) {
+		if (!*tok || node->num_conns >= VIRT_MAX_CONNS)
+			continue;
+		sel = strchr(tok, '*');
+		if (sel) {
+			*sel = 0;
+			node->regs[AC_VERB_GET_CONNECT_SEL & 0xff] =
+				node->num_conns;
+		}
+		if (kstrtoul(tok, 16, &val))
+			continue;
+		node->conns[node->num_conns++] = val;
+	}
+	node->params[AC_PAR_CONNLIST_LEN] = node->num_conns;
+}
+
+static struct virt_node *virt_new_node(struct virt_codec *vc, int nid)
+{
+	if (nid < 0 || nid >= HDA_MAX_NODES)
+		return NULL;
+	if (!vc->nodes[nid])
+		vc->nodes[nid] = kzalloc(sizeof(struct virt_node), GFP_KERNEL);
+	return vc->nodes[nid];
+}
+
+static void virt_free_codec(struct virt_codec *vc)
+{
+	int i;
+
+	if (!vc)
+		return;
+	for (i = 0; i < HDA_MAX_NODES; i++) {
+		if (vc->nodes[i] != vc->fg)
+			kfree(vc->nodes[i]);
+	}
+	kfree(vc->fg);
+	kfree(vc);
+}
+
+static struct virt_codec *virt_new_codec(void)
+{
+	struct virt_codec *vc;
+
+	vc = kzalloc(sizeof(*vc), GFP_KERNEL);
+	if (!vc)
+		return NULL;
+	vc->fg = kzalloc(sizeof(struct virt_node), GFP_KERNEL);
+	if (!vc->fg || !virt_new_node(vc, AC_NODE_ROOT)) {
+		virt_free_codec(vc);
+		return NULL;
+	}
+	vc->cur = vc->fg;
+	return vc;
+}
+
+/* return the rest of the line if it starts with the prefix */
+static char *match_prefix(char *line, const char *prefix)
+{
+	int len = strlen(prefix);
+
+	if (strncmp(line, prefix, len))
+		return NULL;
+	return skip_spaces(line + len);
+}
+
+static int virt_parse_line(struct virt_codec *vc, char *line)
+{
+	struct virt_node *root = vc->nodes[AC_NODE_ROOT];
+	struct virt_node *node = vc->cur;
+	unsigned int a, b, c, d, e, f, g;
+	int conn_state = vc->conn_state;
+	char *p;
+
+	vc->conn_state = 0;
+	if (!strncmp(line, "0x", 2)) {
+		if (conn_state == 1)
+			parse_conn_list(node, line);
+		return 0;
+	}
+
+	if ((p = match_prefix(line, "Address:"))) {
+		if (!kstrtouint(p, 0, &a))
+			vc->addr = a;
+	} else if ((p = match_prefix(line, "AFG Function Id:"))) {
+		if (sscanf(p, "%x (unsol %u)", &a, &b) == 2)
+			vc->fg->params[AC_PAR_FUNCTION_TYPE] = a | (b << 8);
+	} else if ((p = match_prefix(line, "MFG Function Id:"))) {
+		if (sscanf(p, "%x (unsol %u)", &a, &b) == 2)
+			vc->mfg_function = a | (b << 8);
+	} else if ((p = match_prefix(line, "Vendor Id:"))) {
+		if (!kstrtouint(p, 0, &a))
+			root->params[AC_PAR_VENDOR_ID] = a;
+	} else if ((p = match_prefix(line, "Subsystem Id:"))) {
+		if (!kstrtouint(p, 0, &a)) {
+			root->params[AC_PAR_SUBSYSTEM_ID] = a;
+			vc->fg->regs[AC_VERB_GET_SUBSYSTEM_ID & 0xff] = a;
+		}
+	} else if ((p = match_prefix(line, "Revision Id:"))) {
+		if (!kstrtouint(p, 0, &a))
+			root->params[AC_PAR_REV_ID] = a;
+	} else if ((p = match_prefix(line, "Modem Function Group:"))) {
+		if (kstrtouint(p, 0, &a) || a == AC_NODE_ROOT)
+			return 0;
+		node = virt_new_node(vc, a);
+		if (!node)
+			return -ENOMEM;
+		node->params[AC_PAR_FUNCTION_TYPE] = vc->mfg_function;
+		vc->mfg = a;
+	} else if (match_prefix(line, "Default PCM:")) {
+		vc->cur = vc->fg;
+	} else if ((p = match_prefix(line, "Default Amp-In caps:"))) {
+		vc->fg->params[AC_PAR_AMP_IN_CAP] = parse_amp_caps(p);
+	} else if ((p = match_prefix(line, "Default Amp-Out caps:"))) {
+		vc->fg->params[AC_PAR_AMP_OUT_CAP] = parse_amp_caps(p);
+	} else if ((p = match_prefix(line, "State of AFG node"))) {
+		if (sscanf(p, "%x", &a) != 1 || !a || a >= HDA_MAX_NODES ||
+		    vc->nodes[a])
+			return 0;
+		vc->afg = a;
+		vc->nodes[a] = vc->fg;
+		vc->cur = vc->fg;
+	} else if ((p = match_prefix(line, "GPIO:"))) {
+		if (sscanf(p, "io=%u, o=%u, i=%u, unsolicited=%u, wake=%u",
+			   &a, &b, &c, &d, &e) == 5)
+			vc->fg->params[AC_PAR_GPIO_CAP] = a |
+				(b << AC_GPIO_O_COUNT_SHIFT) |
+				(c << AC_GPIO_I_COUNT_SHIFT) |
+				(d ? AC_GPIO_UNSOLICITED : 0) |
+				(e ? AC_GPIO_WAKE : 0);
+	} else if ((p = match_prefix(line, "IO["))) {
+		if (sscanf(p, "%u]: enable=%u, dir=%u, wake=%u, sticky=%u, "
+			   "data=%u, unsol=%u", &a, &b, &c, &d, &e, &f, &g) != 7 ||
+		    a >= 8)
+			return 0;
+		node = vc->fg;
+		node->regs[AC_VERB_GET_GPIO_MASK & 0xff] |= b << a;
+		node->regs[AC_VERB_GET_GPIO_DIRECTION & 0xff] |= c << a;
+		node->regs[AC_VERB_GET_GPIO_WAKE_MASK & 0xff] |= d << a;
+		node->regs[AC_VERB_GET_GPIO_STICKY_MASK & 0xff] |= e << a;
+		node->regs[AC_VERB_GET_GPIO_DATA & 0xff] |= f << a;
+		node->regs[AC_VERB_GET_GPIO_UNSOLICITED_RSP_MASK & 0xff] |=
+			g << a;
+	} else if ((p = match_prefix(line, "Node"))) {
+		if (sscanf(p, "%x", &a) != 1 || !a)
+			return 0;
+		p = strstr(p, "] wcaps ");
+		if (!p || sscanf(p, "] wcaps %x", &b) != 1)
+			return 0;
+		node = virt_new_node(vc, a);
+		if (!node)
+			return -ENOMEM;
+		node->params[AC_PAR_AUDIO_WIDGET_CAP] = b;
+		vc->cur = node;
+	} else if ((p = match_prefix(line, "Amp-In caps:"))) {
+		node->params[AC_PAR_AMP_IN_CAP] = parse_amp_caps(p);
+	} else if ((p = match_prefix(line, "Amp-Out caps:"))) {
+		node->params[AC_PAR_AMP_OUT_CAP] = parse_amp_caps(p);
+	} else if ((p = match_prefix(line, "Amp-In vals:"))) {
+		parse_amp_vals(node, HDA_INPUT, p);
+	} else if ((p = match_prefix(line, "Amp-Out vals:"))) {
+		parse_amp_vals(node, HDA_OUTPUT, p);
+	} else if ((p = match_prefix(line, "Pincap"))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->params[AC_PAR_PIN_CAP] = a;
+	} else if ((p = match_prefix(line, "EAPD"))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->regs[AC_VERB_GET_EAPD_BTLENABLE & 0xff] = a;
+	} else if ((p = match_prefix(line, "Pin Default"))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->regs[AC_VERB_GET_CONFIG_DEFAULT & 0xff] = a;
+	} else if ((p = match_prefix(line, "Pin-ctls:"))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->regs[AC_VERB_GET_PIN_WIDGET_CONTROL & 0xff] = a;
+	} else if ((p = match_prefix(line, "Volume-Knob:"))) {
+		if (sscanf(p, "delta=%u, steps=%u, direct=%u, val=%u",
+			   &a, &b, &c, &d) != 4)
+			return 0;
+		node->params[AC_PAR_VOL_KNB_CAP] = (a << 7) | b;
+		node->regs[AC_VERB_GET_VOLUME_KNOB_CONTROL & 0xff] =
+			(c << 7) | d;
+	} else if ((p = match_prefix(line, "Converter:"))) {
+		if (sscanf(p, "stream=%u, channel=%u", &a, &b) == 2)
+			node->regs[AC_VERB_GET_CONV & 0xff] =
+				(a << AC_CONV_STREAM_SHIFT) | b;
+	} else if ((p = match_prefix(line, "SDI-Select:"))) {
+		if (!kstrtouint(p, 0, &a))
+			node->regs[AC_VERB_GET_SDI_SELECT & 0xff] = a;
+	} else if ((p = match_prefix(line, "Digital category:"))) {
+		if (!kstrtouint(p, 0, &a))
+			node->regs[AC_VERB_GET_DIGI_CONVERT_1 & 0xff] |= a << 8;
+	} else if ((p = match_prefix(line, "Digital:"))) {
+		node->regs[AC_VERB_GET_DIGI_CONVERT_1 & 0xff] |=
+			parse_bit_names(p, virt_dig_bits,
+					ARRAY_SIZE(virt_dig_bits));
+	} else if ((p = match_prefix(line, "rates ["))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->params[AC_PAR_PCM] |= a & AC_SUPPCM_RATES;
+	} else if ((p = match_prefix(line, "bits ["))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->params[AC_PAR_PCM] |= (a & 0xff) << 16;
+	} else if ((p = match_prefix(line, "formats ["))) {
+		if (sscanf(p, "%x", &a) == 1)
+			node->params[AC_PAR_STREAM] = a;
+	} else if ((p = match_prefix(line, "Unsolicited:"))) {
+		if (sscanf(p, "tag=%x, enabled=%u", &a, &b) == 2)
+			node->regs[AC_VERB_GET_UNSOLICITED_RESPONSE & 0xff] =
+				(a & AC_UNSOL_TAG) | (b ? AC_UNSOL_ENABLED : 0);
+	} else if ((p = match_prefix(line, "Power states:"))) {
+		node->params[AC_PAR_POWER_STATE] =
+			parse_bit_names(p, virt_pwr_caps,
+					ARRAY_SIZE(virt_pwr_caps));
+	} else if ((p = match_prefix(line, "Power:"))) {
+		char setting[8], actual[8];
+
+		if (sscanf(p, "setting=%7[^,], actual=%7[^,]",
+			   setting, actual) == 2)
+			node->regs[AC_VERB_GET_POWER_STATE & 0xff] =
+				parse_pwr_state(setting) |
+				(parse_pwr_state(actual) <<
+				 AC_PWRST_ACTUAL_SHIFT);
+	} else if (match_prefix(line, "Connection:")) {
+		vc->conn_state = 1;
+	} else if (match_prefix(line, "In-driver Connection:")) {
+		vc->conn_state = 2;
+	} else if ((p = match_prefix(line, "Processing caps:"))) {
+		if (sscanf(p, "benign=%u, ncoeff=%u", &a, &b) == 2)
+			node->params[AC_PAR_PROC_CAP] = a |
+				(b << AC_PCAP_NUM_COEF_SHIFT);
+	}
+	return 0;
+}
+
+/* set up the node counts and register the parsed codec */
+static void virt_add_codec(struct hda_virt *chip, struct virt_codec *vc)
+{
+	int nid, first = 0, last = 0;
+
+	if (!vc->afg && !vc->mfg) {
+		virt_free_codec(vc);
+		return;
+	}
+	if (vc->addr >= VIRT_MAX_CODECS || chip->codecs[vc->addr]) {
+		snd_printk(KERN_WARNING "hda_virtual: "
+			   "invalid or duplicated codec address %u\n",
+			   vc->addr);
+		virt_free_codec(vc);
+		return;
+	}
+
+	for (nid = 1; nid < HDA_MAX_NODES; nid++) {
+		if (!vc->nodes[nid] || nid == vc->afg || nid == vc->mfg)
+			continue;
+		if (!first)
+			first = nid;
+		last = nid;
+	}
+	if (vc->afg && first)
+		vc->fg->params[AC_PAR_NODE_COUNT] = (first << 16) |
+			(last - first + 1);
+
+	/* function group nodes under the root */
+	if (vc->afg && vc->mfg) {
+		first = min(vc->afg, vc->mfg);
+		last = max(vc->afg, vc->mfg);
+	} else
+		first = last = vc->afg ? vc->afg : vc->mfg;
+	vc->nodes[AC_NODE_ROOT]->params[AC_PAR_NODE_COUNT] = (first << 16) |
+		(last - first + 1);
+
+	if (!vc->afg) {
+		kfree(vc->fg);
+		vc->fg = NULL;
+	}
+	chip->codecs[vc->addr] = vc;
+}
+
+static int virt_parse_dump(struct hda_virt *chip, const struct firmware *fw)
+{
+	struct virt_codec *vc = NULL;
+	char *text, *p, *line;
+	int err = 0;
+
+	text = kmalloc(fw->size + 1, GFP_KERNEL);
+	if (!text)
+		return -ENOMEM;
+	memcpy(text, fw->data, fw->size);
+	text[fw->size] = 0;
+	p = text;
+	while ((line = strsep(&p, "\n")) != NULL) {
+		line = strim(line);
+		if (match_prefix(line, "Codec:")) {
+			if (vc)
+				virt_add_codec(chip, vc);
+			vc = virt_new_codec();
+			if (!vc) {
+				err = -ENOMEM;
+				break;
+			}
+			continue;
+		}
+		if (!vc)
+			continue;
+		err = virt_parse_line(vc, line);
+		if (err < 0)
+			break;
+	}
+	if (vc) {
+		if (err < 0)
+			virt_free_codec(vc);
+		else
+			virt_add_codec(chip, vc);
+	}
+	kfree(text);
+	return err;
+}
+
+/*
+ * proc interface: statistics and jack plugging
+ */
+
+#ifdef CONFIG_PROC_FS
+static void virt_proc_read(struct snd_info_entry *entry,
+			   struct snd_info_buffer *buffer)
+{
+	struct hda_virt *chip = entry->private_data;
+	struct virt_codec *vc;
+	int i, nid;
+
+	snd_iprintf(buffer, "# times in nsec\n");
+	snd_iprintf(buffer, "probe: create %llu configure %llu "
+		    "build_pcms %llu build_controls %llu\n",
+		    chip->create_ns, chip->configure_ns,
+		    chip->build_pcms_ns, chip->build_controls_ns);
+	spin_lock_irq(&chip->lock);
+	snd_iprintf(buffer, "bus: resets %lu cmd_time %llu\n",
+		    chip->resets, chip->cmd_ns);
+	for (i = 0; i < VIRT_MAX_CODECS; i++) {
+		vc = chip->codecs[i];
+		if (!vc)
+			continue;
+		snd_iprintf(buffer, "codec#%d: verbs %lu params %lu reads %lu "
+			    "writes %lu unknown %lu time %llu\n",
+			    i, vc->verbs, vc->params, vc->reads,
+			    vc->writes, vc->unknown, vc->time_ns);
+		for (nid = 0; nid < HDA_MAX_NODES; nid++) {
+			if (vc->nodes[nid] && vc->nodes[nid]->writes)
+				snd_iprintf(buffer, "  node 0x%02x: writes %u\n",
+					    nid, vc->nodes[nid]->writes);
+		}
+	}
+	spin_unlock_irq(&chip->lock);
+}
+
+static void virt_reset_stats(struct hda_virt *chip)
+{
+	struct virt_codec *vc;
+	int i, nid;
+
+	chip->resets = 0;
+	chip->cmd_ns = 0;
+	for (i = 0; i < VIRT_MAX_CODECS; i++) {
+		vc = chip->codecs[i];
+		if (!vc)
+			continue;
+		vc->verbs = vc->params = vc->reads = 0;
+		vc->writes = vc->unknown = 0;
+		vc->time_ns = 0;
+		for (nid = 0; nid < HDA_MAX_NODES; nid++) {
+			if (vc->nodes[nid])
+				vc->nodes[nid]->writes = 0;
+		}
+	}
+}
+
+/* change the pin sense and issue the unsolicited event if enabled */
+static void virt_plug_jack(struct hda_virt *chip, unsigned int addr,
+			   unsigned int nid, bool plugged)
+{
+	struct virt_node *node;
+	unsigned int unsol;
+
+	if (addr >= VIRT_MAX_CODECS || !chip->codecs[addr] ||
+	    nid >= HDA_MAX_NODES)
+		return;
+	spin_lock_irq(&chip->lock);
+	node = chip->codecs[addr]->nodes[nid];
+	if (!node) {
+		spin_unlock_irq(&chip->lock);
+		return;
+	}
+	node->regs[AC_VERB_GET_PIN_SENSE & 0xff] =
+		plugged ? AC_PINSENSE_PRESENCE : 0;
+	unsol = node->regs[AC_VERB_GET_UNSOLICITED_RESPONSE & 0xff];
+	spin_unlock_irq(&chip->lock);
+	if (unsol & AC_UNSOL_ENABLED)
+		snd_hda_queue_unsol_event(chip->bus,
+				(unsol & AC_UNSOL_TAG) << AC_UNSOL_RES_TAG_SHIFT,
+				addr);
+}
+
+/*
+ * accepted commands:
+ *   jack <addr> <nid> <0|1>	plug/unplug the pin
+ *   reset			clear the statistics
+ */
+static void virt_proc_write(struct snd_info_entry *entry,
+			    struct snd_info_buffer *buffer)
+{
+	struct hda_virt *chip = entry->private_data;
+	char line[64];
+	unsigned int addr, nid, plugged;
+
+	while (!snd_info_get_line(buffer, line, sizeof(line))) {
+		if (sscanf(line, "jack %u %x %u", &addr, &nid, &plugged) == 3)
+			virt_plug_jack(chip, addr, nid, plugged);
+		else if (!strcmp(line, "reset")) {
+			spin_lock_irq(&chip->lock);
+			virt_reset_stats(chip);
+			spin_unlock_irq(&chip->lock);
+		}
+	}
+}
+
+static void virt_proc_init(struct hda_virt *chip)
+{
+	struct snd_info_entry *entry;
+
+	if (!snd_card_proc_new(chip->card, "hda_virtual", &entry)) {
+		snd_info_set_text_ops(entry, chip, virt_proc_read);
+		entry->c.text.write = virt_proc_write;
+		entry->mode |= S_IWUSR;
+	}
+}
+#else
+#define virt_proc_init(x)
+#endif /* CONFIG_PROC_FS */
+
+/*
+ * probe
+ */
+
+static void virt_card_free(struct snd_card *card)
+{
+	struct hda_virt *chip = card->private_data;
+	int i;
+
+	for (i = 0; i < VIRT_MAX_CODECS; i++)
+		virt_free_codec(chip->codecs[i]);
+}
+
+static int virt_codec_create(struct hda_virt *chip, int dev)
+{
+	struct hda_bus_template bus_temp;
+	struct hda_codec *codec;
+	ktime_t start;
+	int c, codecs, err;
+
+	memset(&bus_temp, 0, sizeof(bus_temp));
+	bus_temp.private_data = chip;
+	bus_temp.modelname = model[dev];
+	bus_temp.ops.command = virt_send_cmd;
+	bus_temp.ops.get_response = virt_get_response;
+	bus_temp.ops.command_batch = virt_send_batch;
+	bus_temp.ops.attach_pcm = virt_attach_pcm;
+	bus_temp.ops.bus_reset = virt_bus_reset;
+#ifdef CONFIG_PM
+	bus_temp.power_save = &power_save;
+#endif
+
+	err = snd_hda_bus_new(chip->card, &bus_temp, &chip->bus);
+	if (err < 0)
+		return err;
+
+	codecs = 0;
+	start = ktime_get();
+	for (c = 0; c < VIRT_MAX_CODECS; c++) {
+		if (!chip->codecs[c])
+			continue;
+		if (snd_hda_codec_new(chip->bus, c, &codec) < 0)
+			continue;
+		codecs++;
+	}
+	chip->create_ns = virt_elapsed_ns(start);
+	if (!codecs)
+		return -ENXIO;
+
+	start = ktime_get();
+	list_for_each_entry(codec, &chip->bus->codec_list, list)
+		snd_hda_codec_configure(codec);
+	chip->configure_ns = virt_elapsed_ns(start);
+
+	start = ktime_get();
+	err = snd_hda_build_pcms(chip->bus);
+	chip->build_pcms_ns = virt_elapsed_ns(start);
+	if (err < 0)
+		return err;
+
+	start = ktime_get();
+	err = snd_hda_build_controls(chip->bus);
+	chip->build_controls_ns = virt_elapsed_ns(start);
+	return err;
+}
+
+/* snd_hda_codec_new() leaves the codecs powered up */
+static void virt_power_down_all_codecs(struct hda_virt *chip)
+{
+#ifdef CONFIG_PM
+	struct hda_codec *codec;
+
+	list_for_each_entry(codec, &chip->bus->codec_list, list)
+		snd_hda_power_down(codec);
+#endif
+}
+
+static int snd_hda_virt_probe(struct platform_device *devptr)
+{
+	const struct firmware *fw;
+	struct snd_card *card;
+	struct hda_virt *chip;
+	int dev = devptr->id;
+	int err;
+
+	if (!dump[dev]) {
+		snd_printk(KERN_ERR "hda_virtual: no dump file given\n");
+		return -EINVAL;
+	}
+	err = snd_card_create(index[dev], id[dev], THIS_MODULE,
+			      sizeof(struct hda_virt), &card);
+	if (err < 0)
+		return err;
+	chip = card->private_data;
+	chip->card = card;
+	spin_lock_init(&chip->lock);
+	card->private_free = virt_card_free;
+	snd_card_set_dev(card, &devptr->dev);
+
+	err = request_firmware(&fw, dump[dev], &devptr->dev);
+	if (err < 0) {
+		snd_printk(KERN_ERR "hda_virtual: cannot load dump %s\n",
+			   dump[dev]);
+		goto error;
+	}
+	err = virt_parse_dump(chip, fw);
+	release_firmware(fw);
+	if (err < 0)
+		goto error;
+
+	/* without bus->pci, the quirks are looked up via the codec SSIDs */
+	err = virt_codec_create(chip, dev);
+	if (err < 0)
+		goto error;
+
+	strcpy(card->driver, "HDA-Virtual");
+	strcpy(card->shortname, "HDA Virtual");
+	sprintf(card->longname, "HDA Virtual %i (%s)", dev + 1, dump[dev]);
+	virt_proc_init(chip);
+
+	err = snd_card_register(card);
+	if (err < 0)
+		goto error;
+	virt_power_down_all_codecs(chip);
+	platform_set_drvdata(devptr, card);
+	return 0;
+
+ error:
+	snd_card_free(card);
+	return err;
+}
+
+static int snd_hda_virt_remove(struct platform_device *devptr)
+{
+	snd_card_free(platform_get_drvdata(devptr));
+	platform_set_drvdata(devptr, NULL);
+	return 0;
+}
+
+#ifdef CONFIG_PM_SLEEP
+static int snd_hda_virt_suspend(struct device *pdev)
+{
+	struct snd_card *card = dev_get_drvdata(pdev);
+	struct hda_virt *chip = card->private_data;
+
+	snd_power_change_state(card, SNDRV_CTL_POWER_D3hot);
+	snd_hda_suspend(chip->bus);
+	return 0;
+}
+
+static int snd_hda_virt_resume(struct device *pdev)
+{
+	struct snd_card *card = dev_get_drvdata(pdev);
+	struct hda_virt *chip = card->private_data;
+
+	snd_hda_resume(chip->bus);
+	snd_power_change_state(card, SNDRV_CTL_POWER_D0);
+	return 0;
+}
+
+static SIMPLE_DEV_PM_OPS(snd_hda_virt_pm, snd_hda_virt_suspend,
+			 snd_hda_virt_resume);
+#define SND_HDA_VIRT_PM_OPS	&snd_hda_virt_pm
+#else
+#define SND_HDA_VIRT_PM_OPS	NULL
+#endif
+
+static struct platform_driver snd_hda_virt_driver = {
+	.probe		= snd_hda_virt_probe,
+	.remove		= snd_hda_virt_remove,
+	.driver		= {
+		.name	= SND_HDA_VIRT_DRIVER,
+		.owner	= THIS_MODULE,
+		.pm	= SND_HDA_VIRT_PM_OPS,
+	},
+};
+
+static void snd_hda_virt_unregister_all(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(devices); ++i)
+		platform_device_unregister(devices[i]);
+	platform_driver_unregister(&snd_hda_virt_driver);
+}
+
+static int __init alsa_card_hda_virt_init(void)
+{
+	int i, cards, err;
+
+	err = platform_driver_register(&snd_hda_virt_driver);
+	if (err < 0)
+		return err;
+
+	cards = 0;
+	for (i = 0; i < SNDRV_CARDS; i++) {
+		struct platform_device *device;
+		if (!enable[i] || !dump[i])
+			continue;
+		device = platform_device_register_simple(SND_HDA_VIRT_DRIVER,
+							 i, NULL, 0);
+		if (IS_ERR(device))
+			continue;
+		if (!platform_get_drvdata(device)) {
+			platform_device_unregister(device);
+			continue;
+		}
+		devices[i] = device;
+		cards++;
+	}
+	if (!cards) {
+#ifdef MODULE
+		printk(KERN_ERR "Virtual HD-audio bus: no codec dump loaded\n");
+#endif
+		snd_hda_virt_unregister_all();
+		return -ENODEV;
+	}
+	return 0;
+}
+
+static void __exit alsa_card_hda_virt_exit(void)
+{
+	snd_hda_virt_unregister_all();
+}
+
+module_init(alsa_card_hda_virt_init)
+module_exit(alsa_card_hda_virt_exit)
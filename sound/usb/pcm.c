@@ -1141,6 +1141,9 @@ static int setup_hw_info(struct snd_pcm_runtime *runtime, struct snd_usb_substre
 	}
 	if ((err = snd_usb_pcm_check_knot(runtime, subs)) < 0)
 		goto rep_err;
+	/* all rules above depend only on the fixed format list */
+	if ((err = snd_pcm_hw_refine_cache_enable(runtime)) < 0)
+		goto rep_err;
 	return 0;
 
 rep_err: